@@ -0,0 +1,304 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "imgui.h"
+#include "fmt/format.h"
+
+#include "asset_cache.hpp"
+#include "logger.hpp"
+
+namespace someone {
+
+namespace {
+
+constexpr size_t megabyte = 1024 * 1024;
+
+}
+
+AssetCache::AssetCache() {
+    // Textures are in VRAM, decoded sounds in RAM
+    cache_of(Type::Texture).stats.budget = 256 * megabyte;
+    cache_of(Type::Sound).stats.budget = 128 * megabyte;
+}
+
+AssetCache::Type AssetCache::type_of(std::string_view name) {
+    if (name == "textures")
+        return Type::Texture;
+    else if (name == "sounds")
+        return Type::Sound;
+
+    throw std::invalid_argument(fmt::format("There's no cache for {} assets", name));
+}
+
+AssetCache::Entry *AssetCache::find(Type type, const std::string &key) {
+    auto &cache = cache_of(type);
+
+    auto found = cache.keys.find(key);
+    if (found == cache.keys.end())
+        return nullptr;
+
+    return &cache.entries.at(found->second);
+}
+
+AssetCache::Entry &AssetCache::insert(Type type, const std::string &key, size_t size) {
+    auto &cache = cache_of(type);
+
+    // An asset that's loaded again replaces the old one, the objects that still use the old one keep it
+    if (auto old = find(type, key))
+        detach(cache, *old);
+
+    auto id = next_id++;
+    auto &entry = cache.entries[id];
+    entry.key = key;
+    entry.id = id;
+    entry.size = size;
+    cache.keys[key] = id;
+
+    cache.lru.push_front(&entry);
+    entry.used = cache.lru.begin();
+
+    cache.stats.count++;
+    cache.stats.bytes += size;
+
+    return entry;
+}
+
+void AssetCache::erase(Cache &cache, Entry &entry) {
+    if (auto page = cache.entries.find(entry.page); entry.page != 0 && page != cache.entries.end()) {
+        auto &regions = page->second.regions;
+        regions.erase(std::remove(regions.begin(), regions.end(), entry.id), regions.end());
+        if (entry.refs > 0)
+            page->second.referenced_regions--;
+    }
+
+    // The regions can't be used without the page's memory being charged for, they're made again when needed
+    for (auto region_id : std::vector(entry.regions)) {
+        auto region = cache.entries.find(region_id);
+        if (region == cache.entries.end())
+            continue;
+
+        if (region->second.refs == 0)
+            erase(cache, region->second);
+        else
+            region->second.page = 0;
+    }
+
+    cache.stats.count--;
+    cache.stats.bytes -= entry.size;
+    if (entry.refs > 0)
+        cache.stats.referenced--;
+
+    auto key = cache.keys.find(entry.key);
+    if (key != cache.keys.end() && key->second == entry.id)
+        cache.keys.erase(key);
+
+    cache.lru.erase(entry.used);
+    cache.entries.erase(entry.id);
+}
+
+void AssetCache::detach(Cache &cache, Entry &entry) {
+    if (!in_use(entry)) {
+        erase(cache, entry);
+        return;
+    }
+
+    // It stays in the LRU list, but it's never evicted while it's referenced
+    cache.keys.erase(entry.key);
+}
+
+void AssetCache::evict(Type type) {
+    auto &cache = cache_of(type);
+    if (cache.lru.empty())
+        return;
+
+    // Erasing a page erases its regions too, which can be anywhere in the list, so the search starts over after every eviction
+    while (cache.stats.bytes > cache.stats.budget) {
+        // The most recently used asset is kept, it's usually the one that was just added, and so is its page
+        auto newest = cache.lru.front();
+
+        Entry *evicted = nullptr;
+        for (auto it = cache.lru.rbegin(); it != cache.lru.rend() && *it != newest; ++it) {
+            if (!in_use(**it) && (*it)->id != newest->page) {
+                evicted = *it;
+                break;
+            }
+        }
+        if (!evicted)
+            break;
+
+        erase(cache, *evicted);
+        cache.stats.evictions++;
+    }
+}
+
+std::shared_ptr<sf::Texture> AssetCache::get_texture(const std::string &key) {
+    auto &cache = cache_of(Type::Texture);
+
+    auto entry = find(Type::Texture, key);
+    if (!entry) {
+        cache.stats.misses++;
+        return nullptr;
+    }
+
+    cache.stats.hits++;
+    cache.lru.splice(cache.lru.begin(), cache.lru, entry->used);
+
+    return entry->texture;
+}
+
+std::shared_ptr<SoundBuffer> AssetCache::get_sound_buffer(const std::string &key) {
+    auto &cache = cache_of(Type::Sound);
+
+    auto entry = find(Type::Sound, key);
+    if (!entry) {
+        cache.stats.misses++;
+        return nullptr;
+    }
+
+    cache.stats.hits++;
+    cache.lru.splice(cache.lru.begin(), cache.lru, entry->used);
+
+    return entry->sound_buffer;
+}
+
+void AssetCache::add_texture(const std::string &key, std::shared_ptr<sf::Texture> texture) {
+    auto &cache = cache_of(Type::Texture);
+
+    // Atlas regions are charged to their page. There are only so many pages, so they're just searched for
+    uint64_t page = 0;
+    if (auto &page_texture = texture->getPage()) {
+        for (auto &[id, entry] : cache.entries) {
+            if (entry.texture == page_texture) {
+                page = id;
+                break;
+            }
+        }
+    }
+
+    auto size = texture->getSize();
+    // Textures are uploaded as RGBA
+    auto &entry = insert(Type::Texture, key, page != 0 ? 0 : (size_t)size.x * size.y * 4);
+    entry.texture = std::move(texture);
+
+    // The new asset could have replaced the page itself, if they have the same name
+    if (auto found = cache.entries.find(page); page != 0 && found != cache.entries.end()) {
+        entry.page = page;
+        found->second.regions.push_back(entry.id);
+    } else if (page != 0) {
+        entry.size = (size_t)size.x * size.y * 4;
+        cache.stats.bytes += entry.size;
+    }
+
+    evict(Type::Texture);
+}
+
+void AssetCache::add_sound_buffer(const std::string &key, std::shared_ptr<SoundBuffer> sound_buffer) {
+    auto size = sound_buffer->getSize();
+    insert(Type::Sound, key, size).sound_buffer = std::move(sound_buffer);
+
+    evict(Type::Sound);
+}
+
+uint64_t AssetCache::acquire(Type type, const std::string &key) {
+    auto entry = find(type, key);
+    if (!entry)
+        return 0;
+
+    auto &cache = cache_of(type);
+    if (entry->refs++ == 0) {
+        cache.stats.referenced++;
+
+        if (auto page = cache.entries.find(entry->page); entry->page != 0 && page != cache.entries.end())
+            page->second.referenced_regions++;
+    }
+
+    return entry->id;
+}
+
+void AssetCache::release(Type type, uint64_t reference) {
+    auto &cache = cache_of(type);
+
+    auto found = cache.entries.find(reference);
+    // The cache could have been cleared while the asset was still used
+    if (found == cache.entries.end() || found->second.refs == 0)
+        return;
+
+    auto &entry = found->second;
+    if (--entry.refs > 0)
+        return;
+
+    cache.stats.referenced--;
+
+    auto page = entry.page;
+    if (auto found = cache.entries.find(page); page != 0 && found != cache.entries.end())
+        found->second.referenced_regions--;
+
+    // Removed or replaced assets are only kept while they're used
+    auto key = cache.keys.find(entry.key);
+    if (key == cache.keys.end() || key->second != entry.id)
+        erase(cache, entry);
+
+    if (page != 0)
+        release_page(cache, page);
+}
+
+void AssetCache::release_page(Cache &cache, uint64_t page) {
+    auto found = cache.entries.find(page);
+    if (found == cache.entries.end() || in_use(found->second))
+        return;
+
+    auto key = cache.keys.find(found->second.key);
+    if (key == cache.keys.end() || key->second != page)
+        erase(cache, found->second);
+}
+
+void AssetCache::remove(Type type, const std::string &key) {
+    if (auto entry = find(type, key))
+        detach(cache_of(type), *entry);
+}
+
+void AssetCache::clear() {
+    for (auto &cache : caches) {
+        cache.lru.clear();
+        cache.keys.clear();
+        cache.entries.clear();
+
+        cache.stats.count = cache.stats.referenced = cache.stats.bytes = 0;
+    }
+}
+
+void AssetCache::set_budget(Type type, size_t bytes) {
+    cache_of(type).stats.budget = bytes;
+
+    evict(type);
+}
+
+void AssetCache::debug_menu() {
+    if (!ImGui::CollapsingHeader("Asset cache"))
+        return;
+
+    auto cache_menu = [this](const char *name, Type type) {
+        auto &stats = cache_of(type).stats;
+
+        ImGui::Text(
+            "%s: %zu loaded, %zu referenced, %.1f of %.1f MB", name,
+            stats.count, stats.referenced, (double)stats.bytes / megabyte, (double)stats.budget / megabyte
+        );
+        ImGui::Text(
+            "  %llu hits, %llu misses, %llu evicted",
+            (unsigned long long)stats.hits, (unsigned long long)stats.misses, (unsigned long long)stats.evictions
+        );
+
+        int budget_mb = stats.budget / megabyte;
+        ImGui::SetNextItemWidth(120);
+        if (ImGui::InputInt(fmt::format("{} budget (MB)", name).c_str(), &budget_mb, 16) && budget_mb >= 0)
+            set_budget(type, (size_t)budget_mb * megabyte);
+    };
+
+    cache_menu("Textures", Type::Texture);
+    cache_menu("Sounds", Type::Sound);
+
+    ImGui::Text("Loading in the background: %zu", AssetLoader::instance().pending());
+}
+
+}
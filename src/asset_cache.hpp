@@ -0,0 +1,122 @@
+#pragma once
+
+#include <list>
+#include <array>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+
+#include "SFML/Graphics/Texture.hpp"
+#include "sound.hpp"
+#include "asset_loader.hpp"
+
+namespace someone {
+
+/** Keeps the loaded textures and sound buffers by their asset names, within a memory budget for each type.
+ *
+ *  Assets are referenced by the objects made from them (see assets.create_sprite_from_asset). When a budget
+ *  is exceeded, the assets nothing references are freed, the ones used the longest time ago first.
+ *
+ *  Sprites and tile layers only point to their textures, so a referenced asset is never freed. If it's removed
+ *  or replaced while it's referenced, only its name is forgotten, and it's freed once the last reference is released.
+ *
+ *  Textures in an atlas are regions of a cached page and only the page is charged for the memory. A page is kept
+ *  while any of its regions is referenced, and its unreferenced regions are freed along with it.
+ */
+class AssetCache {
+public:
+    using Type = AssetRequest::Type;
+
+    struct Stats {
+        size_t count = 0, referenced = 0;
+        size_t bytes = 0, budget = 0;
+        uint64_t hits = 0, misses = 0, evictions = 0;
+    };
+private:
+    struct Entry {
+        std::string key;
+        // References are to the entry rather than the name, which can be taken by another asset in the meantime
+        uint64_t id = 0;
+
+        std::shared_ptr<sf::Texture> texture;
+        std::shared_ptr<SoundBuffer> sound_buffer;
+
+        size_t size = 0;
+        int refs = 0;
+
+        // The entry of the atlas page a region texture is drawn from, 0 if it isn't a region of a cached page
+        uint64_t page = 0;
+        // For pages, the entries of their regions and how many of those are referenced
+        std::vector<uint64_t> regions;
+        int referenced_regions = 0;
+
+        // Position in the LRU list of its type
+        std::list<Entry*>::iterator used;
+    };
+
+    struct Cache {
+        std::unordered_map<uint64_t, Entry> entries;
+        // Entries by their names, without the ones that were removed but are still referenced
+        std::unordered_map<std::string, uint64_t> keys;
+        // Most recently used first
+        std::list<Entry*> lru;
+
+        Stats stats;
+    };
+
+    std::array<Cache, 2> caches;
+    uint64_t next_id = 1;
+
+    Cache &cache_of(Type type) { return caches[(size_t)type]; }
+    static bool in_use(const Entry &entry) { return entry.refs > 0 || entry.referenced_regions > 0; }
+    Entry *find(Type type, const std::string &key);
+    /** Erases the entry if nothing references it, otherwise only forgets its name. */
+    void detach(Cache &cache, Entry &entry);
+    Entry &insert(Type type, const std::string &key, size_t size);
+    void erase(Cache &cache, Entry &entry);
+    /** Called when a region of the page stops being referenced, frees the page if it was only kept for it. */
+    void release_page(Cache &cache, uint64_t page);
+
+    /** Frees unreferenced assets until the cache fits into its budget. */
+    void evict(Type type);
+
+    AssetCache();
+public:
+    static AssetCache &instance() {
+        static AssetCache cache;
+        return cache;
+    }
+
+    /** The type for the name used in assets.lua, "textures" or "sounds". */
+    static Type type_of(std::string_view name);
+
+    // Null if the asset isn't in the cache
+    std::shared_ptr<sf::Texture> get_texture(const std::string &key);
+    std::shared_ptr<SoundBuffer> get_sound_buffer(const std::string &key);
+
+    void add_texture(const std::string &key, std::shared_ptr<sf::Texture> texture);
+    void add_sound_buffer(const std::string &key, std::shared_ptr<SoundBuffer> sound_buffer);
+
+    bool contains(Type type, const std::string &key) { return find(type, key) != nullptr; }
+
+    /** Returns the reference to give back to release, or 0 if the asset isn't in the cache. */
+    uint64_t acquire(Type type, const std::string &key);
+    void release(Type type, uint64_t reference);
+    /** Forgets the asset, it's freed right away unless it's still referenced. */
+    void remove(Type type, const std::string &key);
+
+    /** Frees every asset, referenced or not. The textures have to be freed before the window closes,
+     *  the cache itself is only destroyed after main returns.
+     */
+    void clear();
+
+    void set_budget(Type type, size_t bytes);
+    const Stats &get_stats(Type type) { return cache_of(type).stats; }
+
+    void debug_menu();
+};
+
+}
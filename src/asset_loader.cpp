@@ -0,0 +1,335 @@
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+
+// SDL_gpu's own copy of stb_image, compiled here privately so that the workers don't go through SDL_gpu
+#define STB_IMAGE_STATIC
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include "asset_loader.hpp"
+#include "logger.hpp"
+#include "profiler.hpp"
+#include "raw_image.hpp"
+#include "asset_cache.hpp"
+
+namespace someone {
+
+namespace {
+
+/** Decodes the image into an RGBA surface. SDL_gpu keeps its errors in a global stack without any locking,
+ *  so the workers don't use GPU_LoadSurface, and errors are put into the string instead.
+ */
+SDL_Surface *decode_image(const std::string &path, std::string &error) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.good()) {
+        error = "couldn't open the file";
+        return nullptr;
+    }
+    std::vector<unsigned char> contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    int width, height, channels;
+    auto pixels = stbi_load_from_memory(contents.data(), contents.size(), &width, &height, &channels, 4);
+    if (!pixels) {
+        // stbi_failure_reason isn't thread local in every version of stb_image
+        error = "couldn't decode the image";
+        return nullptr;
+    }
+
+    auto surface = SDL_CreateRGBSurfaceWithFormat(0, width, height, 32, SDL_PIXELFORMAT_RGBA32);
+    if (surface) {
+        for (int y = 0; y < height; y++)
+            std::memcpy((uint8_t *)surface->pixels + (size_t)y * surface->pitch, pixels + (size_t)y * width * 4, (size_t)width * 4);
+    } else {
+        // SDL errors are per thread
+        error = SDL_GetError();
+    }
+    stbi_image_free(pixels);
+
+    return surface;
+}
+
+}
+
+AssetRequest::~AssetRequest() {
+    // Whatever was decoded but never uploaded
+    if (surface)
+        SDL_FreeSurface(surface);
+}
+
+AssetLoader::AssetLoader() {
+#ifndef SOMEONE_EMSCRIPTEN
+    // Decoding is mostly waiting on zlib and vorbis, a couple of workers are enough to keep ahead of the uploads
+    auto worker_count = std::clamp<unsigned>(std::thread::hardware_concurrency(), 2, 3) - 1;
+    for (unsigned i = 0; i < worker_count; i++)
+        workers.emplace_back(&AssetLoader::work, this);
+#endif
+}
+
+AssetLoader::~AssetLoader() {
+    shutdown();
+}
+
+void AssetLoader::shutdown() {
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    work_available.notify_all();
+
+    for (auto &worker : workers)
+        worker.join();
+    workers.clear();
+
+    std::lock_guard lock(mutex);
+    for (auto &request : decoded)
+        drop(*request);
+    decoded.clear();
+    queued.clear();
+}
+
+void AssetLoader::work() {
+    while (true) {
+        std::shared_ptr<AssetRequest> request;
+        {
+            std::unique_lock lock(mutex);
+            work_available.wait(lock, [this]() { return stopping || !queued.empty(); });
+            if (stopping)
+                return;
+
+            request = std::move(queued.front());
+            queued.pop_front();
+        }
+
+        // The main thread might have taken the request already to decode it right away
+        auto expected = AssetRequest::State::Queued;
+        if (!request->state.compare_exchange_strong(expected, AssetRequest::State::Decoding))
+            continue;
+
+        if (request->cancelled) {
+            {
+                std::lock_guard lock(mutex);
+                request->state = AssetRequest::State::Cancelled;
+            }
+            work_decoded.notify_all();
+
+            continue;
+        }
+
+        decode(*request);
+
+        std::lock_guard lock(mutex);
+        if (request->state == AssetRequest::State::Decoded)
+            decoded.push_back(std::move(request));
+    }
+}
+
+void AssetLoader::decode(AssetRequest &request) {
+    bool decoded = false;
+    switch (request.type) {
+    case AssetRequest::Type::Texture: {
+        std::string error;
+        if (auto raw = RawImage::find(request.path)) {
+            // The pixels are copied out of the mapping, so the surface outlives the raw image until it's uploaded
+            auto view = raw->surface();
+            request.surface = SDL_DuplicateSurface(view);
+            SDL_FreeSurface(view);
+
+            if (!request.surface)
+                error = SDL_GetError();
+        } else {
+            request.surface = decode_image(request.path, error);
+        }
+
+        if (request.surface)
+            decoded = true;
+        else
+            spdlog::error("Failed loading {}: {}", request.path, error);
+        break;
+    }
+    case AssetRequest::Type::Sound: {
+        std::ifstream file(request.path, std::ios::binary);
+        if (file.good()) {
+            request.sound_data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+            decoded = true;
+        } else {
+            spdlog::error("Failed to load audio file {}: couldn't open the file", request.path);
+        }
+        break;
+    }
+    }
+
+    {
+        std::lock_guard lock(mutex);
+        request.state = decoded ? AssetRequest::State::Decoded : AssetRequest::State::Failed;
+    }
+    work_decoded.notify_all();
+}
+
+void AssetLoader::upload(AssetRequest &request) {
+    if (request.state != AssetRequest::State::Decoded)
+        return;
+
+    switch (request.type) {
+    case AssetRequest::Type::Texture: {
+        Profiler::Scope scope("Texture upload");
+        Profiler::instance().count(Profiler::Counter::TextureUploads);
+
+        auto image = GPU_CopyImageFromSurface(request.surface);
+        SDL_FreeSurface(request.surface);
+        request.surface = nullptr;
+
+        if (!image) {
+            spdlog::error("Failed uploading {}: {}", request.path, GPU_PopErrorCode().details);
+            request.state = AssetRequest::State::Failed;
+
+            return;
+        }
+        request.texture = std::make_shared<sf::Texture>(image);
+
+        break;
+    }
+    case AssetRequest::Type::Sound: {
+        auto chunk = Mix_LoadWAV_RW(SDL_RWFromConstMem(request.sound_data.data(), request.sound_data.size()), 1);
+        request.sound_data = {};
+
+        if (!chunk) {
+            spdlog::error("Failed to load audio file {}: {}", request.path, Mix_GetError());
+            request.state = AssetRequest::State::Failed;
+
+            return;
+        }
+        request.sound_buffer->chunk.reset(chunk, Mix_FreeChunk);
+
+        break;
+    }
+    }
+
+    // The cache owns the asset from now on, so that it counts towards the budget and can be evicted
+    // if it's prefetched for a room that's never entered
+    if (!request.cache_key.empty()) {
+        auto &cache = AssetCache::instance();
+        if (request.type == AssetRequest::Type::Texture)
+            cache.add_texture(request.cache_key, std::move(request.texture));
+        else
+            cache.add_sound_buffer(request.cache_key, std::move(request.sound_buffer));
+
+        request.texture = nullptr;
+        request.sound_buffer = nullptr;
+    }
+
+    request.state = AssetRequest::State::Ready;
+}
+
+void AssetLoader::drop(AssetRequest &request) {
+    if (request.surface) {
+        SDL_FreeSurface(request.surface);
+        request.surface = nullptr;
+    }
+    request.sound_data = {};
+    request.sound_buffer = nullptr;
+
+    request.state = AssetRequest::State::Cancelled;
+}
+
+std::shared_ptr<AssetRequest> AssetLoader::queue(std::shared_ptr<AssetRequest> request) {
+    {
+        std::lock_guard lock(mutex);
+        queued.push_back(request);
+    }
+    work_available.notify_one();
+
+    return request;
+}
+
+std::shared_ptr<AssetRequest> AssetLoader::load_texture(const std::string &path, const std::string &cache_key) {
+    return queue(std::make_shared<AssetRequest>(AssetRequest::Type::Texture, path, cache_key));
+}
+
+std::shared_ptr<AssetRequest> AssetLoader::load_sound(const std::string &path, const std::string &cache_key) {
+    auto request = std::make_shared<AssetRequest>(AssetRequest::Type::Sound, path, cache_key);
+    request->sound_buffer = std::make_shared<SoundBuffer>();
+
+    return queue(std::move(request));
+}
+
+void AssetLoader::wait(AssetRequest &request) {
+    // It's needed after all, so a worker that didn't get to it yet decodes it as usual
+    request.cancelled = false;
+
+    while (true) {
+        auto expected = AssetRequest::State::Queued;
+        if (request.state.compare_exchange_strong(expected, AssetRequest::State::Decoding)
+            || (expected == AssetRequest::State::Cancelled
+                && request.state.compare_exchange_strong(expected, AssetRequest::State::Decoding))) {
+            // Nobody got to it yet or it was skipped, the worker that takes it from the queue will skip it
+            decode(request);
+        } else if (expected == AssetRequest::State::Decoding) {
+            std::unique_lock lock(mutex);
+            work_decoded.wait(lock, [&]() { return request.state != AssetRequest::State::Decoding; });
+
+            // A worker might have marked it as cancelled just before it was needed
+            continue;
+        }
+
+        break;
+    }
+
+    // If it's in the list of decoded requests, update() skips it once it's ready
+    upload(request);
+}
+
+void AssetLoader::update() {
+    Profiler::Scope scope("Asset uploads");
+
+    auto start = std::chrono::steady_clock::now();
+    bool uploaded = false;
+
+    while (!uploaded || std::chrono::steady_clock::now() - start < upload_budget) {
+        std::shared_ptr<AssetRequest> request;
+        {
+            std::lock_guard lock(mutex);
+
+            if (!decoded.empty()) {
+                request = std::move(decoded.front());
+                decoded.pop_front();
+            }
+#ifdef SOMEONE_EMSCRIPTEN
+            // There are no workers, so the requests are decoded here within the same budget
+            else if (!queued.empty()) {
+                request = std::move(queued.front());
+                queued.pop_front();
+            }
+#endif
+        }
+
+        if (!request)
+            break;
+
+#ifdef SOMEONE_EMSCRIPTEN
+        auto expected = AssetRequest::State::Queued;
+        if (request->state.compare_exchange_strong(expected, AssetRequest::State::Decoding)) {
+            if (request->cancelled) {
+                drop(*request);
+                continue;
+            }
+
+            decode(*request);
+        }
+#endif
+
+        // Requests that were waited for are already uploaded
+        if (request->state == AssetRequest::State::Decoded) {
+            if (request->cancelled) {
+                drop(*request);
+                continue;
+            }
+
+            upload(*request);
+            uploaded = true;
+        }
+    }
+}
+
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <condition_variable>
+
+#include "SDL.h"
+#include "SDL_mixer.h"
+
+#include "SFML/Graphics/Texture.hpp"
+#include "sound.hpp"
+
+namespace someone {
+
+/** A texture or a sound that's loaded in the background. Lua gets these as futures. */
+class AssetRequest {
+public:
+    enum class Type {
+        Texture,
+        Sound
+    };
+
+    enum class State {
+        // Waiting for a worker
+        Queued,
+        Decoding,
+        // Decoded on a worker, waiting to be uploaded on the main thread
+        Decoded,
+        Ready,
+        Failed,
+        // Nobody needed it anymore before it was uploaded
+        Cancelled
+    };
+private:
+    Type type;
+    std::string path;
+    // Uploaded assets go into the cache under this name, where they're evicted like any other unused asset
+    std::string cache_key;
+
+    std::atomic<State> state = State::Queued;
+    std::atomic<bool> cancelled = false;
+
+    // Handed over from the worker to the main thread. Sounds are only read on the worker, SDL_mixer converts
+    // them for the opened audio device and isn't safe to use from other threads
+    SDL_Surface *surface = nullptr;
+    std::vector<uint8_t> sound_data;
+
+    std::shared_ptr<sf::Texture> texture;
+    // Made right away on the main thread, since it opens the audio device that the sound is converted for
+    std::shared_ptr<SoundBuffer> sound_buffer;
+
+    friend class AssetLoader;
+public:
+    AssetRequest(Type type, std::string path, std::string cache_key = "")
+        : type(type), path(std::move(path)), cache_key(std::move(cache_key)) {}
+    ~AssetRequest();
+
+    AssetRequest(const AssetRequest &) = delete;
+    AssetRequest &operator=(const AssetRequest &) = delete;
+
+    const std::string &get_path() const { return path; }
+    bool is_ready() const { return state == State::Ready; }
+    /** Ready, failed or cancelled. */
+    bool is_done() const { return state == State::Ready || state == State::Failed || state == State::Cancelled; }
+    bool is_failed() const { return state == State::Failed; }
+    bool is_cancelled() const { return state == State::Cancelled; }
+
+    /** Skips decoding and uploading it if it hasn't happened yet. Waiting for it still loads it, even if it was already cancelled. */
+    void cancel() { cancelled = true; }
+
+    // Null until the request is ready, and for requests that put their asset into the cache
+    std::shared_ptr<sf::Texture> get_texture() const { return is_ready() ? texture : nullptr; }
+    std::shared_ptr<SoundBuffer> get_sound_buffer() const { return is_ready() ? sound_buffer : nullptr; }
+};
+
+/** Decodes images and reads sounds on worker threads. The decoded textures are uploaded to the GPU and the sounds are
+ *  decoded on the main thread in update(), a few every frame, so that loading the assets of a room doesn't stall a single frame.
+ */
+class AssetLoader {
+public:
+    // How long update() can spend uploading every frame, at least one asset is uploaded anyway
+    static constexpr std::chrono::microseconds upload_budget { 4000 };
+private:
+    std::mutex mutex;
+    std::condition_variable work_available, work_decoded;
+
+    std::deque<std::shared_ptr<AssetRequest>> queued, decoded;
+    bool stopping = false;
+
+    std::vector<std::thread> workers;
+
+    AssetLoader();
+
+    void work();
+    void decode(AssetRequest &request);
+    void upload(AssetRequest &request);
+    /** Frees what was decoded for a cancelled request. */
+    void drop(AssetRequest &request);
+
+    std::shared_ptr<AssetRequest> queue(std::shared_ptr<AssetRequest> request);
+public:
+    ~AssetLoader();
+
+    static AssetLoader &instance() {
+        static AssetLoader loader;
+        return loader;
+    }
+
+    // With a cache key, the asset is put into the AssetCache once it's uploaded instead of being kept in the request
+    std::shared_ptr<AssetRequest> load_texture(const std::string &path, const std::string &cache_key = "");
+    std::shared_ptr<AssetRequest> load_sound(const std::string &path, const std::string &cache_key = "");
+
+    /** Blocks until the request is decoded and uploads it right away, for when the asset is needed now.
+     *  Cancelled requests are loaded too.
+     */
+    void wait(AssetRequest &request);
+
+    /** Stops the workers and frees everything decoded but not uploaded. Has to be called before SDL shuts down. */
+    void shutdown();
+
+    /** Uploads decoded assets within the budget. Has to be called on the main thread every frame. */
+    void update();
+
+    size_t pending() {
+        std::lock_guard lock(mutex);
+        return queued.size() + decoded.size();
+    }
+};
+
+}
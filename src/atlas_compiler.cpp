@@ -0,0 +1,197 @@
+#include <map>
+#include <set>
+#include <memory>
+#include <fstream>
+#include <iostream>
+#include <filesystem>
+
+#include <toml++/toml.h>
+#include "SDL_gpu.h"
+#include "fmt/format.h"
+
+#include "args.hxx"
+
+#include "logger.hpp"
+#include "atlas_packer.hpp"
+#include "room_manifest.hpp"
+
+namespace fs = std::filesystem;
+
+using SurfacePtr = std::unique_ptr<SDL_Surface, decltype(&SDL_FreeSurface)>;
+
+/** Textures of the rooms by the day they're in, named after the directory, like day1. */
+std::map<std::string, std::set<std::string>> textures_by_day(const fs::path &rooms_root) {
+    std::map<std::string, std::set<std::string>> result;
+
+    for (const auto &day : fs::directory_iterator(rooms_root)) {
+        auto day_name = day.path().filename().string();
+        if (!day.is_directory() || !day_name.starts_with("day"))
+            continue;
+
+        for (const auto &room : fs::directory_iterator(day.path())) {
+            if (room.path().extension() != ".toml")
+                continue;
+
+            auto room_name = (fs::path(day_name) / room.path().stem()).generic_string();
+            auto manifest = RoomManifest::build(rooms_root.string(), room_name);
+
+            result[day_name].insert(manifest.textures.begin(), manifest.textures.end());
+        }
+    }
+
+    return result;
+}
+
+// Packs the textures the rooms use into atlas pages, one set of pages for the rooms of each day and one
+// for the textures used on several days, and writes where every texture ended up to atlases.toml.
+// assets.lua takes the packed textures from the pages instead of loading their files.
+int main(int argc, char **argv) {
+    args::ArgumentParser arg_parser("Someone - texture atlas compiler");
+    arg_parser.helpParams.width = 100;
+    arg_parser.helpParams.showProglineOptions = false;
+
+    args::HelpFlag help(arg_parser, "help", "Display this help message", {'h', "help"});
+    args::ValueFlag<std::string> resources(
+        arg_parser, "directory", "Directory with the resources", {'r', "resources"}, "resources"
+    );
+    args::ValueFlag<unsigned> page_size(arg_parser, "pixels", "Width and height of the pages", {"page-size"}, 2048);
+    args::ValueFlag<unsigned> max_size(
+        arg_parser, "pixels", "Larger textures, like room backgrounds, are left out", {"max-size"}, 512
+    );
+    args::ValueFlag<unsigned> padding(arg_parser, "pixels", "Space between the textures", {"padding"}, 1);
+    args::Positional<std::string> output(
+        arg_parser, "output", "Directory to write the pages and atlases.toml to", args::Options::Required
+    );
+    try {
+        arg_parser.ParseCLI(argc, argv);
+    } catch (const args::Help&) {
+        std::cout << arg_parser;
+        return 0;
+    } catch (const args::Error &e) {
+        std::cerr << e.what() << std::endl;
+        std::cerr << arg_parser;
+
+        return 1;
+    }
+
+    fs::path resources_root = args::get(resources);
+    fs::path output_root = args::get(output);
+
+    toml::table assets;
+    std::map<std::string, std::set<std::string>> days;
+    try {
+        assets = toml::parse_file((resources_root / "rooms" / "assets.toml").string());
+        days = textures_by_day(resources_root / "rooms");
+    } catch (const std::exception &e) {
+        spdlog::error("{}", e.what());
+
+        return 1;
+    }
+
+    auto textures = assets["textures"].as_table();
+    if (!textures) {
+        spdlog::error("There are no textures in assets.toml");
+
+        return 1;
+    }
+    fs::path textures_root = resources_root / assets["config"]["textures"]["root"].value_or(std::string("sprites/"));
+
+    // Textures used on more than one day go into their own pages, so that they aren't loaded twice.
+    // Textures no room uses are loaded from scripts, they're left alone.
+    std::map<std::string, std::string> group_of;
+    for (const auto &[day, day_textures] : days) {
+        for (const auto &texture : day_textures) {
+            auto [it, inserted] = group_of.emplace(texture, day);
+            if (!inserted && it->second != day)
+                it->second = "shared";
+        }
+    }
+
+    std::map<std::string, std::vector<std::pair<std::string, SurfacePtr>>> groups;
+    for (const auto &[key, path] : *textures) {
+        auto group = group_of.find(std::string(key.str()));
+        auto path_string = path.value<std::string>();
+        if (group == group_of.end() || !path_string)
+            continue;
+
+        SurfacePtr surface(GPU_LoadSurface((textures_root / *path_string).string().c_str()), SDL_FreeSurface);
+        if (!surface) {
+            spdlog::warn("Leaving {} out of the atlases, couldn't load it: {}", key.str(), GPU_PopErrorCode().details);
+            continue;
+        }
+
+        if ((unsigned)surface->w > args::get(max_size) || (unsigned)surface->h > args::get(max_size))
+            continue;
+
+        groups[group->second].emplace_back(std::string(key.str()), std::move(surface));
+    }
+
+    std::error_code error;
+    fs::create_directories(output_root, error);
+    if (error) {
+        spdlog::error("Couldn't create {}: {}", output_root.string(), error.message());
+
+        return 1;
+    }
+
+    toml::table pages, packed;
+    for (auto &[group, group_textures] : groups) {
+        std::vector<sf::Vector2u> sizes;
+        for (const auto &[_, surface] : group_textures)
+            sizes.emplace_back(surface->w, surface->h);
+
+        AtlasPacker packer(args::get(page_size), args::get(padding));
+        auto placements = packer.pack(sizes);
+
+        std::vector<SurfacePtr> page_surfaces;
+        for (size_t page = 0; page < packer.page_count(); page++) {
+            // Pages are cut down to what's used, so the last one is usually smaller
+            auto extent = packer.page_extent(page);
+            page_surfaces.emplace_back(
+                SDL_CreateRGBSurfaceWithFormat(0, extent.x, extent.y, 32, SDL_PIXELFORMAT_RGBA32), SDL_FreeSurface
+            );
+        }
+
+        for (size_t i = 0; i < group_textures.size(); i++) {
+            auto &[key, surface] = group_textures[i];
+            if (!placements[i])
+                continue;
+
+            auto page_name = fmt::format("{}_{}", group, placements[i]->page);
+            auto rect = placements[i]->rect;
+
+            // Alpha is copied as is instead of being blended onto the empty page
+            SDL_Rect destination { rect.left, rect.top, rect.width, rect.height };
+            SDL_SetSurfaceBlendMode(surface.get(), SDL_BLENDMODE_NONE);
+            SDL_BlitSurface(surface.get(), nullptr, page_surfaces[placements[i]->page].get(), &destination);
+
+            packed.insert(key, toml::table {
+                { "page", page_name },
+                { "rect", toml::array { rect.left, rect.top, rect.width, rect.height } }
+            });
+        }
+
+        for (size_t page = 0; page < page_surfaces.size(); page++) {
+            auto page_name = fmt::format("{}_{}", group, page);
+            auto page_file = page_name + ".png";
+
+            if (!GPU_SaveSurface(page_surfaces[page].get(), (output_root / page_file).string().c_str(), GPU_FILE_PNG)) {
+                spdlog::error("Couldn't write the atlas page {}: {}", page_file, GPU_PopErrorCode().details);
+
+                return 1;
+            }
+
+            pages.insert(page_name, page_file);
+        }
+
+        spdlog::info("Packed {} textures of {} into {} pages", group_textures.size(), group, page_surfaces.size());
+    }
+
+    std::ofstream file(output_root / "atlases.toml");
+    file << toml::table { { "pages", pages }, { "textures", packed } };
+    if (!file.good()) {
+        spdlog::error("Couldn't write {}", (output_root / "atlases.toml").string());
+
+        return 1;
+    }
+}
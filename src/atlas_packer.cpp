@@ -0,0 +1,121 @@
+#include <numeric>
+#include <algorithm>
+
+#include "atlas_packer.hpp"
+
+AtlasPacker::AtlasPacker(unsigned page_size, unsigned padding) : page_size(page_size), padding(padding) {}
+
+std::optional<int> AtlasPacker::fit(const Page &page, size_t segment, int width, int height) const {
+    const auto &skyline = page.skyline;
+
+    int x = skyline[segment].x;
+    if (x + width > page_size)
+        return std::nullopt;
+
+    // The rectangle lies on the highest segment under it
+    int y = 0;
+    for (int width_left = width; width_left > 0; segment++) {
+        y = std::max(y, skyline[segment].y);
+        if (y + height > page_size)
+            return std::nullopt;
+
+        width_left -= skyline[segment].width;
+    }
+
+    return y;
+}
+
+void AtlasPacker::place(Page &page, size_t segment, int x, int y, int width, int height) {
+    auto &skyline = page.skyline;
+    skyline.insert(skyline.begin() + segment, Segment { x, y + height, width });
+
+    // Cut the segments the new one covers
+    auto end = x + width;
+    auto next = segment + 1;
+    while (next < skyline.size() && skyline[next].x < end) {
+        auto covered = end - skyline[next].x;
+        skyline[next].x += covered;
+        skyline[next].width -= covered;
+
+        if (skyline[next].width > 0)
+            break;
+        skyline.erase(skyline.begin() + next);
+    }
+
+    // Neighbours at the same height are merged, so there are fewer places to try
+    for (size_t i = 0; i + 1 < skyline.size();) {
+        if (skyline[i].y == skyline[i + 1].y) {
+            skyline[i].width += skyline[i + 1].width;
+            skyline.erase(skyline.begin() + i + 1);
+        } else {
+            i++;
+        }
+    }
+}
+
+bool AtlasPacker::try_place(Page &page, int width, int height, sf::Vector2i &at) {
+    std::optional<size_t> best;
+    int best_bottom = 0, best_width = 0;
+
+    for (size_t segment = 0; segment < page.skyline.size(); segment++) {
+        auto y = fit(page, segment, width, height);
+        if (!y)
+            continue;
+
+        auto bottom = *y + height;
+        auto segment_width = page.skyline[segment].width;
+        if (!best || bottom < best_bottom || (bottom == best_bottom && segment_width < best_width)) {
+            best = segment;
+            best_bottom = bottom;
+            best_width = segment_width;
+
+            at = sf::Vector2i(page.skyline[segment].x, *y);
+        }
+    }
+
+    if (!best)
+        return false;
+
+    place(page, *best, at.x, at.y, width, height);
+
+    return true;
+}
+
+std::vector<std::optional<AtlasPlacement>> AtlasPacker::pack(const std::vector<sf::Vector2u> &sizes) {
+    std::vector<std::optional<AtlasPlacement>> result(sizes.size());
+
+    // Taller rectangles first leave a flatter skyline for the rest
+    std::vector<size_t> order(sizes.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return sizes[a].y != sizes[b].y ? sizes[a].y > sizes[b].y : sizes[a].x > sizes[b].x;
+    });
+
+    for (auto index : order) {
+        int width = sizes[index].x, height = sizes[index].y;
+        if (width == 0 || height == 0 || width > page_size || height > page_size)
+            continue;
+
+        // The padding is reserved to the right and below. It's only cut short for rectangles as wide
+        // or as tall as the page, anywhere else a rectangle needs room for its padding to fit
+        int padded_width = std::min(width + padding, page_size), padded_height = std::min(height + padding, page_size);
+
+        sf::Vector2i at;
+        size_t page = 0;
+        while (page < pages.size() && !try_place(pages[page], padded_width, padded_height, at))
+            page++;
+
+        if (page == pages.size()) {
+            pages.push_back(Page { { Segment { 0, 0, page_size } }, sf::Vector2u(0, 0) });
+            try_place(pages.back(), padded_width, padded_height, at);
+        }
+
+        auto &extent = pages[page].extent;
+        extent.x = std::max<unsigned>(extent.x, at.x + width);
+        extent.y = std::max<unsigned>(extent.y, at.y + height);
+
+        result[index] = AtlasPlacement { page, sf::IntRect(at.x, at.y, width, height) };
+    }
+
+    return result;
+}
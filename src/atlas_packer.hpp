@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <optional>
+
+#include "SFML/System/Rect.hpp"
+#include "SFML/System/Vector2.hpp"
+
+struct AtlasPlacement {
+    size_t page;
+    // Where the image goes on the page, without the padding
+    sf::IntRect rect;
+};
+
+/** Packs rectangles into square pages with a skyline packer: every page keeps the top edge of what's already
+ *  placed as a list of horizontal segments, and a rectangle goes where its bottom ends up the highest.
+ */
+class AtlasPacker {
+    struct Segment {
+        int x, y, width;
+    };
+
+    struct Page {
+        std::vector<Segment> skyline;
+        sf::Vector2u extent;
+    };
+
+    int page_size, padding;
+    std::vector<Page> pages;
+
+    /** The y the rectangle would be placed at over the segment, or nothing if it doesn't fit there. */
+    std::optional<int> fit(const Page &page, size_t segment, int width, int height) const;
+    void place(Page &page, size_t segment, int x, int y, int width, int height);
+    bool try_place(Page &page, int width, int height, sf::Vector2i &at);
+public:
+    AtlasPacker(unsigned page_size, unsigned padding);
+
+    /** Places the rectangles, the tallest ones first. placements[i] is where sizes[i] went,
+     *  or nullopt if it didn't fit into a page even on its own.
+     */
+    std::vector<std::optional<AtlasPlacement>> pack(const std::vector<sf::Vector2u> &sizes);
+
+    size_t page_count() const { return pages.size(); }
+    /** How much of the page is used, pages can be cut down to this. */
+    sf::Vector2u page_extent(size_t page) const { return pages[page].extent; }
+};
@@ -0,0 +1,482 @@
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+
+#include "fmt/format.h"
+
+#include "collision_world.hpp"
+
+namespace {
+
+// Same as in bump, the tolerance for floating point comparisons
+constexpr double delta = 1e-10;
+
+int sign(double x) {
+    if (x > 0) return 1;
+    if (x < 0) return -1;
+    return 0;
+}
+
+double nearest(double x, double a, double b) {
+    return std::abs(a - x) < std::abs(b - x) ? a : b;
+}
+
+bool contains_point(const CollisionWorld::Rect &rect, double px, double py) {
+    return px - rect.x > delta && py - rect.y > delta &&
+        rect.x + rect.w - px > delta && rect.y + rect.h - py > delta;
+}
+
+bool is_intersecting(const CollisionWorld::Rect &a, const CollisionWorld::Rect &b) {
+    return a.x < b.x + b.w && b.x < a.x + a.w && a.y < b.y + b.h && b.y < a.y + a.h;
+}
+
+/** Lua truthiness, only nil and false are false. Filters like bump's often return nil instead of false. */
+bool is_truthy(sol::object value) {
+    return value.valid() && value.get_type() != sol::type::lua_nil
+        && (value.get_type() != sol::type::boolean || value.as<bool>());
+}
+
+/** The table of the items the filter keeps, all of them without a filter. */
+std::tuple<sol::table, size_t> filtered_items(
+    sol::this_state lua, const std::vector<sol::object> &found, const sol::optional<sol::function> &filter
+) {
+    auto result = sol::state_view(lua).create_table();
+    size_t count = 0;
+    for (auto &object : found) {
+        if (filter && !is_truthy((*filter)(object)))
+            continue;
+
+        result[++count] = object;
+    }
+
+    return { result, count };
+}
+
+double square_distance(const CollisionWorld::Rect &a, const CollisionWorld::Rect &b) {
+    double dx = a.x - b.x + (a.w - b.w) / 2;
+    double dy = a.y - b.y + (a.h - b.h) / 2;
+
+    return dx * dx + dy * dy;
+}
+
+struct SegmentIntersection {
+    double ti1, ti2;
+    double nx1, ny1;
+};
+
+/** Liang-Barsky clipping of the segment from (x1, y1) to (x2, y2) against the rectangle. */
+std::optional<SegmentIntersection> segment_intersection(
+    const CollisionWorld::Rect &rect, double x1, double y1, double x2, double y2, double ti1, double ti2
+) {
+    double dx = x2 - x1, dy = y2 - y1;
+    double nx1 = 0, ny1 = 0;
+
+    for (int side = 0; side < 4; side++) {
+        double nx, ny, p, q;
+        switch (side) {
+        case 0: nx = -1; ny = 0; p = -dx; q = x1 - rect.x; break; // left
+        case 1: nx = 1; ny = 0; p = dx; q = rect.x + rect.w - x1; break; // right
+        case 2: nx = 0; ny = -1; p = -dy; q = y1 - rect.y; break; // top
+        default: nx = 0; ny = 1; p = dy; q = rect.y + rect.h - y1; break; // bottom
+        }
+
+        if (p == 0) {
+            if (q <= 0)
+                return std::nullopt;
+        } else {
+            double r = q / p;
+            if (p < 0) {
+                if (r > ti2)
+                    return std::nullopt;
+                if (r > ti1) {
+                    ti1 = r;
+                    nx1 = nx;
+                    ny1 = ny;
+                }
+            } else {
+                if (r < ti1)
+                    return std::nullopt;
+                if (r < ti2)
+                    ti2 = r;
+            }
+        }
+    }
+
+    return SegmentIntersection { ti1, ti2, nx1, ny1 };
+}
+
+std::optional<CollisionWorld::Collision> detect_collision(
+    const CollisionWorld::Rect &item, const CollisionWorld::Rect &other, double goal_x, double goal_y
+) {
+    constexpr double infinity = std::numeric_limits<double>::infinity();
+
+    double dx = goal_x - item.x, dy = goal_y - item.y;
+    // Minkowski difference of the two rectangles
+    CollisionWorld::Rect diff {
+        other.x - item.x - item.w, other.y - item.y - item.h,
+        item.w + other.w, item.h + other.h
+    };
+
+    CollisionWorld::Collision col {};
+    col.item_rect = item;
+    col.other_rect = other;
+    col.move_x = dx;
+    col.move_y = dy;
+
+    if (contains_point(diff, 0, 0)) {
+        // The item was already intersecting the other one, ti is the negative area of the intersection
+        double px = nearest(0, diff.x, diff.x + diff.w), py = nearest(0, diff.y, diff.y + diff.h);
+        col.ti = -std::min(item.w, std::abs(px)) * std::min(item.h, std::abs(py));
+        col.overlaps = true;
+
+        if (dx == 0 && dy == 0) {
+            // Not moving, use the minimum displacement
+            if (std::abs(px) < std::abs(py)) py = 0; else px = 0;
+
+            col.normal_x = sign(px);
+            col.normal_y = sign(py);
+            col.touch_x = item.x + px;
+            col.touch_y = item.y + py;
+        } else {
+            // Moving, so go back in the opposite direction
+            auto intersection = segment_intersection(diff, 0, 0, dx, dy, -infinity, 1);
+            if (!intersection)
+                return std::nullopt;
+
+            col.normal_x = intersection->nx1;
+            col.normal_y = intersection->ny1;
+            col.touch_x = item.x + dx * intersection->ti1;
+            col.touch_y = item.y + dy * intersection->ti1;
+        }
+    } else {
+        auto intersection = segment_intersection(diff, 0, 0, dx, dy, -infinity, infinity);
+        // Also handles the special case of going exactly through the other rectangle's corner
+        if (!intersection || intersection->ti1 >= 1 || std::abs(intersection->ti1 - intersection->ti2) < delta ||
+            !(0 < intersection->ti1 + delta || (0 == intersection->ti1 && intersection->ti2 > 0)))
+            return std::nullopt;
+
+        col.ti = intersection->ti1;
+        col.overlaps = false;
+        col.normal_x = intersection->nx1;
+        col.normal_y = intersection->ny1;
+        col.touch_x = item.x + dx * col.ti;
+        col.touch_y = item.y + dy * col.ti;
+    }
+
+    return col;
+}
+
+int64_t cell_key(int64_t cx, int64_t cy) {
+    return (cx << 32) ^ (cy & 0xFFFFFFFF);
+}
+
+}
+
+const char *CollisionWorld::response_name(Response response) {
+    switch (response) {
+    case Response::Slide: return "slide";
+    case Response::Cross: return "cross";
+    case Response::Touch: return "touch";
+    }
+
+    return "slide";
+}
+
+std::optional<CollisionWorld::Response> CollisionWorld::response_from_name(const std::string &name) {
+    if (name == "slide") return Response::Slide;
+    if (name == "cross") return Response::Cross;
+    if (name == "touch") return Response::Touch;
+
+    return std::nullopt;
+}
+
+std::optional<uint32_t> CollisionWorld::maybe_id_of(const sol::object &item) const {
+    auto found = item_ids.find(item.pointer());
+    if (found == item_ids.end())
+        return std::nullopt;
+
+    return found->second;
+}
+
+uint32_t CollisionWorld::id_of(const sol::object &item) const {
+    auto id = maybe_id_of(item);
+    if (!id)
+        throw std::invalid_argument("Item must be added to the world before being used. Use world:add(item, x, y, w, h) to add it first.");
+
+    return *id;
+}
+
+void CollisionWorld::add_to_cells(uint32_t id) {
+    auto &rect = items[id].rect;
+
+    int64_t left = std::floor(rect.x / cell_size), top = std::floor(rect.y / cell_size);
+    int64_t right = std::max(left, (int64_t)std::ceil((rect.x + rect.w) / cell_size) - 1);
+    int64_t bottom = std::max(top, (int64_t)std::ceil((rect.y + rect.h) / cell_size) - 1);
+
+    for (auto cy = top; cy <= bottom; cy++)
+        for (auto cx = left; cx <= right; cx++)
+            cells[cell_key(cx, cy)].push_back(id);
+}
+
+void CollisionWorld::remove_from_cells(uint32_t id) {
+    auto &rect = items[id].rect;
+
+    int64_t left = std::floor(rect.x / cell_size), top = std::floor(rect.y / cell_size);
+    int64_t right = std::max(left, (int64_t)std::ceil((rect.x + rect.w) / cell_size) - 1);
+    int64_t bottom = std::max(top, (int64_t)std::ceil((rect.y + rect.h) / cell_size) - 1);
+
+    for (auto cy = top; cy <= bottom; cy++) {
+        for (auto cx = left; cx <= right; cx++) {
+            auto cell = cells.find(cell_key(cx, cy));
+            if (cell == cells.end())
+                continue;
+
+            auto &cell_items = cell->second;
+            auto found = std::find(cell_items.begin(), cell_items.end(), id);
+            if (found != cell_items.end()) {
+                *found = cell_items.back();
+                cell_items.pop_back();
+            }
+            if (cell_items.empty())
+                cells.erase(cell);
+        }
+    }
+}
+
+template <typename F>
+void CollisionWorld::for_each_near(const Rect &rect, F callback) {
+    query_mark++;
+
+    int64_t left = std::floor(rect.x / cell_size), top = std::floor(rect.y / cell_size);
+    int64_t right = std::max(left, (int64_t)std::ceil((rect.x + rect.w) / cell_size) - 1);
+    int64_t bottom = std::max(top, (int64_t)std::ceil((rect.y + rect.h) / cell_size) - 1);
+
+    for (auto cy = top; cy <= bottom; cy++) {
+        for (auto cx = left; cx <= right; cx++) {
+            auto cell = cells.find(cell_key(cx, cy));
+            if (cell == cells.end())
+                continue;
+
+            for (auto id : cell->second) {
+                if (item_query_marks[id] == query_mark)
+                    continue;
+                item_query_marks[id] = query_mark;
+
+                callback(id);
+            }
+        }
+    }
+}
+
+sol::object CollisionWorld::add(sol::object item, double x, double y, double w, double h) {
+    if (maybe_id_of(item))
+        throw std::invalid_argument("Item added to the world twice.");
+
+    uint32_t id;
+    if (!free_items.empty()) {
+        id = free_items.back();
+        free_items.pop_back();
+    } else {
+        id = items.size();
+        items.emplace_back();
+        item_query_marks.push_back(0);
+    }
+
+    items[id] = Item { item, Rect { x, y, w, h }, Response::Slide, true };
+    item_ids[item.pointer()] = id;
+
+    add_to_cells(id);
+
+    return item;
+}
+
+void CollisionWorld::update(sol::object item, double x, double y, sol::optional<double> w, sol::optional<double> h) {
+    auto id = id_of(item);
+    auto &rect = items[id].rect;
+
+    Rect new_rect { x, y, w.value_or(rect.w), h.value_or(rect.h) };
+    if (new_rect.x == rect.x && new_rect.y == rect.y && new_rect.w == rect.w && new_rect.h == rect.h)
+        return;
+
+    remove_from_cells(id);
+    rect = new_rect;
+    add_to_cells(id);
+}
+
+void CollisionWorld::remove(sol::object item) {
+    auto id = id_of(item);
+
+    remove_from_cells(id);
+
+    item_ids.erase(item.pointer());
+    items[id] = Item {};
+    free_items.push_back(id);
+}
+
+bool CollisionWorld::has_item(sol::object item) const {
+    return maybe_id_of(item).has_value();
+}
+
+std::tuple<double, double, double, double> CollisionWorld::get_rect(sol::object item) const {
+    auto &rect = items[id_of(item)].rect;
+
+    return { rect.x, rect.y, rect.w, rect.h };
+}
+
+void CollisionWorld::set_response(sol::object item, Response response) {
+    items[id_of(item)].response = response;
+}
+
+std::tuple<sol::table, size_t> CollisionWorld::query_rect(
+    sol::this_state lua, double x, double y, double w, double h, sol::optional<sol::function> filter
+) {
+    Rect rect { x, y, w, h };
+
+    // The filter may use the world too, so it's only called once the query is done with the marks
+    std::vector<sol::object> found;
+    for_each_near(rect, [&](uint32_t id) {
+        if (is_intersecting(rect, items[id].rect))
+            found.push_back(items[id].object);
+    });
+
+    return filtered_items(lua, found, filter);
+}
+
+std::tuple<sol::table, size_t> CollisionWorld::query_point(
+    sol::this_state lua, double x, double y, sol::optional<sol::function> filter
+) {
+    std::vector<sol::object> found;
+    for_each_near(Rect { x, y, 0, 0 }, [&](uint32_t id) {
+        if (contains_point(items[id].rect, x, y))
+            found.push_back(items[id].object);
+    });
+
+    return filtered_items(lua, found, filter);
+}
+
+template <typename F>
+std::vector<CollisionWorld::Collision> CollisionWorld::project(
+    uint32_t id, const Rect &rect, double goal_x, double goal_y, F filter
+) {
+    // Everything the item can touch on its way to the goal
+    double left = std::min(rect.x, goal_x), top = std::min(rect.y, goal_y);
+    Rect swept {
+        left, top,
+        std::max(rect.x, goal_x) + rect.w - left, std::max(rect.y, goal_y) + rect.h - top
+    };
+
+    std::vector<uint32_t> candidates;
+    for_each_near(swept, [&](uint32_t other) {
+        if (other != id)
+            candidates.push_back(other);
+    });
+
+    std::vector<Collision> result;
+    for (auto other : candidates) {
+        auto response = filter(other);
+        if (!response)
+            continue;
+
+        auto col = detect_collision(rect, items[other].rect, goal_x, goal_y);
+        if (col) {
+            col->other = other;
+            col->type = *response;
+
+            result.push_back(*col);
+        }
+    }
+
+    std::sort(result.begin(), result.end(), [](const Collision &a, const Collision &b) {
+        if (a.ti == b.ti)
+            return square_distance(a.item_rect, a.other_rect) < square_distance(a.item_rect, b.other_rect);
+
+        return a.ti < b.ti;
+    });
+
+    return result;
+}
+
+sol::table CollisionWorld::collision_to_lua(sol::state_view &lua, uint32_t id, const Collision &col) {
+    auto rect_to_lua = [&lua](const Rect &rect) {
+        return lua.create_table_with("x", rect.x, "y", rect.y, "w", rect.w, "h", rect.h);
+    };
+
+    return lua.create_table_with(
+        "item", items[id].object,
+        "other", items[col.other].object,
+        "type", response_name(col.type),
+        "overlaps", col.overlaps,
+        "ti", col.ti,
+        "move", lua.create_table_with("x", col.move_x, "y", col.move_y),
+        "normal", lua.create_table_with("x", col.normal_x, "y", col.normal_y),
+        "touch", lua.create_table_with("x", col.touch_x, "y", col.touch_y),
+        "itemRect", rect_to_lua(col.item_rect),
+        "otherRect", rect_to_lua(col.other_rect)
+    );
+}
+
+std::tuple<double, double, sol::table, size_t> CollisionWorld::check(
+    sol::this_state lua_, sol::object item, double goal_x, double goal_y, sol::optional<sol::function> filter
+) {
+    sol::state_view lua(lua_);
+
+    auto id = id_of(item);
+    auto rect = items[id].rect;
+
+    std::vector<uint32_t> visited { id };
+    auto visited_filter = [&](uint32_t other) -> std::optional<Response> {
+        if (std::find(visited.begin(), visited.end(), other) != visited.end())
+            return std::nullopt;
+
+        // Without a filter function, every item decides the response itself
+        if (!filter)
+            return items[other].response;
+
+        sol::object result = (*filter)(items[id].object, items[other].object);
+        if (!result.valid() || result.get_type() != sol::type::string)
+            return std::nullopt;
+
+        auto response = response_from_name(result.as<std::string>());
+        if (!response)
+            throw std::invalid_argument(fmt::format("Unknown collision type: {}", result.as<std::string>()));
+
+        return response;
+    };
+
+    auto cols = lua.create_table();
+    size_t count = 0;
+
+    auto projected = project(id, rect, goal_x, goal_y, visited_filter);
+    while (!projected.empty()) {
+        auto col = projected.front();
+
+        cols[++count] = collision_to_lua(lua, id, col);
+        visited.push_back(col.other);
+
+        switch (col.type) {
+        case Response::Touch:
+            goal_x = col.touch_x;
+            goal_y = col.touch_y;
+            projected.clear();
+            break;
+        case Response::Cross:
+            projected = project(id, rect, goal_x, goal_y, visited_filter);
+            break;
+        case Response::Slide: {
+            if (col.move_x != 0 || col.move_y != 0) {
+                if (col.normal_x != 0)
+                    goal_x = col.touch_x;
+                else
+                    goal_y = col.touch_y;
+            }
+
+            Rect touch_rect { col.touch_x, col.touch_y, rect.w, rect.h };
+            projected = project(id, touch_rect, goal_x, goal_y, visited_filter);
+            break;
+        }
+        }
+    }
+
+    return { goal_x, goal_y, cols, count };
+}
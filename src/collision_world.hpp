@@ -0,0 +1,100 @@
+#pragma once
+
+#include <vector>
+#include <optional>
+#include <unordered_map>
+
+#include <sol/sol.hpp>
+
+/** An axis-aligned rectangle collision world, with the same interface and behavior as bump.lua,
+ *  but keeping items in a spatial hash so that queries only look at the items nearby.
+ */
+class CollisionWorld {
+public:
+    enum class Response {
+        Slide,
+        Cross,
+        Touch
+    };
+
+    struct Rect {
+        double x, y, w, h;
+    };
+
+    struct Collision {
+        uint32_t other;
+        Response type;
+        bool overlaps;
+        double ti;
+        double move_x, move_y;
+        double normal_x, normal_y;
+        double touch_x, touch_y;
+        Rect item_rect, other_rect;
+    };
+
+private:
+    struct Item {
+        sol::object object;
+        Rect rect;
+        // The response other items get when they move into this one
+        Response response = Response::Slide;
+        bool alive = false;
+    };
+
+    double cell_size;
+
+    std::vector<Item> items;
+    std::vector<uint32_t> free_items;
+    std::unordered_map<const void *, uint32_t> item_ids;
+
+    std::unordered_map<int64_t, std::vector<uint32_t>> cells;
+
+    // Each item remembers the last query that saw it, so that items in multiple cells are only reported once
+    std::vector<uint32_t> item_query_marks;
+    uint32_t query_mark = 0;
+
+    uint32_t id_of(const sol::object &item) const;
+    std::optional<uint32_t> maybe_id_of(const sol::object &item) const;
+
+    void add_to_cells(uint32_t id);
+    void remove_from_cells(uint32_t id);
+
+    /** Calls the callback once for every item in the cells the rectangle touches. */
+    template <typename F>
+    void for_each_near(const Rect &rect, F callback);
+
+    /** Finds all the collisions on the way from the rect to the goal, sorted by the order they happen. */
+    template <typename F>
+    std::vector<Collision> project(uint32_t id, const Rect &rect, double goal_x, double goal_y, F filter);
+
+    sol::table collision_to_lua(sol::state_view &lua, uint32_t id, const Collision &col);
+public:
+    static constexpr double default_cell_size = 64;
+
+    CollisionWorld(double cell_size = default_cell_size) : cell_size(cell_size) { }
+
+    sol::object add(sol::object item, double x, double y, double w, double h);
+    void update(sol::object item, double x, double y, sol::optional<double> w, sol::optional<double> h);
+    void remove(sol::object item);
+
+    bool has_item(sol::object item) const;
+    std::tuple<double, double, double, double> get_rect(sol::object item) const;
+
+    /** Sets the response other items get when they move into this one and no filter function is passed to check. */
+    void set_response(sol::object item, Response response);
+
+    std::tuple<sol::table, size_t> query_rect(sol::this_state lua, double x, double y, double w, double h, sol::optional<sol::function> filter);
+    std::tuple<sol::table, size_t> query_point(sol::this_state lua, double x, double y, sol::optional<sol::function> filter);
+
+    /** Tries to move the item to the goal, returning where it can actually go and what it collides with on the way.
+     *
+     *  The filter may be a function that returns the response name for an item pair like in bump, otherwise
+     *  the responses set with set_response are used.
+     */
+    std::tuple<double, double, sol::table, size_t> check(
+        sol::this_state lua, sol::object item, double goal_x, double goal_y, sol::optional<sol::function> filter
+    );
+
+    static const char *response_name(Response response);
+    static std::optional<Response> response_from_name(const std::string &name);
+};
@@ -0,0 +1,347 @@
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+#include "fmt/format.h"
+
+#include "coroutine_scheduler.hpp"
+
+namespace {
+
+uint64_t ticks_for(float seconds, double tick_length) {
+    if (seconds <= 0)
+        return 1;
+
+    return std::max<uint64_t>(1, (uint64_t)std::ceil(seconds / tick_length));
+}
+
+}
+
+void CoroutineScheduler::TaskList::push_back(Task *task) {
+    task->list = this;
+    task->prev = tail;
+    task->next = nullptr;
+
+    if (tail)
+        tail->next = task;
+    else
+        head = task;
+    tail = task;
+}
+
+void CoroutineScheduler::TaskList::remove(Task *task) {
+    if (task->prev)
+        task->prev->next = task->next;
+    else
+        head = task->next;
+
+    if (task->next)
+        task->next->prev = task->prev;
+    else
+        tail = task->prev;
+
+    task->list = nullptr;
+    task->prev = task->next = nullptr;
+}
+
+CoroutineScheduler::Task *CoroutineScheduler::TaskList::pop_front() {
+    auto task = head;
+    if (task)
+        remove(task);
+
+    return task;
+}
+
+void CoroutineScheduler::TaskList::splice(TaskList &other) {
+    while (auto task = other.pop_front())
+        push_back(task);
+}
+
+CoroutineScheduler::Task *CoroutineScheduler::find(lua_State *state) {
+    auto found = tasks.find(state);
+
+    return found != tasks.end() ? found->second.get() : nullptr;
+}
+
+CoroutineScheduler::Task &CoroutineScheduler::spawn(lua_State *from, int count) {
+    auto task = std::make_unique<Task>();
+
+    task->state = lua_newthread(from);
+    // The reference is made on the main state, since the coroutine it's made from can be collected first
+    lua_xmove(from, main_state, 1);
+    task->thread = sol::thread(main_state, -1);
+    lua_pop(main_state, 1);
+
+    lua_xmove(from, task->state, count);
+
+    // Coroutines made while the others are running start right away, like they did when they were run from lua
+    (is_running ? running : ready).push_back(task.get());
+
+    auto &result = *task;
+    tasks.emplace(task->state, std::move(task));
+
+    return result;
+}
+
+sol::thread CoroutineScheduler::create(sol::this_state lua, sol::variadic_args args) {
+    lua_State *state = lua;
+
+    if (args.size() == 0 || lua_type(state, args.stack_index()) != LUA_TFUNCTION)
+        throw std::invalid_argument("coroutines.create_coroutine expects a function to make a coroutine from");
+
+    for (int i = 0; i < (int)args.size(); i++)
+        lua_pushvalue(state, args.stack_index() + i);
+
+    return spawn(state, args.size()).thread;
+}
+
+void CoroutineScheduler::wake(Task &task) {
+    if (task.list)
+        task.list->remove(&task);
+
+    task.wait = Wait::None;
+    ready.push_back(&task);
+}
+
+void CoroutineScheduler::finish(Task &task) {
+    if (&task == current) {
+        task.abandoned = true;
+        return;
+    }
+
+    while (auto waiter = task.waiters.head)
+        wake(*waiter);
+
+    if (task.list)
+        task.list->remove(&task);
+
+    // Destroying the task releases the coroutine to the GC
+    tasks.erase(task.state);
+}
+
+void CoroutineScheduler::abandon(sol::thread coroutine) {
+    if (auto task = find(coroutine.thread_state()))
+        finish(*task);
+}
+
+CoroutineScheduler::Task &CoroutineScheduler::current_task(lua_State *caller, const char *what) {
+    if (!current || current->state != caller)
+        throw std::logic_error(fmt::format("{} can only be used in a coroutine made with coroutines.create_coroutine", what));
+    if (current->wait != Wait::None)
+        throw std::logic_error(fmt::format("{} is used while the coroutine is already waiting", what));
+
+    return *current;
+}
+
+void CoroutineScheduler::schedule(Task &task, uint64_t tick) {
+    task.wake_tick = tick;
+
+    auto delta = tick > current_tick ? tick - current_tick : 0;
+
+    int level = 0;
+    while (level < wheel_levels - 1 && delta >= (uint64_t(1) << (wheel_bits * (level + 1))))
+        level++;
+
+    // Timers that are further away than the whole wheel wait in the top level and are put back there until they're close enough
+    auto slot_tick = std::min(tick, current_tick + (uint64_t(1) << (wheel_bits * wheel_levels)) - 1);
+    wheel[level][(slot_tick >> (wheel_bits * level)) & (wheel_slots - 1)].push_back(&task);
+}
+
+void CoroutineScheduler::advance_to(uint64_t tick) {
+    while (current_tick < tick) {
+        current_tick++;
+
+        // When a slot of a higher level comes up, its timers are spread over the levels below.
+        // Higher levels go first, since they can move timers into the slots of the lower levels that come up right now
+        for (int level = wheel_levels - 1; level > 0; level--) {
+            auto shift = wheel_bits * level;
+            if (current_tick & ((uint64_t(1) << shift) - 1))
+                continue;
+
+            TaskList due;
+            due.splice(wheel[level][(current_tick >> shift) & (wheel_slots - 1)]);
+            while (auto task = due.pop_front())
+                schedule(*task, task->wake_tick);
+        }
+
+        auto &slot = wheel[0][current_tick & (wheel_slots - 1)];
+        while (auto task = slot.pop_front()) {
+            if (task->wait == Wait::Condition)
+                check_condition(*task);
+            else
+                wake(*task);
+        }
+    }
+}
+
+void CoroutineScheduler::check_condition(Task &task) {
+    current = &task;
+    sol::protected_function_result result = task.condition();
+    current = nullptr;
+
+    if (task.abandoned) {
+        task.abandoned = false;
+        finish(task);
+
+        return;
+    }
+
+    if (!result.valid()) {
+        sol::error err = result;
+        finish(task);
+
+        throw sol::error(fmt::format("The condition a coroutine waits for failed with \"{}\"", err.what()));
+    }
+
+    sol::object value = result;
+    if (value.get_type() != sol::type::lua_nil && !(value.get_type() == sol::type::boolean && !value.as<bool>())) {
+        task.condition = sol::lua_nil;
+        wake(task);
+    } else if (task.condition_interval > 0) {
+        schedule(task, current_tick + task.condition_interval);
+    } else {
+        conditions.push_back(&task);
+    }
+}
+
+void CoroutineScheduler::wait_for(sol::this_state lua, sol::thread coroutine) {
+    auto &task = current_task(lua, "coroutines.wait_for");
+
+    auto other = find(coroutine.thread_state());
+    // Coroutines that already finished don't need to be waited for
+    if (!other)
+        return;
+    if (other == &task)
+        throw std::logic_error("A coroutine can't wait for itself");
+
+    task.wait = Wait::Coroutine;
+    other->waiters.push_back(&task);
+}
+
+void CoroutineScheduler::wait_event(sol::this_state lua, const std::string &name) {
+    auto &task = current_task(lua, "coroutines.wait_event");
+
+    task.wait = Wait::Event;
+    events[name].push_back(&task);
+}
+
+void CoroutineScheduler::sleep(sol::this_state lua, float seconds) {
+    auto &task = current_task(lua, "coroutines.sleep");
+
+    task.wait = Wait::Timer;
+    schedule(task, current_tick + ticks_for(seconds, tick_length));
+}
+
+void CoroutineScheduler::wait_until(sol::this_state lua, sol::protected_function condition, sol::optional<float> interval) {
+    auto &task = current_task(lua, "coroutines.wait_until");
+
+    // The function is called from the main state, the coroutine is suspended by then
+    condition.push(main_state);
+    task.condition = sol::protected_function(main_state, -1);
+    lua_pop(main_state, 1);
+
+    task.wait = Wait::Condition;
+    if (interval && *interval > 0) {
+        task.condition_interval = ticks_for(*interval, tick_length);
+        schedule(task, current_tick + task.condition_interval);
+    } else {
+        task.condition_interval = 0;
+        conditions.push_back(&task);
+    }
+}
+
+void CoroutineScheduler::signal(const std::string &name) {
+    auto found = events.find(name);
+    if (found == events.end())
+        return;
+
+    while (auto task = found->second.head)
+        wake(*task);
+}
+
+void CoroutineScheduler::resume(Task &task, float dt) {
+    auto state = task.state;
+
+    int arg_count;
+    if (!task.started) {
+        // The function and the arguments are already on the coroutine's stack
+        arg_count = lua_gettop(state) - 1;
+        task.started = true;
+    } else {
+        lua_pushnumber(state, dt);
+        arg_count = 1;
+    }
+
+    current = &task;
+    auto status = lua_resume(state, main_state, arg_count);
+    current = nullptr;
+
+    if (status != LUA_OK && status != LUA_YIELD) {
+        const char *message = lua_tostring(state, -1);
+
+        luaL_traceback(main_state, state, nullptr, 0);
+        auto error = fmt::format(
+            "Coroutine exited with \"{}\"\n  {}\n\n", message ? message : "(error object is not a string)", lua_tostring(main_state, -1)
+        );
+        lua_pop(main_state, 1);
+
+        finish(task);
+
+        throw sol::error(error);
+    }
+
+    if (task.abandoned || status == LUA_OK) {
+        task.abandoned = false;
+        finish(task);
+
+        return;
+    }
+
+    // If a function was yielded, it's made into a coroutine with the rest of the yielded values
+    // as its arguments, and this coroutine waits for it to finish
+    int result_count = lua_gettop(state);
+    if (task.wait == Wait::None && result_count > 0 && lua_type(state, 1) == LUA_TFUNCTION) {
+        auto &child = spawn(state, result_count);
+
+        task.wait = Wait::Coroutine;
+        child.waiters.push_back(&task);
+    }
+    lua_settop(state, 0);
+
+    // Waiting tasks are put back when whatever they wait for happens
+    if (task.wait == Wait::None && !task.list)
+        ready.push_back(&task);
+}
+
+void CoroutineScheduler::run(float dt) {
+    now += dt;
+    advance_to((uint64_t)(now / tick_length));
+
+    TaskList checking;
+    checking.splice(conditions);
+    try {
+        while (auto task = checking.pop_front())
+            check_condition(*task);
+    } catch (...) {
+        conditions.splice(checking);
+        throw;
+    }
+
+    running.splice(ready);
+
+    is_running = true;
+    try {
+        while (auto task = running.pop_front())
+            resume(*task, dt);
+    } catch (...) {
+        // Keep the rest of the coroutines for the next run, in the same order
+        TaskList rest;
+        rest.splice(running);
+        rest.splice(ready);
+        ready.splice(rest);
+
+        is_running = false;
+        throw;
+    }
+    is_running = false;
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <unordered_map>
+
+#include "sol/sol.hpp"
+
+/** Runs the lua coroutines made with coroutines.create_coroutine, resuming each of them once per frame.
+ *
+ *  Coroutines that wait for another coroutine, an event or a timer are taken out of the ready list until
+ *  what they wait for happens, so they cost nothing while waiting. Resuming them doesn't allocate.
+ *
+ *  Timers are kept in a hierarchical timer wheel: every level has a fixed number of slots, each covering
+ *  a range of ticks that's as long as the whole level below it. Slots of the higher levels are
+ *  moved down when the time reaches them, so only the timers that are due are ever touched.
+ */
+class CoroutineScheduler {
+    struct Task;
+
+    /** An intrusive list of tasks, a task is in at most one of them at a time. */
+    struct TaskList {
+        Task *head = nullptr, *tail = nullptr;
+
+        bool empty() const { return head == nullptr; }
+
+        void push_back(Task *task);
+        void remove(Task *task);
+        Task *pop_front();
+        /** Moves all the tasks of the other list to the end of this one. */
+        void splice(TaskList &other);
+    };
+
+    enum class Wait {
+        None,
+        Coroutine,
+        Event,
+        Timer,
+        // Waits until a function returns true, checking it on a timer or every run
+        Condition
+    };
+
+    struct Task {
+        sol::thread thread;
+        lua_State *state;
+
+        bool started = false;
+        // Set when the coroutine is abandoned from inside itself, it's removed after it yields
+        bool abandoned = false;
+
+        Wait wait = Wait::None;
+        // The tick when the timer of a timer or condition wait runs out
+        uint64_t wake_tick = 0;
+
+        sol::protected_function condition;
+        // In ticks, 0 means that the condition is checked every run
+        uint64_t condition_interval = 0;
+
+        TaskList *list = nullptr;
+        Task *prev = nullptr, *next = nullptr;
+
+        // Tasks waiting for this one to finish
+        TaskList waiters;
+    };
+
+    static constexpr double tick_length = 0.01;
+    static constexpr int wheel_bits = 6;
+    static constexpr uint64_t wheel_slots = 1 << wheel_bits;
+    static constexpr int wheel_levels = 4;
+
+    lua_State *main_state;
+
+    std::unordered_map<lua_State*, std::unique_ptr<Task>> tasks;
+
+    TaskList ready;
+    // Tasks that are left to resume in the current run
+    TaskList running;
+    std::unordered_map<std::string, TaskList> events;
+
+    TaskList wheel[wheel_levels][wheel_slots];
+    // Conditions that are checked every run
+    TaskList conditions;
+
+    double now = 0;
+    uint64_t current_tick = 0;
+
+    bool is_running = false;
+    Task *current = nullptr;
+
+    /** Makes a task from the function and the arguments at the top of the stack, which are moved to the new coroutine. */
+    Task &spawn(lua_State *from, int count);
+    void resume(Task &task, float dt);
+    void finish(Task &task);
+    void wake(Task &task);
+
+    Task *find(lua_State *state);
+    Task &current_task(lua_State *caller, const char *what);
+
+    void schedule(Task &task, uint64_t tick);
+    void advance_to(uint64_t tick);
+    /** Wakes the task up if its condition is true, or schedules the next check. */
+    void check_condition(Task &task);
+public:
+    explicit CoroutineScheduler(lua_State *main_state) : main_state(main_state) {}
+
+    CoroutineScheduler(const CoroutineScheduler &) = delete;
+    CoroutineScheduler &operator=(const CoroutineScheduler &) = delete;
+
+    /** Takes a function and the arguments to start it with, returns the coroutine. */
+    sol::thread create(sol::this_state lua, sol::variadic_args args);
+    /** Removes the coroutine, coroutines waiting for it continue. */
+    void abandon(sol::thread coroutine);
+
+    // These are called from a coroutine right before it yields
+
+    void wait_for(sol::this_state lua, sol::thread coroutine);
+    void wait_event(sol::this_state lua, const std::string &name);
+    void sleep(sol::this_state lua, float seconds);
+    /** Checks the function every interval seconds (or every run if there's no interval) until it returns true. */
+    void wait_until(sol::this_state lua, sol::protected_function condition, sol::optional<float> interval);
+
+    /** Wakes up all the coroutines waiting for the event. */
+    void signal(const std::string &name);
+
+    /** Resumes every coroutine that isn't waiting with the time since the last run. */
+    void run(float dt);
+
+    size_t size() const { return tasks.size(); }
+};
@@ -1,19 +1,40 @@
 #pragma once
 
 #include "lua_module_env.hpp"
+#include "coroutine_scheduler.hpp"
 
 class CoroutinesEnv : public LuaModuleEnv {
 private:
-    sol::protected_function run_f;
+    CoroutineScheduler scheduler;
 public:
     void run(float dt) {
-        call_or_throw(run_f, dt);
+        try {
+            scheduler.run(dt);
+        } catch (const sol::error &err) {
+#ifdef SOMEONE_EMSCRIPTEN
+            spdlog::error("{}", err.what());
+#endif
+
+            throw;
+        }
     }
 
-    CoroutinesEnv(sol::state &lua) : LuaModuleEnv(lua) {
+    CoroutinesEnv(sol::state &lua) : LuaModuleEnv(lua), scheduler(lua.lua_state()) {
+        // The scheduler is native, the module wraps it for lua
+        lua["CoroutineScheduler"] = lua.create_table_with(
+            "create", [this](sol::this_state state, sol::variadic_args args) { return scheduler.create(state, args); },
+            "abandon", [this](sol::thread coroutine) { scheduler.abandon(coroutine); },
+            "wait_for", [this](sol::this_state state, sol::thread coroutine) { scheduler.wait_for(state, coroutine); },
+            "wait_event", [this](sol::this_state state, const std::string &name) { scheduler.wait_event(state, name); },
+            "sleep", [this](sol::this_state state, float seconds) { scheduler.sleep(state, seconds); },
+            "wait_until", [this](sol::this_state state, sol::protected_function condition, sol::optional<float> interval) {
+                scheduler.wait_until(state, condition, interval);
+            },
+            "signal", [this](const std::string &name) { scheduler.signal(name); },
+            "count", [this]() { return scheduler.size(); }
+        );
+
         // This both defines a global for the module and returns it
         module = lua.require_script("CoroutinesModule", "return require('coroutines')");
-
-        run_f = module["run"];
     }
 };
@@ -1,7 +1,11 @@
 #pragma once
 
+#include <memory>
+#include <string_view>
+
 #include "SFML/Graphics/Color.hpp"
 #include "fonts.hpp"
+#include "text_template.hpp"
 
 struct CharacterConfig {
     sf::Color color;
@@ -10,50 +14,67 @@ struct CharacterConfig {
     CharacterConfig(sf::Color color = sf::Color::White, uint32_t size = StaticFonts::font_size) : color(color), font_size(size) {}
 };
 
+// Strings in the line data point into the memory of the story parser (or the story bundle) and are
+// only made into lua strings when they are accessed. Names and next references are interned.
+
 struct TerminalLineData {
     CharacterConfig character_config;
-    std::optional<std::string> script;
-    std::optional<std::string> script_after;
+    std::optional<std::string_view> script;
+    std::optional<std::string_view> script_after;
+
+    // Keeps the memory the strings point to alive
+    std::shared_ptr<const void> storage;
 
     virtual ~TerminalLineData() { }
 };
 
 struct TerminalOutputLineData : TerminalLineData {
-    std::string text;
-    std::string next;
+    std::string_view text;
+    std::string_view next;
 
-    TerminalOutputLineData(std::string text, std::string next)
-        : text(text), next(next) { }
+    TextTemplate text_template;
+
+    TerminalOutputLineData(std::string_view text, std::string_view next)
+        : text(text), next(next), text_template(text) { }
 };
 
 struct TerminalInputWaitLineData : TerminalOutputLineData {
-    TerminalInputWaitLineData(std::string text, std::string next)
+    TerminalInputWaitLineData(std::string_view text, std::string_view next)
         : TerminalOutputLineData(text, next) { }
 };
 
 struct TerminalVariantInputLineData : TerminalLineData {
     struct Variant {
-        std::string text;
-        std::string next;
-        std::optional<std::string> condition;
+        std::string_view text;
+        std::string_view next;
+        std::optional<std::string_view> condition;
+
+        // Only made when the line data is made, not for the parsed lines
+        TextTemplate text_template;
 
-        Variant(std::string text, std::string next) : text(text), next(next) {}
+        Variant(std::string_view text, std::string_view next) : text(text), next(next) {}
     };
 
     std::vector<Variant> variants;
 
     TerminalVariantInputLineData(decltype(variants) variants)
-        : variants(variants) { }
+        : variants(variants) {
+        for (auto &variant : this->variants)
+            variant.text_template = TextTemplate(variant.text);
+    }
 };
 
 struct TerminalTextInputLineData : TerminalLineData {
-    std::string before, after, variable, next;
+    std::string_view before, after, variable, next;
     uint32_t max_length;
-    std::vector<std::string> filters;
+    std::vector<std::string_view> filters;
+
+    TextTemplate before_template, after_template;
 
-    TerminalTextInputLineData(std::string before, std::string after, std::string variable, uint32_t max_length,
-                              std::vector<std::string> filters, std::string next)
-        : before(before), after(after), variable(variable), max_length(max_length), next(next), filters(filters) {}
+    TerminalTextInputLineData(std::string_view before, std::string_view after, std::string_view variable, uint32_t max_length,
+                              std::vector<std::string_view> filters, std::string_view next)
+        : before(before), after(after), variable(variable), max_length(max_length), next(next), filters(filters),
+          before_template(before), after_template(after) {}
 };
 
 struct TerminalCustomLineData : TerminalLineData {
@@ -63,3 +84,61 @@ struct TerminalCustomLineData : TerminalLineData {
     TerminalCustomLineData(sol::object class_, sol::object data)
         : data(data), class_(class_) { }
 };
+
+/** A value in the data of a custom line, kept without lua so that it can be stored in a story bundle. */
+struct StoryValue {
+    enum class Type : uint8_t {
+        Nil,
+        Int,
+        Float,
+        String,
+        Array,
+        Map
+    };
+
+    Type type = Type::Nil;
+
+    int32_t int_value = 0;
+    float float_value = 0;
+    std::string_view string_value;
+
+    // Elements of an array, or values of a map with the keys in the same order
+    std::vector<StoryValue> values;
+    std::vector<std::string_view> keys;
+};
+
+/** A parsed line that hasn't been turned into one of the line data types above yet, which needs lua.
+ *
+ *  Like in the line data, the strings point into memory owned by the parser or the story bundle.
+ */
+struct StoryLine {
+    enum class Type : uint8_t {
+        Output,
+        InputWait,
+        VariantInput,
+        TextInput,
+        Custom
+    };
+
+    Type type;
+    std::string_view name;
+
+    CharacterConfig character_config;
+    std::optional<std::string_view> script;
+    std::optional<std::string_view> script_after;
+
+    // Output, input wait and text input lines
+    std::string_view next;
+    // Output and input wait lines
+    std::string_view text;
+
+    std::vector<TerminalVariantInputLineData::Variant> variants;
+
+    std::string_view before, after, variable;
+    uint32_t max_length = 0;
+    std::vector<std::string_view> filters;
+
+    // The class of a custom line is looked up as custom_class in the custom_module module
+    std::string_view custom_module, custom_class;
+    StoryValue custom_data;
+};
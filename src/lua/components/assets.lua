@@ -26,18 +26,89 @@ M.add_to_known_assets = function(asset_type, key, path)
    known_assets[asset_type][key] = path
 end
 
+-- Requests for textures and sounds that are being loaded in the background
+local pending = {
+  textures = {},
+  sounds = {}
+}
+
+-- Textures and sounds are kept in the native cache instead of M.assets,
+-- so it can free the ones that aren't used when it's over its budget
+local cached_types = {
+  textures = true,
+  sounds = true
+}
+
+local function get_cached(asset_type, key)
+   if asset_type == "textures" then
+      return AssetCache.get_texture(key)
+   else
+      return AssetCache.get_sound_buffer(key)
+   end
+end
+
+-- Requests put their assets into the cache when they're uploaded
+local function start_loading(asset_type, key, path)
+   if asset_type == "textures" then
+      return AssetLoader.load_texture(path, key)
+   else
+      return AssetLoader.load_sound(path, key)
+   end
+end
+
+-- Waits for the request and takes its asset from the cache. The placeholder is used for textures that failed to load
+local function take_from_request(asset_type, key, request)
+   request:wait()
+
+   local asset = get_cached(asset_type, key)
+   if not asset and not request.failed then
+      -- Prefetched long enough ago to be evicted already
+      request = start_loading(asset_type, key, known_assets[asset_type][key])
+      request:wait()
+
+      asset = get_cached(asset_type, key)
+   end
+
+   if asset then
+      return asset
+   elseif asset_type == "textures" then
+      return M.placeholder_texture
+   else
+      return SoundBuffer.new()
+   end
+end
+
 local function load_from_known_assets(asset_type, key)
    local maybe_known_asset_path = known_assets[asset_type][key]
    if not maybe_known_asset_path then
       return nil
    end
 
+   if asset_type == "textures" and type(maybe_known_asset_path) == "table" then
+      -- A region of an atlas page, it keeps the page alive
+      local atlas_texture = maybe_known_asset_path
+      local page = M.assets.textures[atlas_texture.page]
+      if page == M.placeholder_texture then
+         return page
+      end
+
+      local rect = atlas_texture.rect
+      local texture = Texture.from_region(page, IntRect.new(rect[1], rect[2], rect[3], rect[4]))
+      AssetCache.add_texture(key, texture)
+
+      return texture
+   end
+
+   if cached_types[asset_type] then
+      -- Finishes the request right away if it wasn't prefetched or isn't loaded yet
+      local request = pending[asset_type][key] or M.prefetch(asset_type, key)
+      pending[asset_type][key] = nil
+
+      return take_from_request(asset_type, key, request)
+   end
+
    local asset
-   if asset_type == "textures" then
-      asset = Texture.new()
-   elseif asset_type == "sounds" then
-      asset = SoundBuffer.new()
-   elseif asset_type == "shaders" then
+   if asset_type == "shaders" then
       asset = maybe_known_asset_path
 
       -- Swap the name to be like other "functions" for debug menu
@@ -45,19 +116,61 @@ local function load_from_known_assets(asset_type, key)
       asset.args = nil
 
       asset.shader = Shader.new()
+      asset.shader:load_from_file(maybe_known_asset_path.file, ShaderType.Fragment)
    else
       error("Unknown asset type: " .. tostring(asset_type))
    end
 
+   M.assets[asset_type][key] = asset
+
+   return asset
+end
+
+-- Starts loading a texture or a sound in the background, returns the request for it.
+-- The asset is used when it's first accessed in M.assets, waiting for the request if it's not done yet.
+-- Returns nil if the asset is already loaded or isn't known. Shaders are compiled on the main thread,
+-- so they're loaded right away.
+function M.prefetch(asset_type, key)
+   local path = known_assets[asset_type][key]
+   if not path then
+      return nil
+   end
+
+   -- Textures in an atlas only need their page
+   if asset_type == "textures" and type(path) == "table" then
+      return M.prefetch(asset_type, path.page)
+   end
+
    if asset_type == "shaders" then
-      asset.shader:load_from_file(maybe_known_asset_path.file, ShaderType.Fragment)
-   else
-      asset:load_from_file(maybe_known_asset_path)
+      local _ = M.assets.shaders[key]
+      return nil
    end
 
-   M.assets[asset_type][key] = asset
+   if AssetCache.contains(asset_type, key) then
+      return nil
+   end
 
-   return asset
+   -- Requests that finished without failing have nothing left to give, their asset was evicted or they were cancelled
+   local request = pending[asset_type][key]
+   if not request or (request.done and not request.failed) then
+      request = start_loading(asset_type, key, path)
+      pending[asset_type][key] = request
+   end
+
+   return request
+end
+
+-- Stops loading a prefetched asset if it's not loaded yet, for when it's not going to be needed after all
+function M.cancel_prefetch(request)
+   request:cancel()
+
+   for _, type_pending in pairs(pending) do
+      for key, pending_request in pairs(type_pending) do
+         if pending_request == request then
+            type_pending[key] = nil
+         end
+      end
+   end
 end
 
 function M.list_known_assets(asset_type)
@@ -70,6 +183,10 @@ for k, v in pairs(M.assets) do
       v,
       {
          __index = function(_, key)
+            if cached_types[k] then
+               return get_cached(k, key) or load_from_known_assets(k, key)
+            end
+
             return load_from_known_assets(k, key)
          end
       }
@@ -80,9 +197,52 @@ M.used_assets = {}
 -- Mark table keys as weak, so they don't prevent GC
 setmetatable(M.used_assets, {__mode = "k"})
 
+-- References of objects to the assets they use, by slot. An object usually uses one asset of a type,
+-- so the slot is the type by default. They're released when the object is collected.
+local references = {}
+setmetatable(references, {__mode = "k"})
+
+local owner_references_metatable = {
+   __gc = function(owner_references)
+      for _, reference in pairs(owner_references) do
+         AssetCache.release(reference.asset_type, reference.id)
+      end
+   end
+}
+
+-- Returns the asset for the object to use, the cache doesn't free it while the object exists
+-- or until it uses another asset in the same slot
+function M.use_asset(asset_type, key, owner, slot)
+   slot = slot or asset_type
+
+   local asset = M.assets[asset_type][key]
+
+   local owner_references = references[owner]
+   if not owner_references then
+      owner_references = setmetatable({}, owner_references_metatable)
+      references[owner] = owner_references
+   end
+
+   local old = owner_references[slot]
+   if old then
+      AssetCache.release(old.asset_type, old.id)
+      owner_references[slot] = nil
+   end
+
+   if asset and cached_types[asset_type] then
+      -- Placeholders for assets that failed to load aren't in the cache
+      local id = AssetCache.acquire(asset_type, key)
+      if id ~= 0 then
+         owner_references[slot] = { asset_type = asset_type, id = id }
+      end
+   end
+
+   return asset
+end
+
 function M.create_sound_from_asset(asset_name)
    local sound = Sound.new()
-   sound.buffer = M.assets.sounds[asset_name]
+   sound.buffer = M.use_asset("sounds", asset_name, sound)
 
    M.used_assets[sound] = asset_name
 
@@ -92,7 +252,7 @@ end
 function M.create_sprite_from_asset(asset_name)
    local drawable = Sprite.new()
    if asset_name ~= "placeholder" then
-      drawable.texture = M.assets.textures[asset_name]
+      drawable.texture = M.use_asset("textures", asset_name, drawable)
    else
       drawable.texture = M.placeholder_texture
    end
@@ -224,7 +384,8 @@ function M.debug_menu()
 
             -- Delete the old asset, if there was one
             if editing_asset.name then
-               M.assets[key][editing_asset.name] = nil
+               AssetCache.remove(key, editing_asset.name)
+               pending[key][editing_asset.name] = nil
             end
             if editing_asset.new_name then
                -- Put the new asset in its place, if there is one
@@ -238,7 +399,7 @@ function M.debug_menu()
             for obj, asset_name in pairs(M.used_assets) do
                if asset_name == editing_asset.name then
                   local updated_field
-                  local updated_value = M.assets[key][editing_asset.new_name]
+                  local updated_value = editing_asset.new_name and M.use_asset(key, editing_asset.new_name, obj)
                   if key == "textures" and obj.__type.name == "sf::Sprite" then
                      updated_field = "texture"
 
@@ -299,6 +460,34 @@ function M.resources_root()
    end
 end
 
+-- Textures packed by someone_atlas_compiler are taken from their atlas pages instead of their own files.
+-- Pages are known textures too, named atlas/<page>
+local function load_atlases(resources_root)
+   local atlases_root = path.join(resources_root, "atlases")
+   local atlases_path = path.join(atlases_root, "atlases.toml")
+   if not fs.exists(atlases_path) then
+      return
+   end
+
+   local atlases, err = TOML.parse(atlases_path)
+   if err then
+      error(err)
+   end
+
+   for page, page_path in pairs(atlases.pages or {}) do
+      M.add_to_known_assets("textures", "atlas/" .. page, path.join(atlases_root, page_path))
+   end
+
+   for name, atlas_texture in pairs(atlases.textures or {}) do
+      -- Textures that were removed from assets.toml since the atlases were made stay removed
+      if known_assets.textures[name] then
+         M.add_to_known_assets(
+            "textures", name, { page = "atlas/" .. atlas_texture.page, rect = atlas_texture.rect }
+         )
+      end
+   end
+end
+
 function M.load_assets()
    local resources_root = M.resources_root()
 
@@ -345,6 +534,11 @@ function M.load_assets()
          end
       end
    end
+
+   -- Mods aren't packed into atlases
+   if not _G.mod then
+      load_atlases(resources_root)
+   end
 end
 
 function M.unload_known_mod_assets()
@@ -353,7 +547,12 @@ function M.unload_known_mod_assets()
          -- Clear references to mod assets
          if asset_name:match("^mod%.(.*)") then
             category[asset_name] = nil
-            rawset(M.assets[cat_name], asset_name, nil)
+            if cached_types[cat_name] then
+               AssetCache.remove(cat_name, asset_name)
+               pending[cat_name][asset_name] = nil
+            else
+               rawset(M.assets[cat_name], asset_name, nil)
+            end
          end
       end
    end
@@ -1,10 +1,14 @@
-local bump = require("bump")
 local lume = require("lume")
 
 local M = {}
 
 function M.reset_world()
-   M.physics_world = bump.newWorld()
+   M.physics_world = CollisionWorld.new()
+end
+
+-- Triggers are crossed by things moving into them, everything else stops them
+local function collider_response(collider)
+   if collider.trigger then return CollisionResponse.Cross else return CollisionResponse.Slide end
 end
 
 M.components = {
@@ -58,6 +62,7 @@ function M.ColliderUpdateSystem.update_from_sprite(entity)
       local x, y = pos.x - tf.origin.x, pos.y - tf.origin.y
 
       physics_world:add(entity, x, y, sprite_size.width, sprite_size.height)
+      physics_world:set_response(entity, collider_response(entity:get("Collider")))
    end
 end
 
@@ -86,6 +91,7 @@ function M.components.collider.process_component(new_ent, comp, entity_name)
 
       M.physics_world:add(new_ent, pos.x - orig.x, pos.y - orig.y, ph_width, ph_height)
       new_ent:add(M.components.collider.class(comp.mode, comp.trigger))
+      M.physics_world:set_response(new_ent, collider_response(new_ent:get("Collider")))
    else
       error("Unknown collider mode " .. tostring(comp.mode) .. " for " .. tostring(entity_name))
    end
@@ -130,6 +136,7 @@ function M.components.collider.class:show_editor(ent)
    x, y = table.unpack(ImGui.InputInt2("XY", {x, y}))
    w, h = table.unpack(ImGui.InputInt2("WH", {w, h}))
    self.trigger = ImGui.Checkbox("Trigger", self.trigger)
+   physics_world:set_response(ent, collider_response(self))
 
    if self.mode == "constant" then
       ent:get("Transformable").transformable.position =
@@ -296,6 +296,9 @@ end
 local function shader_debug_menu()
    local available_shaders = assets.assets.shaders
 
+   -- Values of the shaders can be changed here at any time
+   ShaderPasses.invalidate()
+
    if ImGui.BeginCombo("##add_shader_combo", debug_menu_state.adding_shader.name or "(none)") then
       for name, shader in pairs(available_shaders) do
          if not lume.find(lume.keys(util.rooms_mod()._room_shaders), name)
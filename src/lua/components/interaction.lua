@@ -288,20 +288,12 @@ function M.interaction_callbacks.player_talk(_curr_state, phrase, state_var)
    coroutines.create_coroutine(function ()
          local interaction_text_drawable = util.first(engine:getEntitiesWithComponent("InteractionTextTag")):get("Drawable")
 
-         local letter = 1
-         local timer = 0
-
          interaction_text_drawable.enabled = true
          interaction_text_drawable.drawable.string = ""
 
-         while interaction_text_drawable.drawable.string ~= phrase do
-            if timer > talking_speed then
-               interaction_text_drawable.drawable.string = phrase:sub(1, letter)
-               letter = letter + 1
-               timer = 0
-            end
-
-            timer = timer + coroutine.yield()
+         for letter = 1, #phrase do
+            coroutines.sleep(talking_speed)
+            interaction_text_drawable.drawable.string = phrase:sub(1, letter)
          end
 
          interaction_text_drawable.drawable.string = interaction_text_drawable.drawable.string ..
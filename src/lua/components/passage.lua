@@ -122,6 +122,14 @@ function M.interaction_callbacks.switch_room(_current_state, ent)
    local player_movement = util.rooms_mod().find_player():get("PlayerMovement")
    player_movement.active = false
 
+   -- The room is usually loading since this one was entered, the screen stays black until it's done
+   -- If it can't be prefetched the room is just loaded when switching
+   local ok, requests = pcall(util.rooms_mod().prefetch_room, final_room_name)
+   if not ok then
+      logger.warn(lume.format("Couldn't prefetch {1}: {2}", {final_room_name, requests}))
+      requests = nil
+   end
+
    coroutines.create_coroutine(
       coroutines.black_screen_out,
       function()
@@ -146,7 +154,8 @@ function M.interaction_callbacks.switch_room(_current_state, ent)
       function()
          -- Enable the player back when the room has changed
          player_movement.active = true
-      end
+      end,
+      requests
    )
 end
 debug_components.declare_callback_args(
@@ -44,10 +44,8 @@ PlayerMovementSystem.update = function(self, dt)
             local x, y = physics_world:getRect(entity)
             local expected_new_pos = Vector2f.new(x, y) + pos_diff
 
-            local _, _, cols, col_count = physics_world:check(
-               entity, expected_new_pos.x, expected_new_pos.y,
-               function(item, other) if other:get("Collider").trigger then return "cross" else return "slide" end end
-            )
+            -- Colliders set their own response, triggers are crossed and everything else is slid against
+            local _, _, cols, col_count = physics_world:check(entity, expected_new_pos.x, expected_new_pos.y)
             if col_count == 0 or not lume.any(cols, function(c) return c.type == "slide" end) then
                -- Don't check for collisions here, since the've already been checked,
                -- just update the position
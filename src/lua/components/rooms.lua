@@ -8,16 +8,17 @@ local entities = require("components.entities")
 
 local M = {}
 
--- Loads the room's toml file, processing parent relationships
-function M.load_room_file(name)
-   local path_root
+local function rooms_root()
    if _G.mod then
-      path_root = lume.format("resources/mods/{1}/resources/rooms/", {getmetatable(_G.mod).name})
+      return lume.format("resources/mods/{1}/resources/rooms/", {getmetatable(_G.mod).name})
    else
-      path_root = "resources/rooms/"
+      return "resources/rooms/"
    end
+end
 
-   local path = path_root .. name .. ".toml"
+-- Loads the room's toml file, processing parent relationships
+function M.load_room_file(name)
+   local path = rooms_root() .. name .. ".toml"
 
    local room_table, err = TOML.parse(path)
    if not room_table then
@@ -52,9 +53,34 @@ function M.load_room_file(name)
 end
 
 local CustomEngine = class("CustomEgine", Engine)
+-- Each system is timed separately, so they can be told apart in the profiler.
+-- The scope names are built once per system class, not on every frame
+local scope_names = {}
+function CustomEngine:addSystem(system, type)
+   if not scope_names[system.class] then
+      scope_names[system.class] = {
+         update = system.class.name .. ":update",
+         draw = system.class.name .. ":draw"
+      }
+   end
+   return CustomEngine.super.addSystem(self, system, type)
+end
+function CustomEngine:update(dt)
+   for _, system in ipairs(self.systems["update"]) do
+      if system.active then
+         Profiler.begin_scope(scope_names[system.class].update)
+         system:update(dt)
+         Profiler.end_scope()
+      end
+   end
+end
 function CustomEngine:draw(layer)
    for _, system in ipairs(self.systems["draw"]) do
-      if system.active then system:draw(layer) end
+      if system.active then
+         Profiler.begin_scope(scope_names[system.class].draw)
+         system:draw(layer)
+         Profiler.end_scope()
+      end
    end
 end
 function CustomEngine:stopSystem(name)
@@ -115,6 +141,71 @@ function M.compile_room_shader_enabled()
          setmetatable(M._room_shaders[name], meta)
       end
    end
+
+   -- The shaders are drawn from passes compiled natively, which have to be made again
+   ShaderPasses.invalidate()
+end
+
+-- Starts loading the textures and sounds the room needs in the background,
+-- returns the requests for the ones that aren't loaded yet
+function M.prefetch_room(name)
+   local manifest = RoomManifest.load(rooms_root(), name)
+
+   local requests = {}
+   local function prefetch(asset_type, key)
+      local request = assets.prefetch(asset_type, key)
+      if request then table.insert(requests, request) end
+   end
+
+   for _, file in ipairs(manifest.texture_files) do
+      assets.add_to_known_assets("textures", file.key, file.path)
+      prefetch("textures", file.key)
+   end
+   for _, key in ipairs(manifest.textures) do prefetch("textures", key) end
+   for _, key in ipairs(manifest.sounds) do prefetch("sounds", key) end
+
+   return requests
+end
+
+-- Requests for the rooms next to the current one, cancelled when they're not next to it anymore
+local adjacent_requests = {}
+
+-- Prefetches the rooms the passages of the current room lead to, so they're loaded before the player gets there
+local function prefetch_adjacent_rooms(name)
+   local passage_components = require("components.passage")
+
+   local requests = {}
+   local function prefetch(what, get_room_name)
+      local ok, err = pcall(function()
+         for _, request in ipairs(M.prefetch_room(get_room_name())) do
+            table.insert(requests, request)
+         end
+      end)
+      if not ok then
+         logger.warn(lume.format("Couldn't prefetch {1}: {2}", {what, err}))
+      end
+   end
+
+   -- What the current room still needs is kept too, it might be waited for while the screen is black
+   prefetch(name, function() return name end)
+   for _, ent in pairs(M.engine:getEntitiesWithComponent("Passage")) do
+      prefetch(
+         "the room behind " .. ent:get("Name").name,
+         function() return passage_components.get_final_room_name(ent:get("Passage")) end
+      )
+   end
+
+   local still_needed = {}
+   for _, request in ipairs(requests) do
+      still_needed[request] = true
+   end
+   for _, request in ipairs(adjacent_requests) do
+      if not still_needed[request] and not request.done then
+         assets.cancel_prefetch(request)
+      end
+   end
+
+   adjacent_requests = requests
 end
 
 function M.load_room(name, switch_namespace)
@@ -142,6 +233,7 @@ function M.load_room(name, switch_namespace)
       M.compile_room_shader_enabled()
    else
       M._room_shaders = {}
+      ShaderPasses.invalidate()
    end
 
    if room_toml.entities then
@@ -153,6 +245,8 @@ function M.load_room(name, switch_namespace)
          entities.instantiate_entity(entity_name, entity)
       end
    end
+
+   prefetch_adjacent_rooms(name)
 end
 
 function M.find_player()
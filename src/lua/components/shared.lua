@@ -280,13 +280,16 @@ function M.components.drawable.process_component(new_ent, comp, entity_name)
    elseif comp.kind == "9slice" then
       -- TODO: maybe move this somewhere else or add a way to add more drawables easily
       drawable = NineSliceSprite.new()
-      drawable.texture = assets.assets.textures[comp.texture_asset]
+      drawable.texture = assets.use_asset("textures", comp.texture_asset, drawable)
       assets.used_assets[drawable] = comp.texture_asset
       drawable.size = Vector2i.new(comp.size[1], comp.size[2])
 
       local _, _, sl = M.load_sheet_data(comp.slice_sheet)
 
       drawable.texture_rect = sl["9slice"]
+   elseif comp.kind == "tile_layer" then
+      -- Already baked by the tilemap, just put it in place
+      drawable = comp.tile_layer
    else
       error("Unknown kind of drawable in " .. tostring(entity_name) .. "." .. tostring(comp_name))
    end
@@ -1,4 +1,3 @@
-local json = require("lunajson")
 local lume = require("lume")
 local path = require("path")
 
@@ -35,133 +34,92 @@ M.components = {
 function M.components.tilemap.process_component(new_ent, comp, entity_name)
    if not comp.tilemap then error("Tilemap path is not set in " .. entity_name) end
 
-   local map_file = io.open(comp.tilemap, "r")
-   local map = json.decode(map_file:read("*all"))
-   map_file:close()
+   local map = Tilemap.load(comp.tilemap)
 
-   -- Load the tileset image
-
-   local sets, paths_to_names = {}, {}
-   for _, tset_info in ipairs(map.tilesets) do
-      local tset_path = path.join(path.dirname(comp.tilemap), tset_info.source)
-
-      local set_file = io.open(tset_path, "r")
-      local set = json.decode(set_file:read("*all"))
-      set_file:close()
-      sets[set.name] = set
-      paths_to_names[tset_info.source] = set.name
-
-      local image_path = path.join(path.dirname(tset_path), set.image)
+   -- Load the tileset images into known assets
+   local image_names = {}
+   for n, set in ipairs(map.tilesets) do
       local image_name = path.splitext(set.image)
 
-      -- Load the texture into known assets
-      assets.add_to_known_assets("textures", image_name, image_path)
-      set.image = image_name
-      set.firstgid = tset_info.firstgid
+      assets.add_to_known_assets("textures", image_name, set.image_path)
+      image_names[n] = image_name
    end
 
-   local function gid_to_tile(tile)
-      local from_tileset
-      for _, set in lume.ripairs(map.tilesets) do
-         if set.firstgid <= tile then
-            tile = tile - set.firstgid
-
-            local tile_val = tile
-            tile = lume.match(sets[paths_to_names[set.source]].tiles, function(til) return til.id == tile end)
-            if tile == nil then
-               -- Tile has no special properties, so not in the tilemap
-               tile = { id = tile_val }
-            end
-            tile.tileset = paths_to_names[set.source]
-
-            break
-         end
-      end
-
-      return tile
+   local function frame_to_rect(frame)
+      return { x = frame.left, y = frame.top, w = frame.width, h = frame.height }
    end
 
-   local function tile_to_frame(tile)
-      local tset = sets[tile.tileset]
-
-      -- Width/Height of the tileset in tile number
-      local tset_w = tset.imagewidth / tset.tilewidth
-      local tset_h = tset.imageheight / tset.tileheight
-      -- Position in tileset
-      local ts_x = math.floor(tile.id % tset_w)
-      local ts_y = math.floor(tile.id / tset_w)
-
-      return { x = ts_x * tset.tilewidth, y = ts_y * tset.tileheight, w = tset.tilewidth, h = tset.tileheight }
-   end
-
-   local FLIPPED_HORIZONTALLY_FLAG = 0x80000000
-   local FLIPPED_VERTICALLY_FLAG = 0x40000000
-   local FLIPPED_DIAGONALLY_FLAG = 0x20000000
-   local ROTATED_HEXAGONAL_120_FLAG = 0x10000000
    for layer_n, layer in ipairs(map.layers) do
       if layer.type == "tilelayer" then
-         if layer.compression == "zlib" then
-            layer.data = decode_base64_and_decompress_zlib(layer.data, layer.width * layer.height)
+         -- Players move, so they can't be baked into the layer. Walls are baked and only keep the collider.
+         local unbaked_tiles = {}
+         for _, tile in ipairs(layer.typed_tiles) do
+            if tile.type == "Player" then unbaked_tiles[tile.gid] = true end
          end
 
-         for n, tile in ipairs(layer.data) do
-            -- 0 = no tile
-            if tile == 0 then
-               goto next
-            end
-
-            local flipped_horizontally = (tile & FLIPPED_HORIZONTALLY_FLAG) ~= 0
-            local flipped_vertically = (tile & FLIPPED_VERTICALLY_FLAG) ~= 0
-            local flipped_diagonally = (tile & FLIPPED_DIAGONALLY_FLAG) ~= 0
-            local rotated_hex120 = (tile & ROTATED_HEXAGONAL_120_FLAG) ~= 0
-            tile = tile & ~(FLIPPED_HORIZONTALLY_FLAG |
-                            FLIPPED_VERTICALLY_FLAG |
-                            FLIPPED_DIAGONALLY_FLAG |
-                            ROTATED_HEXAGONAL_120_FLAG)
-
-            tile = gid_to_tile(tile)
-
-            local tset = sets[tile.tileset]
-
-            local x = (n - 1) % layer.width
-            local y = math.floor((n - 1) / layer.width)
-            local w, h = tset.tilewidth, tset.tileheight
+         -- The tileset textures are only drawn from while baking, the layer draws its own chunks after that.
+         -- They're kept here until then, in case loading one of them evicts another from the cache
+         local tileset_textures = {}
+         local tile_layer = TileLayer.new(layer.width, layer.height, map.tile_width, map.tile_height)
+         for n, set in ipairs(map.tilesets) do
+            tileset_textures[n] = assets.assets.textures[image_names[n]]
+            tile_layer:add_tileset(
+               tileset_textures[n], set.first_gid, set.tile_width, set.tile_height,
+               set.columns, set.margin, set.spacing
+            )
+         end
+         tile_layer:bake(layer.data, unbaked_tiles)
+         tileset_textures = nil
+
+         util.entities_mod().instantiate_entity(
+            lume.format("tile_layer_{1}", {layer_n}),
+            {
+               drawable = { kind = "tile_layer", tile_layer = tile_layer, z = layer_n },
+               transformable = { position = { 0, 0 } }
+            }
+         )
 
-            local frame = tile_to_frame(tile)
+         -- Only typed tiles need entities, the rest is already in the baked layer
+         for _, tile in ipairs(layer.typed_tiles) do
+            local tset = map.tilesets[tile.tileset]
 
-            local scale = { 1, 1 }
-            if flipped_diagonally then
-               scale[1], scale[2] = scale[2], scale[1]
-            end
-            if flipped_horizontally then scale[1] = -scale[1] end
-            if flipped_vertically then scale[2] = -scale[2] end
+            local x, y = tile.x, tile.y
+            -- Tiles are positioned on the map grid, the tileset's tile size is only the size of the sprite
+            local grid_w, grid_h = map.tile_width, map.tile_height
+            local w, h = tset.tile_width, tset.tile_height
 
-            local tile_transformable = { position = { (w * x) + (w / 2), (h * y) + (h / 2) },
-                                         origin = {math.floor(w / 2), math.floor(h / 2)},
-                                         scale = scale }
-            local template = {
-               drawable = { kind = "sprite", texture_asset = sets[tile.tileset].image, texture_rect = frame, z = layer_n },
-               transformable = tile_transformable
-            }
-            -- Add a collider for walls
+            local template
             if tile.type == "Wall" then
-               template.collider = { mode = "constant", size = { tset.tilewidth, tset.tileheight } }
+               -- The wall is drawn by the layer, so it's only a collider
+               template = {
+                  transformable = { position = { grid_w * x, grid_h * y } },
+                  collider = { mode = "constant", size = { grid_w, grid_h } }
+               }
             elseif tile.type == "Player" then
-               template.tile_player = { footstep_sound_asset = "footstep" }
-               template.collider = { mode = "sprite" }
+               local scale = { 1, 1 }
+               if tile.flipped_diagonally then
+                  scale[1], scale[2] = scale[2], scale[1]
+               end
+               if tile.flipped_horizontally then scale[1] = -scale[1] end
+               if tile.flipped_vertically then scale[2] = -scale[2] end
+
+               template = {
+                  drawable = { kind = "sprite", texture_asset = image_names[tile.tileset], texture_rect = frame_to_rect(tile.frame), z = layer_n },
+                  -- Aligned to the bottom left corner of the cell, the same as the baked tiles
+                  transformable = { position = { (grid_w * x) + (w / 2), (grid_h * (y + 1)) - (h / 2) },
+                                    origin = {math.floor(w / 2), math.floor(h / 2)},
+                                    scale = scale },
+                  tile_player = { footstep_sound_asset = "footstep" },
+                  collider = { mode = "sprite" }
+               }
             end
-            util.entities_mod().instantiate_entity(lume.format("tile_{1}_{2}_{3}", {layer_n, x, y}), template)
 
-            ::next::
+            if template then
+               util.entities_mod().instantiate_entity(lume.format("tile_{1}_{2}_{3}", {layer_n, x, y}), template)
+            end
          end
       elseif layer.type == "objectgroup" then
          for n, obj in ipairs(layer.objects) do
-            local props = {}
-            for _, prop in ipairs(obj.properties) do
-               props[prop.name] = prop.value
-            end
-            obj.properties = props
-
             local template = {
                transformable = {
                   position = { obj.x, obj.y }
@@ -172,9 +130,8 @@ function M.components.tilemap.process_component(new_ent, comp, entity_name)
                template.collider = { mode = "constant", size = { obj.width, obj.height }, trigger = obj.properties.trigger }
             end
             if obj.gid then
-               local tile = gid_to_tile(obj.gid)
-               local frame = tile_to_frame(tile)
-               template.drawable = { kind = "sprite", texture_asset = sets[tile.tileset].image, texture_rect = frame, z = layer_n }
+               local tileset = map:tileset_of(obj.gid)
+               template.drawable = { kind = "sprite", texture_asset = image_names[tileset], texture_rect = frame_to_rect(map:frame_of(obj.gid)), z = layer_n }
                -- Adjust position, but why does this happen?
                template.transformable.position[2] = template.transformable.position[2] - obj.height
             end
@@ -324,9 +281,6 @@ M.interaction_callbacks.tilemap_talk = function(_state, args)
          text_drawable.enabled = true
 
          for _, phrase_data in ipairs(phrases) do
-            local letter = 1
-            local timer = 0
-
             if phrase_data.sound then
                local sound = assets.create_sound_from_asset(phrase_data.sound.asset)
                if phrase_data.sound.volume then
@@ -339,14 +293,9 @@ M.interaction_callbacks.tilemap_talk = function(_state, args)
             text_drawable.drawable.string = ""
 
             local phrase = phrase_data.text
-            while text_drawable.drawable.string ~= phrase do
-               if timer > talking_speed then
-                  text_drawable.drawable.string = phrase:sub(1, letter)
-                  letter = letter + 1
-                  timer = 0
-               end
-
-               timer = timer + coroutine.yield()
+            for letter = 1, #phrase do
+               coroutines.sleep(talking_speed)
+               text_drawable.drawable.string = phrase:sub(1, letter)
             end
 
             text_drawable.drawable.string = text_drawable.drawable.string ..
@@ -375,6 +324,8 @@ function M.interaction_callbacks.switch_room(_current_state, room)
    engine:stopSystem("TilePlayerSystem")
 
    local final_room_name = passage_components.get_final_room_name({ to = room })
+   -- Loads while the screen fades out
+   local requests = rooms.prefetch_room(final_room_name)
 
    coroutines.create_coroutine(
       coroutines.black_screen_out,
@@ -386,7 +337,8 @@ function M.interaction_callbacks.switch_room(_current_state, room)
       function()
          -- Enable the player back when the room has changed
          engine:startSystem("TilePlayerSystem")
-      end
+      end,
+      requests
    )
 end
 
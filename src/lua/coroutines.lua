@@ -1,89 +1,55 @@
-local lume = require("lume")
-
-local coroutines = {}
-
 local M = {}
 
-function M.create_coroutine(fnc, ...)
-   local cor = coroutine.create(fnc)
-
-   table.insert(
-      coroutines,
-      {
-         cor = cor,
-         started = false, args = {...},
-         wait = {}
-      }
-   )
+-- The coroutines are run by the native CoroutineScheduler, which only resumes the ones that aren't waiting.
+-- Every resume after the first one gets the time since the last frame.
 
-   return cor
+-- Makes a coroutine from the function and starts it with the arguments on the next run.
+-- If the coroutine yields a function, it waits until a coroutine made from that function
+-- (and the other yielded values as the arguments) finishes.
+function M.create_coroutine(fnc, ...)
+   return CoroutineScheduler.create(fnc, ...)
 end
 
-
 function M.abandon_coroutine(cor)
-   local _, n = lume.match(coroutines, function(c) return c.cor == cor end)
-
-   if n ~= nil and coroutine.status(coroutines[n].cor) ~= "dead" then
-      table.remove(coroutines, n)
-   end
+   CoroutineScheduler.abandon(cor)
 end
 
---- If there are something for the coroutine to wait on,
---- return true. Otherwise return false.
-local function need_to_wait(cor)
-   if cor.wait.coroutine then
-      if coroutine.status(cor.wait.coroutine) == "dead" then
-         cor.wait.coroutine = nil
-
-         return false
-      else
-         return true
-      end
-   end
+-- These can only be called from a coroutine made with create_coroutine
 
-   return false
+-- Waits until the other coroutine finishes (or is abandoned)
+function M.wait_for(cor)
+   CoroutineScheduler.wait_for(cor)
+   return coroutine.yield()
 end
 
-function M.run(dt)
-   local to_remove = { }
-   for n, cor in pairs(coroutines) do
-      if need_to_wait(cor) then goto continue end
-
-      local results
-      if not cor.started then
-         results = { coroutine.resume(cor.cor, table.unpack(cor.args)) }
-
-         cor.started = true
-      else
-         results = { coroutine.resume(cor.cor, dt) }
-      end
-
-      local was_ok, results = results[1], lume.slice(results, 2)
-
-      -- If there was an error, the only result will be the error message
-      if not was_ok then
-         local err = "Coroutine exited with \"" .. results[1] .. "\"\n  " .. debug.traceback(cor.cor) .. "\n\n"
-         error(err)
-      end
+-- Waits until the event is signaled
+function M.wait_event(name)
+   CoroutineScheduler.wait_event(name)
+   return coroutine.yield()
+end
 
-      -- If a function was returned, create a coroutine from it and add it as a
-      -- waiting condition, and pass it all the other arguments returned
-      if type(results[1]) == "function" then
-         cor.wait.coroutine = M.create_coroutine(results[1], table.unpack(lume.slice(results, 2)))
-      end
+-- Waits for the number of seconds, the coroutine isn't touched at all until then
+function M.sleep(seconds)
+   CoroutineScheduler.sleep(seconds)
+   return coroutine.yield()
+end
 
-      if coroutine.status(cor.cor) == "dead" then
-         table.insert(to_remove, n)
-      end
+-- Waits until the predicate returns true. It's checked every interval seconds, or every frame without an interval
+function M.wait_until(predicate, interval)
+   if predicate() then return end
 
-      ::continue::
-   end
+   CoroutineScheduler.wait_until(predicate, interval)
+   return coroutine.yield()
+end
 
-   -- Clean up the dead coroutines
-   lume.each(to_remove, function(n) table.remove(coroutines, n) end)
+-- Wakes up every coroutine waiting for the event
+function M.signal(name)
+   CoroutineScheduler.signal(name)
 end
 
-function M.black_screen_out(do_in, do_after)
+-- Fades the screen out, calls do_in at full black and fades back in, then calls do_after.
+-- If requests for assets are passed, the screen stays black until they're all loaded.
+function M.black_screen_out(do_in, do_after, requests)
    local screen_size = GLOBAL.drawing_target.size
    local black_rect = RectangleShape.new(
       Vector2f.new(screen_size.x, screen_size.y)
@@ -97,9 +63,17 @@ function M.black_screen_out(do_in, do_after)
 
       GLOBAL.drawing_target:draw(black_rect)
 
-      if color.a == 255 and do_in then
+      if color.a == 255 then
+         -- The assets were loading while fading out, keep the screen black for those that aren't done
+         for _, request in ipairs(requests or {}) do
+            while not request.done do
+               GLOBAL.drawing_target:draw(black_rect)
+               coroutine.yield()
+            end
+         end
+
          -- On the last iteration, do whatever requested in the end
-         do_in()
+         if do_in then do_in() end
       end
 
       coroutine.yield()
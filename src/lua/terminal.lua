@@ -232,6 +232,8 @@ M.current_lines_to_draw = {}
 local scroll_height_offset_subtract = 0
 
 local width_offset, height_offset, rect_height, rect_width, rect, terminal_view
+-- The scroll offset the terminal view was last moved by
+local terminal_view_scroll = 0
 
 local terminal_initialized = false
 function initialize_terminal()
@@ -256,6 +258,60 @@ function initialize_terminal()
    rect.position = Vector2f.new(width_offset, height_offset)
 end
 
+-- Retained layout of the texts on screen. Offsets are relative to the first line and only change
+-- when the set of lines, their heights or the terminal width change, scrolling only moves the view.
+local layout = { entries = {}, count = 0, total_height = 0, first_height = nil }
+
+local function layout_add_text(text, height)
+   layout.count = layout.count + 1
+
+   local entry = layout.entries[layout.count]
+   if not entry then
+      entry = {}
+      layout.entries[layout.count] = entry
+   end
+
+   if entry.text ~= text or entry.offset ~= layout.total_height then
+      entry.text = text
+      entry.offset = layout.total_height
+      entry.text.position = Vector2f.new(width_offset * 2, (height_offset * 2) + entry.offset)
+   end
+
+   layout.total_height = layout.total_height + height + (StaticFonts.font_size / 2)
+end
+
+local function update_layout()
+   layout.count = 0
+   layout.total_height = 0
+   layout.first_height = nil
+
+   for _, line in ipairs(M.current_lines_to_draw) do
+      local text = line:current_text()
+      if type(text) == "table" then
+         -- It's more than one line
+         for n, txt in ipairs(text) do
+            layout_add_text(txt, line:layout_line_height(n))
+         end
+         -- Add a bit more after the last line
+         layout.total_height = layout.total_height + StaticFonts.font_size / 2
+      elseif text ~= nil then
+         -- It's a single line of text
+         layout_add_text(text, line:layout_line_height())
+      end
+
+      -- Save the height of the first line to use it if there's a need to scroll,
+      -- so that the scrolling distance can be adjusted by this size after the line is deleted
+      if line == first_line_on_screen then
+         layout.first_height = layout.total_height
+      end
+   end
+
+   -- Forget the texts that are not on screen anymore
+   for n = layout.count + 1, #layout.entries do
+      layout.entries[n] = nil
+   end
+end
+
 function M.draw(dt)
    if not terminal_initialized then
       terminal_initialized = true
@@ -326,57 +382,25 @@ function M.draw(dt)
       GLOBAL.drawing_target:draw(lines.help_text)
    end
 
-   -- Offset for the first line to start at
+   -- Where the first line is on screen after scrolling
    local first_line_height_offset = (height_offset * 2) - scroll_height_offset_subtract
 
-   -- Actual offsets that will be used for line positioning
-   local line_width_offset, line_height_offset = width_offset * 2, first_line_height_offset
+   update_layout()
 
-   -- The total height of the text to compare it with the terminal rectangle
-   local total_text_height = 0
+   -- Scrolling moves the view down instead of moving every text up
+   if terminal_view_scroll ~= scroll_height_offset_subtract then
+      terminal_view:reset(FloatRect.new(
+         width_offset, height_offset + scroll_height_offset_subtract,
+         rect_width, rect_height
+      ))
+      terminal_view_scroll = scroll_height_offset_subtract
+   end
 
    GLOBAL.drawing_target.view = terminal_view
 
-   local first_height
-
-   -- Use the current lines and draw those
-   for _, line in pairs(M.current_lines_to_draw) do
-      local text = line:current_text()
-      if type(text) == "table" then
-         -- It's more than one line
-
-         for n, txt in pairs(text) do
-            txt.position = Vector2f.new(line_width_offset, line_height_offset)
-
-            local this_txt_height = line:max_line_height(n);
-
-            total_text_height = total_text_height + this_txt_height + (StaticFonts.font_size / 2)
-            line_height_offset = first_line_height_offset + total_text_height;
-
-            GLOBAL.drawing_target:draw(txt)
-         end
-         -- Add a bit more after the last line
-         total_text_height = total_text_height + StaticFonts.font_size / 2
-         line_height_offset = first_line_height_offset + total_text_height
-      elseif text == nil then
-         -- Line doesn't output anything, just do nothing
-      else
-         -- It's a single line of text
-
-         text.position = Vector2f.new(line_width_offset, line_height_offset)
-
-         local line_height = line:max_line_height()
-         total_text_height = total_text_height + line_height + (StaticFonts.font_size / 2)
-         line_height_offset = first_line_height_offset + total_text_height
-
-         GLOBAL.drawing_target:draw(text)
-      end
-
-      -- Save the height of the first line to use it if there's a need to scroll,
-      -- so that the scrolling distance can be adjusted by this size after the line is deleted
-      if line == first_line_on_screen then
-         first_height = total_text_height
-      end
+   -- Replay the cached layout, the texts only move when the layout changed
+   for n = 1, layout.count do
+      GLOBAL.drawing_target:draw(layout.entries[n].text)
    end
 
    GLOBAL.drawing_target.view = GLOBAL.drawing_target.default_view
@@ -388,31 +412,17 @@ function M.draw(dt)
       offset. This repeats every frame until all the lines are visible.
    ]]
    local scroll_step = 5
-   if total_text_height > rect_height - (height_offset * 2) then
-      local function top(line)
-         local text = line:current_text()
-
-         if type(text) == "table" then
-            -- Return the first one's top
-            return text[1].global_bounds.top
-         elseif text == nil then
-            -- Try getting the size of the next line instead
-            return top(line:next())
-         else
-            -- It's a single line of text
-            return text.global_bounds.top
-         end
-      end
-
+   if layout.total_height > rect_height - (height_offset * 2) then
+      -- The second line starts right where the first one ends
       local second = first_line_on_screen:next()
-      local second_pos = top(second)
+      local second_pos = first_line_height_offset + layout.first_height
 
       if second_pos + scroll_step > height_offset * 2 then
          scroll_height_offset_subtract = scroll_height_offset_subtract + scroll_step
       else
          first_line_on_screen = second
 
-         scroll_height_offset_subtract = scroll_height_offset_subtract - first_height
+         scroll_height_offset_subtract = scroll_height_offset_subtract - layout.first_height
       end
    end
 
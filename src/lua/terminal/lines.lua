@@ -13,15 +13,16 @@ local M = {
 }
 
 local render_env
-local function insert_variables(name, str)
-   local compiled = liluat.compile(
-      str,
-      {
-         start_tag = "<",
-         end_tag = ">"
-      },
-      name
-   )
+-- Templates with code in them compiled by liluat, by their source, since the same text is shown many times
+local compiled_templates = {}
+-- Renders a native TextTemplate (which split the text into the parts and the <...> tags when the line was parsed)
+local function insert_variables(name, template)
+   local kind = template.kind
+
+   -- Most of the text has no variables at all
+   if kind == TextTemplateKind.Plain then
+      return template.source
+   end
 
    if WalkingModule and not render_env then
       render_env = lume.merge(
@@ -32,25 +33,31 @@ local function insert_variables(name, str)
       )
    end
 
+   if kind == TextTemplateKind.Substitutions then
+      return template:render(render_env or {}, name)
+   end
+
+   local source = template.source
+   local compiled = compiled_templates[source]
+   if not compiled then
+      compiled = liluat.compile(
+         source,
+         {
+            start_tag = "<",
+            end_tag = ">"
+         },
+         name
+      )
+      compiled_templates[source] = compiled
+   end
+
    -- Just reference the whole environment
    return liluat.render(compiled, render_env, { reference = true })
 end
 
--- Text object used for max_string_height calculation
-local max_string_height_text
-
+-- Measured natively from glyph metrics, recently measured strings are cached
 function M.max_string_height(str, font_size)
-   local term_width = M.max_text_width()
-   local fit_str = lume.wordwrap(str, term_width)
-
-   if not max_string_height_text then
-      max_string_height_text = Text.new(fit_str, StaticFonts.main_font, font_size)
-   else
-      max_string_height_text.string = fit_str
-      max_string_height_text.character_size = font_size
-   end
-
-   return max_string_height_text.global_bounds.height
+   return StaticFonts.main_font:measure(str, font_size, M.max_text_width()).y
 end
 
 -- Cache data for max_text_width
@@ -101,6 +108,31 @@ function M.TerminalLine:initialize()
    self._script_after_executed = false
 end
 
+-- Whether the line heights only depend on the terminal width, so they only need to be measured once per width
+M.TerminalLine.static_layout = false
+
+-- Height of the line (or of the n-th text of it) for the terminal layout
+function M.TerminalLine:layout_line_height(n)
+   if not self.static_layout then
+      return self:max_line_height(n)
+   end
+
+   local width = M.max_text_width()
+   if self._layout_width ~= width then
+      self._layout_width = width
+      self._layout_heights = {}
+   end
+
+   local key = n or 0
+   local height = self._layout_heights[key]
+   if not height then
+      height = self:max_line_height(n)
+      self._layout_heights[key] = height
+   end
+
+   return height
+end
+
 function M.TerminalLine:tick_letter_timer(dt)
    self._time_since_last_letter = self._time_since_last_letter + dt
 end
@@ -124,19 +156,19 @@ function M.TerminalLine:fields_to_save()
 end
 
 M.OutputLine = class("OutputLine", M.TerminalLine)
-function M.OutputLine:initialize(text, next_line_name)
+M.OutputLine.static_layout = true
+function M.OutputLine:initialize(text_template, next_line_name)
    M.OutputLine.super.initialize(self)
 
-   self._text = insert_variables(name, text)
+   self._text = insert_variables(self._name, text_template)
    -- The name of the next line to be retreived and instantiated by next()
    self._next_line_name = next_line_name
    -- A place to store the next line instance when it's needed
    self._next_line = nil
 
-   self._text_object = Text.new("", StaticFonts.main_font, StaticFonts.font_size)
-
+   -- The whole text is laid out once and then revealed letter by letter
+   self._text_object = ProgressiveText.new(self._text, StaticFonts.main_font, self._character.font_size)
    self._text_object.fill_color = self._character.color
-   self._text_object.character_size = self._character.font_size
 end
 
 function M.OutputLine:max_line_height()
@@ -162,13 +194,9 @@ end
 function M.OutputLine:current_text()
    local txt = self._text_object
 
-   if #txt.string ~= self._letters_output then
-      local substr = lume.wordwrap(
-         self._text:sub(0, self._letters_output),
-         M.max_text_width()
-      )
-      txt.string = substr
-   end
+   -- Only re-wraps when the width actually changes, revealing letters doesn't touch the layout
+   txt.wrap_width = M.max_text_width()
+   txt.visible_length = self._letters_output
 
    return txt
 end
@@ -200,8 +228,8 @@ function M.OutputLine:handle_interaction(event)
 end
 
 M.InputWaitLine = class("InputWaitLine", M.OutputLine)
-function M.InputWaitLine:initialize(text, next_line)
-   M.InputWaitLine.super.initialize(self, text, next_line)
+function M.InputWaitLine:initialize(text_template, next_line)
+   M.InputWaitLine.super.initialize(self, text_template, next_line)
 
    self._1_pressed = false
 end
@@ -262,6 +290,7 @@ function M.InputWaitLine:fields_to_save()
 end
 
 M.VariantInputLine = class("VariantInputLine", M.TerminalLine)
+M.VariantInputLine.static_layout = true
 function M.VariantInputLine:initialize(variants)
    M.VariantInputLine.super.initialize(self)
 
@@ -295,15 +324,14 @@ function M.VariantInputLine:initialize(variants)
       -- Add the variant number before the text
       local formatted_text = lume.format(
          "{num}.  {text}",
-         { num = var_num, text = insert_variables(name, var.text) }
+         { num = var_num, text = insert_variables(self._name, var.text_template) }
       )
       local inserted_variant = {
          text = formatted_text,
-         text_object = Text.new("", StaticFonts.main_font, StaticFonts.font_size),
+         text_object = ProgressiveText.new(formatted_text, StaticFonts.main_font, self._character.font_size),
          next = var.next,
       }
       inserted_variant.text_object.fill_color = self._character.color
-      inserted_variant.text_object.character_size = self._character.font_size
 
       table.insert(self._variants, inserted_variant)
 
@@ -341,17 +369,12 @@ end
 function M.VariantInputLine:current_text()
    local max_width = M.max_text_width()
 
-   local longest_var_done = #self._variants[self._longest_var_n].text_object.string == self._letters_output
-
    -- Form the result from the variants
    local result = {}
    for n, var in ipairs(self._variants) do
       local txt = var.text_object
-      -- If the longest variant hasn't been fully output yet, keep updaing
-      if not longest_var_done then
-         local substr = lume.wordwrap(var.text:sub(0, self._letters_output), max_width)
-         txt.string = substr
-      end
+      txt.wrap_width = max_width
+      txt.visible_length = self._letters_output
 
       table.insert(result, txt)
    end
@@ -403,14 +426,16 @@ function M.VariantInputLine:fields_to_save()
 end
 
 M.TextInputLine = class("TextInputLine", M.TerminalLine)
-function M.TextInputLine:initialize(before, after, variable, max_length, filters, nxt)
+-- The height is measured with the input text being as long as possible
+M.TextInputLine.static_layout = true
+function M.TextInputLine:initialize(before_template, after_template, variable, max_length, filters, nxt)
    M.TextInputLine.super.initialize(self)
 
    self._next = nxt
    self._next_line = nil
 
-   self._before = insert_variables(name, before)
-   self._after = insert_variables(name, after)
+   self._before = insert_variables(self._name, before_template)
+   self._after = insert_variables(self._name, after_template)
    self._variable = variable
    self._max_length = max_length
    self._filters = filters
@@ -457,9 +482,9 @@ function M.TextInputLine:current_text()
             str = str .. "_"
          end
 
-         substr = lume.wordwrap(str, M.max_text_width())
+         substr = StaticFonts.main_font:wrap(str, M.max_text_width())
       else
-         substr = lume.wordwrap(
+         substr = StaticFonts.main_font:wrap(
             (self._before .. self._input_text .. self._after):sub(0, self._letters_output),
             M.max_text_width()
          )
@@ -564,13 +589,13 @@ function M.make_line(name, line_source)
    local to_insert = M.TerminalLine:allocate(name, line.character_config, line_source)
 
    if tp == "TerminalOutputLineData" then
-      to_insert = M.OutputLine:newFromAllocated(to_insert, line.text, line.next)
+      to_insert = M.OutputLine:newFromAllocated(to_insert, line.text_template, line.next)
    elseif tp == "TerminalInputWaitLineData" then
-      to_insert = M.InputWaitLine:newFromAllocated(to_insert, line.text, line.next)
+      to_insert = M.InputWaitLine:newFromAllocated(to_insert, line.text_template, line.next)
    elseif tp == "TerminalVariantInputLineData" then
       to_insert = M.VariantInputLine:newFromAllocated(to_insert, line.variants)
    elseif tp == "TerminalTextInputLineData" then
-      to_insert = M.TextInputLine:newFromAllocated(to_insert, line.before, line.after, line.variable, line.max_length, line.filters, line.next)
+      to_insert = M.TextInputLine:newFromAllocated(to_insert, line.before_template, line.after_template, line.variable, line.max_length, line.filters, line.next)
    elseif tp == "TerminalCustomLineData" then
       to_insert = line.class:newFromAllocated(to_insert, line.data)
    else
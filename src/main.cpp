@@ -18,6 +18,9 @@
 #include "fonts.hpp"
 #include "story_parser.hpp"
 #include "usertypes.hpp"
+#include "profiler.hpp"
+#include "asset_loader.hpp"
+#include "asset_cache.hpp"
 
 #include "terminal.hpp"
 #include "walking.hpp"
@@ -67,6 +70,9 @@ const std::vector<sf::Vector2u> window_sizes = {
 void main_loop(void *ctx_) {
     auto &ctx = *(MainLoopContext *)ctx_;
 
+    auto &profiler = someone::Profiler::instance();
+    profiler.begin_frame();
+
     auto dt_time = ctx.clock.restart();
     auto dt = dt_time.asSeconds();
 
@@ -80,8 +86,9 @@ void main_loop(void *ctx_) {
     }
     ctx.target.clear(clear_color);
 
+    profiler.begin("Events");
     sf::Event event;
-    while (ctx.window.pollEvent(event)) {
+    while (!ctx.should_exit && ctx.window.pollEvent(event)) {
 #ifdef SOMEONE_APPLE
         // Track keyboard manually
         someone::KeypressTracker::processEvent(event);
@@ -92,7 +99,7 @@ void main_loop(void *ctx_) {
             ctx.window.close();
             ctx.should_exit = true;
 
-            return;
+            continue;
         case sf::Event::KeyReleased: {
             switch (event.key.code) {
             case sf::Keyboard::Tilde:
@@ -133,27 +140,45 @@ void main_loop(void *ctx_) {
             ImGui_ImplSDL2_ProcessEvent(&event.sdlEvent);
         }
     }
+    profiler.end();
+
+    // The window is closed, but the frame is still recorded
+    if (ctx.should_exit) {
+        profiler.end_frame();
+        return;
+    }
 
     ctx.window.clear();
 
     switch (ctx.current_state) {
     case CurrentState::Terminal:
+        profiler.begin("Terminal");
         ctx.terminal_env.update_event_timer(dt);
         ctx.terminal_env.draw(dt);
+        profiler.end();
 
         // Don't draw to the screen yet, will be drawn after coroutines run
 
         break;
     case CurrentState::Walking:
+        profiler.begin("Walking update");
         ctx.walking_env.update(dt);
+        profiler.end();
 
         // Run all the drawing in lua and then draw it to the screen
+        profiler.begin("Walking draw");
         ctx.walking_env.draw();
+        profiler.end();
+
+        profiler.begin("Shaders");
         ctx.walking_env.draw_target_to_window(ctx.window, ctx.target);
+        profiler.end();
 
         // Now clear the target and draw the overlay
+        profiler.begin("Overlay");
         ctx.target.clear(sf::Color::Transparent);
         ctx.walking_env.draw_overlay();
+        profiler.end();
 
         // Don't draw yet, wait for coroutines to run,
         // then everything will be drawn
@@ -161,8 +186,13 @@ void main_loop(void *ctx_) {
         break;
     }
 
+    // Upload what was loaded in the background, so the coroutines waiting for it see it this frame
+    someone::AssetLoader::instance().update();
+
     // After everything has been drawn and processed, run the coroutines
+    profiler.begin("Coroutines");
     ctx.coroutines_env.run(dt);
+    profiler.end();
 
     if (ctx.current_state == CurrentState::Walking) {
         // Clear the event store as the very last thing, after the coroutines run
@@ -170,11 +200,15 @@ void main_loop(void *ctx_) {
     }
 
     // Draw what hasn't been drawn yet
+    profiler.begin("Present");
     ctx.window.draw(ctx.target);
 
     ctx.target.display();
+    profiler.end();
 
     if (ctx.debug_menu) {
+        someone::Profiler::Scope scope("Debug menu");
+
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplSDL2_NewFrame();
         ImGui::NewFrame();
@@ -190,13 +224,20 @@ void main_loop(void *ctx_) {
             break;
         }
 
+        profiler.debug_menu();
+        someone::AssetCache::instance().debug_menu();
+
         ImGui::End();
 
         ImGui::Render();
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
     }
 
+    profiler.begin("Display");
     ctx.window.display();
+    profiler.end();
+
+    profiler.end_frame();
 }
 
 int main(int argc, char **argv) {
@@ -206,6 +247,7 @@ int main(int argc, char **argv) {
 
     args::HelpFlag help(arg_parser, "help", "Display this help message", {'h', "help"});
     args::ValueFlag<std::string> load_mod(arg_parser, "mod name", "Start a mod instead of the main game", {'l', "load-mod"});
+    args::ValueFlag<std::string> trace(arg_parser, "file", "Write every frame to a Chrome trace file", {"trace"});
     try {
         arg_parser.ParseCLI(argc, argv);
     } catch (const args::Help&) {
@@ -218,6 +260,10 @@ int main(int argc, char **argv) {
         return 1;
     }
 
+    // The path is relative to where the program was started, so resolve it before changing the cwd
+    if (trace)
+        someone::Profiler::instance().start_trace(std::filesystem::absolute(args::get(trace)).string());
+
     // Change cwd to where the program is
     std::filesystem::current_path(std::filesystem::path(argv[0]).parent_path());
 
@@ -235,6 +281,14 @@ int main(int argc, char **argv) {
 
     const auto &default_size = window_sizes[current_window_size];
     sf::RenderWindow window(sf::VideoMode(default_size.x, default_size.y), "Someone");
+    // Cached textures and decoded assets that were never uploaded are freed before the window shuts SDL down,
+    // on every way out of main, instead of from static destructors
+    struct AssetCleaner {
+        ~AssetCleaner() {
+            someone::AssetLoader::instance().shutdown();
+            someone::AssetCache::instance().clear();
+        }
+    } asset_cleaner;
 
     ImGui::CreateContext();
     ImGuiIO& io = ImGui::GetIO();
@@ -374,6 +428,8 @@ int main(int argc, char **argv) {
     emscripten_set_main_loop_arg(&main_loop, &context, 0, true);
 #endif
 
+    someone::Profiler::instance().finish_trace();
+
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplSDL2_Shutdown();
     ImGui::DestroyContext();
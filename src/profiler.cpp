@@ -0,0 +1,186 @@
+#include <fstream>
+#include <algorithm>
+
+#include "imgui.h"
+#include "fmt/format.h"
+
+#include "profiler.hpp"
+#include "logger.hpp"
+
+namespace someone {
+
+namespace {
+
+std::string escape_json(const std::string &str) {
+    std::string result;
+    result.reserve(str.size());
+
+    for (char ch : str) {
+        switch (ch) {
+        case '"': result += "\\\""; break;
+        case '\\': result += "\\\\"; break;
+        case '\n': result += "\\n"; break;
+        default:
+            if ((unsigned char)ch < 0x20)
+                result += fmt::format("\\u{:04x}", (int)ch);
+            else
+                result += ch;
+        }
+    }
+
+    return result;
+}
+
+// State of the debug menu view
+bool paused = false;
+int selected_frame = -1;
+
+}
+
+void Profiler::write_trace_events(std::ostream &out, const Frame &frame, bool &empty) const {
+    auto separator = [&] {
+        if (!empty)
+            out << ",\n";
+        empty = false;
+    };
+
+    // Timestamps in the trace format are in microseconds
+    separator();
+    out << fmt::format(
+        R"({{"name":"Frame","ph":"X","pid":1,"tid":1,"ts":{:.3f},"dur":{:.3f}}})",
+        frame.start_ns / 1000.0, frame.duration_ns / 1000.0
+    );
+
+    for (const auto &event : frame.events) {
+        separator();
+        out << fmt::format(
+            R"({{"name":"{}","ph":"X","pid":1,"tid":1,"ts":{:.3f},"dur":{:.3f}}})",
+            escape_json(names[event.name]),
+            (frame.start_ns + event.start_ns) / 1000.0, event.duration_ns / 1000.0
+        );
+    }
+
+    for (size_t counter = 0; counter < (size_t)Counter::Count; counter++) {
+        separator();
+        out << fmt::format(
+            R"({{"name":"{}","ph":"C","pid":1,"tid":1,"ts":{:.3f},"args":{{"count":{}}}}})",
+            counter_name((Counter)counter), frame.start_ns / 1000.0, frame.counters[counter]
+        );
+    }
+}
+
+bool Profiler::export_chrome_trace(const std::string &path) const {
+    std::ofstream file(path);
+    if (!file.good()) {
+        spdlog::error("Couldn't open {} to write the trace", path);
+        return false;
+    }
+
+    file << "{\"traceEvents\":[\n";
+    bool empty = true;
+    for (const auto &frame : frames)
+        write_trace_events(file, frame, empty);
+    file << "\n]}\n";
+
+    return true;
+}
+
+bool Profiler::start_trace(const std::string &path) {
+    finish_trace();
+
+    trace_file.open(path);
+    if (!trace_file.good()) {
+        spdlog::error("Couldn't open {} to write the trace", path);
+        trace_file.close();
+
+        return false;
+    }
+
+    trace_file << "{\"traceEvents\":[\n";
+    trace_empty = true;
+
+    return true;
+}
+
+void Profiler::finish_trace() {
+    if (!trace_file.is_open())
+        return;
+
+    trace_file << "\n]}\n";
+    trace_file.close();
+}
+
+void Profiler::debug_menu() {
+    if (!ImGui::CollapsingHeader("Profiler"))
+        return;
+
+    if (frames.empty()) {
+        ImGui::Text("No frames recorded yet");
+        return;
+    }
+
+    ImGui::Checkbox("Pause", &paused);
+    ImGui::SameLine();
+    if (ImGui::Button("Export Chrome trace")) {
+        if (export_chrome_trace("trace.json"))
+            spdlog::info("Trace of {} frames written to trace.json", frames.size());
+    }
+
+    // Frame times of the most recent frames, clicking on one selects it
+    std::vector<float> frame_times;
+    size_t shown = std::min(frames.size(), kept_frames);
+    for (size_t i = frames.size() - shown; i < frames.size(); i++)
+        frame_times.push_back(frames[i].duration_ns / 1e6);
+
+    if (!paused || selected_frame < 0 || selected_frame >= (int)shown)
+        selected_frame = shown - 1;
+
+    auto max_time = *std::max_element(frame_times.begin(), frame_times.end());
+    ImGui::PlotHistogram(
+        "##frame_times", frame_times.data(), frame_times.size(), 0,
+        fmt::format("Frame {:.2f} ms, max {:.2f} ms", frame_times[selected_frame], max_time).c_str(),
+        0, std::max(max_time, 1000.0f / 60.0f), ImVec2(500, 60)
+    );
+    if (paused && ImGui::IsItemClicked()) {
+        auto min = ImGui::GetItemRectMin(), size = ImGui::GetItemRectSize();
+        selected_frame = std::clamp(
+            (int)((ImGui::GetMousePos().x - min.x) / size.x * shown), 0, (int)shown - 1
+        );
+    }
+
+    const auto &frame = frames[frames.size() - shown + selected_frame];
+
+    for (size_t counter = 0; counter < (size_t)Counter::Count; counter++)
+        ImGui::Text("%s: %u", counter_name((Counter)counter), frame.counters[counter]);
+
+    // Flame view: every scope is a bar under the scope that contains it
+    const float width = 500, row_height = 18;
+    uint32_t max_depth = 0;
+    for (auto &event : frame.events)
+        max_depth = std::max(max_depth, event.depth);
+
+    auto origin = ImGui::GetCursorScreenPos();
+    auto draw_list = ImGui::GetWindowDrawList();
+    ImGui::InvisibleButton("##flame", ImVec2(width, (max_depth + 1) * row_height));
+
+    double ns_per_pixel = std::max<double>(frame.duration_ns, 1) / width;
+    for (auto &event : frame.events) {
+        ImVec2 from(origin.x + event.start_ns / ns_per_pixel, origin.y + event.depth * row_height);
+        ImVec2 to(from.x + std::max(event.duration_ns / ns_per_pixel, 1.0), from.y + row_height - 1);
+
+        // Same scope always has the same color
+        auto hue = (event.name * 0.61803f) - (int)(event.name * 0.61803f);
+        auto color = ImColor::HSV(hue, 0.5f, 0.8f);
+        draw_list->AddRectFilled(from, to, color);
+
+        auto &name = names[event.name];
+        auto text_size = ImGui::CalcTextSize(name.c_str());
+        if (text_size.x < to.x - from.x - 4)
+            draw_list->AddText(ImVec2(from.x + 2, from.y + 1), IM_COL32(0, 0, 0, 255), name.c_str());
+
+        if (ImGui::IsMouseHoveringRect(from, to))
+            ImGui::SetTooltip("%s: %.3f ms", name.c_str(), event.duration_ns / 1e6);
+    }
+}
+
+}
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <array>
+#include <deque>
+#include <string>
+#include <fstream>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <unordered_map>
+
+namespace someone {
+
+/** Records how long each part of a frame takes, as nested scopes, plus some per-frame counters.
+ *
+ *  The last few seconds of frames are kept for the debug menu. When tracing, every frame is also written
+ *  to a Chrome trace file as it ends, so long sessions don't keep all of them in memory.
+ */
+class Profiler {
+public:
+    enum class Counter {
+        TextRasterizations,
+        TextureUploads,
+        GPUFlushes,
+
+        Count
+    };
+
+    struct Event {
+        uint32_t name;
+        uint32_t depth;
+        // Relative to the frame start
+        uint64_t start_ns, duration_ns = 0;
+    };
+
+    struct Frame {
+        uint64_t start_ns, duration_ns = 0;
+        std::vector<Event> events;
+        std::array<uint32_t, (size_t)Counter::Count> counters {};
+    };
+
+    class Scope {
+    public:
+        Scope(const char *name) { Profiler::instance().begin(name); }
+        ~Scope() { Profiler::instance().end(); }
+
+        Scope(const Scope &) = delete;
+        void operator=(const Scope &) = delete;
+    };
+
+    // About five seconds at 60 fps
+    static constexpr size_t kept_frames = 300;
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    clock::time_point start_time = clock::now();
+
+    std::vector<std::string> names;
+    std::unordered_map<std::string, uint32_t> name_ids;
+    // Scopes in C++ use string literals, so they can be found by the pointer without making a string every time
+    std::unordered_map<const char *, uint32_t> literal_name_ids;
+
+    std::deque<Frame> frames;
+    Frame current;
+    bool in_frame = false;
+
+    // Indices of the events that haven't ended yet
+    std::vector<size_t> open_events;
+
+    std::ofstream trace_file;
+    bool trace_empty = true;
+
+    Profiler() = default;
+
+    uint64_t now_ns() const {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start_time).count();
+    }
+
+    uint32_t intern(const std::string &name) {
+        auto found = name_ids.find(name);
+        if (found != name_ids.end())
+            return found->second;
+
+        uint32_t id = names.size();
+        names.push_back(name);
+        name_ids.emplace(name, id);
+
+        return id;
+    }
+
+public:
+    // A trace that's still being written is finished, so it's valid JSON even if main didn't finish it
+    ~Profiler() { finish_trace(); }
+
+    static Profiler &instance() {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    void begin_frame() {
+        current = Frame { now_ns() };
+        open_events.clear();
+        in_frame = true;
+    }
+
+    void end_frame() {
+        if (!in_frame)
+            return;
+
+        auto end = now_ns();
+        // Close whatever was left open, e.g. when an error was thrown in a scope
+        while (!open_events.empty())
+            end_scope_at(end);
+
+        current.duration_ns = end - current.start_ns;
+        if (trace_file.is_open())
+            write_trace_events(trace_file, current, trace_empty);
+
+        frames.push_back(std::move(current));
+        if (frames.size() > kept_frames)
+            frames.pop_front();
+
+        in_frame = false;
+    }
+
+    void begin(const std::string &name) {
+        if (!in_frame)
+            return;
+
+        begin_with_id(intern(name));
+    }
+
+    void begin(const char *literal_name) {
+        if (!in_frame)
+            return;
+
+        auto found = literal_name_ids.find(literal_name);
+        if (found == literal_name_ids.end())
+            found = literal_name_ids.emplace(literal_name, intern(literal_name)).first;
+
+        begin_with_id(found->second);
+    }
+
+    void end() {
+        if (!in_frame || open_events.empty())
+            return;
+
+        end_scope_at(now_ns());
+    }
+
+    void count(Counter counter, uint32_t amount = 1) {
+        current.counters[(size_t)counter] += amount;
+    }
+
+    /** Writes every frame from now on to a Chrome trace at the path, until finish_trace is called. */
+    bool start_trace(const std::string &path);
+    void finish_trace();
+    bool is_tracing() const { return trace_file.is_open(); }
+
+    const std::deque<Frame> &get_frames() const { return frames; }
+    const std::string &name_of(uint32_t id) const { return names[id]; }
+
+    static const char *counter_name(Counter counter) {
+        switch (counter) {
+        case Counter::TextRasterizations: return "Text rasterizations";
+        case Counter::TextureUploads: return "Texture uploads";
+        case Counter::GPUFlushes: return "GPU flushes";
+        default: return "";
+        }
+    }
+
+    /** Writes the kept frames in the Chrome trace event format, which can be opened in chrome://tracing or Perfetto. */
+    bool export_chrome_trace(const std::string &path) const;
+
+    /** Frame time graph and a flame view of a frame, shown in the debug menu. */
+    void debug_menu();
+
+private:
+    /** Writes the frame's events as trace JSON, with a separator before them unless the trace is empty. */
+    void write_trace_events(std::ostream &out, const Frame &frame, bool &empty) const;
+
+    void begin_with_id(uint32_t name) {
+        current.events.push_back(Event { name, (uint32_t)open_events.size(), now_ns() - current.start_ns });
+        open_events.push_back(current.events.size() - 1);
+    }
+
+    void end_scope_at(uint64_t end) {
+        auto &event = current.events[open_events.back()];
+        event.duration_ns = end - current.start_ns - event.start_ns;
+
+        open_events.pop_back();
+    }
+};
+
+}
@@ -0,0 +1,163 @@
+#include <fstream>
+#include <cstring>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "fmt/format.h"
+
+#include "raw_image.hpp"
+#include "logger.hpp"
+
+RawImage::RawImage(const std::filesystem::path &path) {
+#ifndef _WIN32
+    if (int fd = open(path.c_str(), O_RDONLY); fd >= 0) {
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0) {
+            void *mapped = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped != MAP_FAILED) {
+                mapping = mapped;
+                mapping_size = file_stat.st_size;
+
+                data = (const uint8_t *)mapping;
+                data_size = mapping_size;
+            }
+        }
+        close(fd);
+    }
+#endif
+
+    if (!mapping) {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file.good())
+            throw std::runtime_error(fmt::format("Couldn't open the raw image {}", path.string()));
+
+        size_t size = file.tellg();
+        file.seekg(0);
+
+        contents.resize(size);
+        file.read((char *)contents.data(), contents.size());
+
+        data = contents.data();
+        data_size = contents.size();
+    }
+
+    try {
+        if (data_size < sizeof(Header))
+            throw std::runtime_error("file is too small");
+
+        std::memcpy(&header, data, sizeof(Header));
+
+        if (header.magic != magic)
+            throw std::runtime_error("not a raw image");
+        if (header.version != version)
+            throw std::runtime_error(fmt::format("version {} is not supported, expected {}", header.version, version));
+        if (header.width == 0 || header.height == 0
+            || data_size - sizeof(Header) != (uint64_t)header.width * header.height * 4)
+            throw std::runtime_error("file is truncated");
+    } catch (const std::runtime_error &e) {
+#ifndef _WIN32
+        if (mapping)
+            munmap(mapping, mapping_size);
+#endif
+
+        throw std::runtime_error(fmt::format("Invalid raw image {}: {}", path.string(), e.what()));
+    }
+}
+
+RawImage::~RawImage() {
+#ifndef _WIN32
+    if (mapping)
+        munmap(mapping, mapping_size);
+#endif
+}
+
+SDL_Surface *RawImage::surface() const {
+    // SDL doesn't write to surfaces it only reads from, so the read-only mapping can be used directly
+    return SDL_CreateRGBSurfaceWithFormatFrom(
+        (void *)(data + sizeof(Header)), header.width, header.height, 32, header.width * 4, SDL_PIXELFORMAT_RGBA32
+    );
+}
+
+std::filesystem::path RawImage::path_for(const std::filesystem::path &image_path) {
+    return std::filesystem::path(image_path).replace_extension(".rgba");
+}
+
+std::unique_ptr<RawImage> RawImage::find(const std::filesystem::path &image_path) {
+    auto raw_path = path_for(image_path);
+
+    std::error_code error;
+    if (!std::filesystem::exists(raw_path, error))
+        return nullptr;
+
+    try {
+        auto raw = std::make_unique<RawImage>(raw_path);
+
+        // The raw image is still used if it's shipped without the source image
+        auto source_size = std::filesystem::file_size(image_path, error);
+        if (error)
+            return raw;
+
+        // The size is checked first, so that most changes are noticed without reading the source
+        if (source_size != raw->header.source_size || hash_file(image_path) != raw->header.source_hash) {
+            spdlog::debug("Not using {}, {} changed after it was made", raw_path.string(), image_path.string());
+            return nullptr;
+        }
+
+        return raw;
+    } catch (const std::runtime_error &e) {
+        spdlog::warn("{}", e.what());
+
+        return nullptr;
+    }
+}
+
+std::optional<uint64_t> RawImage::hash_file(const std::filesystem::path &path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.good())
+        return std::nullopt;
+
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325;
+    char buffer[64 * 1024];
+    while (file.read(buffer, sizeof(buffer)) || file.gcount() > 0) {
+        for (std::streamsize i = 0; i < file.gcount(); i++) {
+            hash ^= (uint8_t)buffer[i];
+            hash *= 0x100000001b3;
+        }
+    }
+
+    return hash;
+}
+
+void RawImage::write(const std::filesystem::path &path, SDL_Surface *surface, const std::filesystem::path &source_path) {
+    auto source_hash = hash_file(source_path);
+    if (!source_hash)
+        throw std::runtime_error(fmt::format("Couldn't read {}", source_path.string()));
+    auto source_size = std::filesystem::file_size(source_path);
+
+    std::unique_ptr<SDL_Surface, decltype(&SDL_FreeSurface)> converted(
+        SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_RGBA32, 0), SDL_FreeSurface
+    );
+    if (!converted)
+        throw std::runtime_error(fmt::format("Couldn't convert {} to RGBA: {}", path.string(), SDL_GetError()));
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file.good())
+        throw std::runtime_error(fmt::format("Couldn't open {} for writing", path.string()));
+
+    Header header { magic, version, (uint32_t)converted->w, (uint32_t)converted->h, source_size, *source_hash };
+    file.write((const char *)&header, sizeof(header));
+
+    // Rows of the converted surface can be padded, the file has them without padding
+    for (int y = 0; y < converted->h; y++)
+        file.write((const char *)converted->pixels + (size_t)y * converted->pitch, (size_t)converted->w * 4);
+
+    if (!file.good())
+        throw std::runtime_error(fmt::format("Couldn't write {}", path.string()));
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <optional>
+#include <cstdint>
+#include <filesystem>
+
+#include "SDL.h"
+
+/** An image stored as uncompressed RGBA pixels, made offline by the texture compiler next to the image
+ *  it's made from, so that large images are uploaded without decoding them.
+ *
+ *  The file is a header followed by the rows of pixels, with straight alpha the same as decoded images.
+ *  It is memory mapped when loaded. The size and a hash of the source image's contents are kept in the header
+ *  to notice when the source changed after the raw image was made, file times aren't kept when resources are copied.
+ */
+class RawImage {
+public:
+    static constexpr uint32_t magic = 0x49524d53; // "SMRI"
+    static constexpr uint32_t version = 2;
+
+private:
+    struct Header {
+        uint32_t magic, version;
+        uint32_t width, height;
+        uint64_t source_size, source_hash;
+    };
+
+    const uint8_t *data = nullptr;
+    size_t data_size = 0;
+
+    void *mapping = nullptr;
+    size_t mapping_size = 0;
+    // Used when the file can't be mapped
+    std::vector<uint8_t> contents;
+
+    Header header;
+public:
+    /** Maps the raw image file, throws if it can't be read or isn't a valid raw image. */
+    explicit RawImage(const std::filesystem::path &path);
+    ~RawImage();
+
+    RawImage(const RawImage &) = delete;
+    RawImage &operator=(const RawImage &) = delete;
+
+    uint32_t width() const { return header.width; }
+    uint32_t height() const { return header.height; }
+
+    /** A surface over the mapped pixels, it can't be used after the raw image is destroyed. */
+    SDL_Surface *surface() const;
+
+    /** Where the raw image made from the image is, the same path with the .rgba extension. */
+    static std::filesystem::path path_for(const std::filesystem::path &image_path);
+
+    /** The raw image made from the image, if there's one that's up to date. */
+    static std::unique_ptr<RawImage> find(const std::filesystem::path &image_path);
+
+    /** Hash of the file's contents, reading the file is still much faster than decoding it. */
+    static std::optional<uint64_t> hash_file(const std::filesystem::path &path);
+
+    /** Writes the surface as a raw image made from the source image file. */
+    static void write(const std::filesystem::path &path, SDL_Surface *surface, const std::filesystem::path &source_path);
+};
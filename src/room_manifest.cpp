@@ -0,0 +1,295 @@
+#include <set>
+#include <map>
+#include <fstream>
+#include <optional>
+#include <filesystem>
+
+#include <toml++/toml.h>
+#include "yaml-cpp/yaml.h"
+
+#include "room_manifest.hpp"
+#include "logger.hpp"
+
+namespace {
+
+namespace fs = std::filesystem;
+
+int64_t mtime_of(const fs::path &path) {
+    std::error_code error;
+    auto time = fs::last_write_time(path, error);
+
+    // Files that are missing never match, so the manifest is made again once they're there
+    return error ? -1 : (int64_t)time.time_since_epoch().count();
+}
+
+std::set<std::string> strings_of(const toml::array *array) {
+    std::set<std::string> result;
+    if (array) {
+        for (const auto &element : *array) {
+            if (auto value = element.value<std::string>())
+                result.insert(*value);
+        }
+    }
+
+    return result;
+}
+
+class ManifestBuilder {
+    fs::path rooms_root;
+    RoomManifest &manifest;
+
+    std::set<std::string> textures, sounds, shaders, adjacent_rooms, source_paths;
+    std::map<std::string, std::string> texture_files;
+
+    void add_source(const fs::path &path) {
+        auto path_string = path.generic_string();
+        if (source_paths.insert(path_string).second)
+            manifest.sources.push_back(RoomManifestSource { path_string, mtime_of(path) });
+    }
+
+    toml::table parse(const fs::path &path) {
+        add_source(path);
+
+        return toml::parse_file(path.string());
+    }
+
+    /** Goes through every nested table of a component, looking for the keys that name assets. */
+    void find_assets(const toml::node &node, std::string_view name) {
+        if (auto array = node.as_array()) {
+            for (const auto &element : *array)
+                find_assets(element, name);
+        } else if (auto table = node.as_table()) {
+            for (const auto &[key, value] : *table) {
+                auto value_string = value.value<std::string>();
+                if (!value_string) {
+                    find_assets(value, key.str());
+                    continue;
+                }
+
+                // Like sound_asset, footstep_sound_asset and interaction_sound_asset,
+                // and the sounds of tilemap phrases, which are { sound = { asset = ... } }
+                if (key.str() == "texture_asset")
+                    textures.insert(*value_string);
+                else if (key.str().ends_with("sound_asset") || (name == "sound" && key.str() == "asset"))
+                    sounds.insert(*value_string);
+            }
+        }
+    }
+
+    void add_tilemap(const std::string &path) {
+        add_source(path);
+
+        // Only the tilesets are needed, the same way Tilemap::load finds them
+        auto map_path = fs::path(path);
+        YAML::Node root = YAML::LoadFile(map_path.string());
+
+        for (const auto &tset_info : root["tilesets"]) {
+            YAML::Node set = tset_info;
+            auto set_dir = map_path.parent_path();
+            if (tset_info["source"]) {
+                auto set_path = set_dir / tset_info["source"].as<std::string>();
+                add_source(set_path);
+
+                set = YAML::LoadFile(set_path.string());
+                set_dir = set_path.parent_path();
+            }
+
+            auto image = set["image"].as<std::string>();
+            // The name components.tilemap adds the image to the known assets with
+            auto key = fs::path(image).replace_extension().generic_string();
+            texture_files[key] = (set_dir / image).lexically_normal().string();
+        }
+    }
+
+    void add_component(const std::string &name, const toml::node &component) {
+        auto table = component.as_table();
+        if (name == "passage" && table) {
+            if (auto to = (*table)["to"].value<std::string>())
+                adjacent_rooms.insert(*to);
+        } else if (name == "tilemap" && table) {
+            if (auto path = (*table)["tilemap"].value<std::string>())
+                add_tilemap(*path);
+        }
+
+        find_assets(component, name);
+    }
+
+    /** Components of the entity and its prefabs, without the ones that are removed on the way. */
+    void add_entity(const toml::table &entity, std::set<std::string> removed_components) {
+        // Same as components.entities, the prefab is either a name or a table with the name and removed components
+        auto prefab = entity["prefab"];
+        std::optional<std::string> prefab_name = prefab.value<std::string>();
+        if (auto prefab_table = prefab.as_table()) {
+            prefab_name = (*prefab_table)["name"].value<std::string>();
+            removed_components.merge(strings_of((*prefab_table)["removed_components"].as_array()));
+        }
+
+        if (prefab_name)
+            add_entity(parse(rooms_root / "prefabs" / (*prefab_name + ".toml")), removed_components);
+
+        for (const auto &[key, component] : entity) {
+            std::string name(key.str());
+            if (name != "prefab" && !removed_components.contains(name))
+                add_component(name, component);
+        }
+    }
+public:
+    ManifestBuilder(const std::string &rooms_root, RoomManifest &manifest) : rooms_root(rooms_root), manifest(manifest) {}
+
+    /** Adds the room and the rooms it's based on, skipping the removed entities. */
+    void add_room(const std::string &name, const std::set<std::string> &removed_entities) {
+        auto room = parse(rooms_root / (name + ".toml"));
+
+        if (auto prefab = room["prefab"].as_table()) {
+            // Entities removed from this room are removed from the prefab room too, since it's merged into this one
+            auto removed_from_prefab = removed_entities;
+            removed_from_prefab.merge(strings_of((*prefab)["removed_entities"].as_array()));
+
+            if (auto prefab_name = (*prefab)["name"].value<std::string>())
+                add_room(*prefab_name, removed_from_prefab);
+        }
+
+        if (auto room_shaders = room["shaders"].as_table()) {
+            for (const auto &[key, _] : *room_shaders)
+                shaders.insert(std::string(key.str()));
+        }
+
+        if (auto entities = room["entities"].as_table()) {
+            for (const auto &[key, entity] : *entities) {
+                auto entity_table = entity.as_table();
+                if (entity_table && !removed_entities.contains(std::string(key.str())))
+                    add_entity(*entity_table, {});
+            }
+        }
+    }
+
+    void finish() {
+        manifest.textures.assign(textures.begin(), textures.end());
+        manifest.sounds.assign(sounds.begin(), sounds.end());
+        manifest.shaders.assign(shaders.begin(), shaders.end());
+        manifest.adjacent_rooms.assign(adjacent_rooms.begin(), adjacent_rooms.end());
+
+        for (const auto &[key, path] : texture_files)
+            manifest.texture_files.push_back(RoomManifestFile { key, path });
+    }
+};
+
+toml::array to_toml_array(const std::vector<std::string> &strings) {
+    toml::array result;
+    for (const auto &string : strings)
+        result.push_back(string);
+
+    return result;
+}
+
+std::vector<std::string> from_toml_array(const toml::array *array) {
+    std::vector<std::string> result;
+    if (array) {
+        for (const auto &element : *array)
+            result.push_back(element.value_or(std::string()));
+    }
+
+    return result;
+}
+
+toml::table to_toml(const RoomManifest &manifest) {
+    toml::array texture_files;
+    for (const auto &file : manifest.texture_files)
+        texture_files.push_back(toml::table { { "key", file.key }, { "path", file.path } });
+
+    toml::array sources;
+    for (const auto &source : manifest.sources)
+        sources.push_back(toml::table { { "path", source.path }, { "mtime", source.mtime } });
+
+    return toml::table {
+        { "textures", to_toml_array(manifest.textures) },
+        { "sounds", to_toml_array(manifest.sounds) },
+        { "shaders", to_toml_array(manifest.shaders) },
+        { "adjacent_rooms", to_toml_array(manifest.adjacent_rooms) },
+        { "texture_files", texture_files },
+        { "sources", sources }
+    };
+}
+
+RoomManifest from_toml(const toml::table &table) {
+    RoomManifest manifest;
+    manifest.textures = from_toml_array(table["textures"].as_array());
+    manifest.sounds = from_toml_array(table["sounds"].as_array());
+    manifest.shaders = from_toml_array(table["shaders"].as_array());
+    manifest.adjacent_rooms = from_toml_array(table["adjacent_rooms"].as_array());
+
+    if (auto files = table["texture_files"].as_array()) {
+        for (const auto &file : *files) {
+            if (auto file_table = file.as_table()) {
+                manifest.texture_files.push_back(RoomManifestFile {
+                    (*file_table)["key"].value_or(std::string()), (*file_table)["path"].value_or(std::string())
+                });
+            }
+        }
+    }
+
+    if (auto sources = table["sources"].as_array()) {
+        for (const auto &source : *sources) {
+            if (auto source_table = source.as_table()) {
+                manifest.sources.push_back(RoomManifestSource {
+                    (*source_table)["path"].value_or(std::string()), (*source_table)["mtime"].value_or(int64_t(-1))
+                });
+            }
+        }
+    }
+
+    return manifest;
+}
+
+}
+
+RoomManifest RoomManifest::build(const std::string &rooms_root, const std::string &name) {
+    RoomManifest manifest;
+
+    ManifestBuilder builder(rooms_root, manifest);
+    builder.add_room(name, {});
+    builder.finish();
+
+    return manifest;
+}
+
+bool RoomManifest::is_fresh() const {
+    if (sources.empty())
+        return false;
+
+    for (const auto &source : sources) {
+        if (source.mtime < 0 || mtime_of(source.path) != source.mtime)
+            return false;
+    }
+
+    return true;
+}
+
+RoomManifest RoomManifest::load(const std::string &rooms_root, const std::string &name) {
+    auto cache_path = fs::path(rooms_root) / ".manifests" / (name + ".toml");
+
+    if (fs::exists(cache_path)) {
+        try {
+            auto cached = from_toml(toml::parse_file(cache_path.string()));
+            if (cached.is_fresh())
+                return cached;
+        } catch (const toml::parse_error &err) {
+            spdlog::warn("Making the room manifest {} again, couldn't parse it: {}", cache_path.string(), err.description());
+        }
+    }
+
+    auto manifest = build(rooms_root, name);
+
+    std::error_code error;
+    fs::create_directories(cache_path.parent_path(), error);
+
+    std::ofstream file(cache_path);
+    if (error || !file.good()) {
+        // Not being able to cache it only makes the next load slower
+        spdlog::warn("Couldn't write the room manifest {}", cache_path.string());
+        return manifest;
+    }
+    file << to_toml(manifest);
+
+    return manifest;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/** A texture that's loaded straight from a file instead of assets.toml, like the tileset images of tilemaps. */
+struct RoomManifestFile {
+    // The name it's added to the known assets with
+    std::string key;
+    std::string path;
+};
+
+/** A file the manifest was made from, with its modification time at that point. */
+struct RoomManifestSource {
+    std::string path;
+    int64_t mtime;
+};
+
+/** The assets a room needs, found by going through its TOML file, the rooms and entity prefabs it's based on
+ *  and its tilemaps, without instantiating anything. Used to load the assets of a room before it's entered.
+ *
+ *  Manifests are cached in the .manifests directory next to the rooms, and made again when any of the files
+ *  they were made from changes.
+ */
+class RoomManifest {
+public:
+    // Asset keys from assets.toml, sorted
+    std::vector<std::string> textures, sounds, shaders;
+    std::vector<RoomManifestFile> texture_files;
+    // Where the passages of the room lead, as written in them
+    std::vector<std::string> adjacent_rooms;
+
+    std::vector<RoomManifestSource> sources;
+
+    /** Goes through the room's files. rooms_root is the directory with the rooms and the prefabs directory. */
+    static RoomManifest build(const std::string &rooms_root, const std::string &name);
+
+    /** Returns the cached manifest if it's still fresh, otherwise builds it and writes it to the cache. */
+    static RoomManifest load(const std::string &rooms_root, const std::string &name);
+
+    /** True if none of the source files changed since the manifest was made. */
+    bool is_fresh() const;
+};
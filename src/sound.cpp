@@ -34,7 +34,7 @@ SoundBuffer::SoundBuffer() {
 }
 
 bool SoundBuffer::loadFromFile(const std::string &path) {
-    chunk = Mix_LoadWAV(path.data());
+    chunk.reset(Mix_LoadWAV(path.data()), Mix_FreeChunk);
     if (chunk == nullptr) {
         spdlog::error("Failed to load audio file {}: {}", path, SDL_GetError());
         return false;
@@ -54,7 +54,7 @@ void Sound::play() {
     if (status() == Status::Playing) return;
 
     // Loop the sound if requested by passing -1
-    channel = Mix_PlayChannel(-1, buffer.chunk, loop ? -1 : 0);
+    channel = Mix_PlayChannel(-1, buffer.chunk.get(), loop ? -1 : 0);
     if (channel == -1) {
         spdlog::error("Could not play the sound: {}", SDL_GetError());
         return;
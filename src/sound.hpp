@@ -1,4 +1,7 @@
+#pragma once
+
 #include <map>
+#include <memory>
 
 #include "SDL_mixer.h"
 
@@ -7,14 +10,19 @@ namespace someone {
 void on_channel_finished(int channel);
 
 class SoundBuffer {
-    Mix_Chunk *chunk;
+    // Shared with the copies of the buffer in sounds, freed when the last of them is gone
+    std::shared_ptr<Mix_Chunk> chunk;
 
 public:
     SoundBuffer();
 
     bool loadFromFile(const std::string &path);
 
+    /** Size of the decoded samples in bytes. */
+    size_t getSize() const { return chunk ? chunk->alen : 0; }
+
     friend class Sound;
+    friend class AssetLoader;
 };
 
 class Sound {
@@ -0,0 +1,400 @@
+#include <map>
+#include <fstream>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "fmt/format.h"
+
+#include "story_bundle.hpp"
+
+namespace {
+
+uint32_t float_bits(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    return bits;
+}
+
+float bits_float(uint32_t bits) {
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+
+    return value;
+}
+
+class BundleWriter {
+    std::vector<std::string_view> strings;
+    std::unordered_map<std::string_view, uint32_t> string_ids;
+
+    std::vector<CharacterConfig> configs;
+    std::map<std::pair<uint32_t, uint32_t>, uint32_t> config_ids;
+
+    static uint32_t pack_color(const sf::Color &color) {
+        return (color.r << 24) | (color.g << 16) | (color.b << 8) | color.a;
+    }
+public:
+    std::vector<uint32_t> line_records, payload;
+
+    uint32_t intern(std::string_view str) {
+        auto found = string_ids.find(str);
+        if (found != string_ids.end())
+            return found->second;
+
+        uint32_t id = strings.size();
+        strings.push_back(str);
+        string_ids.emplace(str, id);
+
+        return id;
+    }
+
+    uint32_t intern(const std::optional<std::string_view> &str) {
+        return str ? intern(*str) : StoryBundle::no_string;
+    }
+
+    uint32_t config_id(const CharacterConfig &config) {
+        auto key = std::make_pair(pack_color(config.color), config.font_size);
+
+        auto found = config_ids.find(key);
+        if (found != config_ids.end())
+            return found->second;
+
+        uint32_t id = configs.size();
+        configs.push_back(config);
+        config_ids.emplace(key, id);
+
+        return id;
+    }
+
+    void write_value(const StoryValue &value) {
+        payload.push_back((uint32_t)value.type);
+
+        switch (value.type) {
+        case StoryValue::Type::Nil:
+            break;
+        case StoryValue::Type::Int:
+            payload.push_back((uint32_t)value.int_value);
+            break;
+        case StoryValue::Type::Float:
+            payload.push_back(float_bits(value.float_value));
+            break;
+        case StoryValue::Type::String:
+            payload.push_back(intern(value.string_value));
+            break;
+        case StoryValue::Type::Array:
+            payload.push_back(value.values.size());
+            for (const auto &element : value.values)
+                write_value(element);
+            break;
+        case StoryValue::Type::Map:
+            payload.push_back(value.values.size());
+            for (size_t i = 0; i < value.values.size(); i++) {
+                payload.push_back(intern(value.keys[i]));
+                write_value(value.values[i]);
+            }
+            break;
+        }
+    }
+
+    void write_line(const StoryLine &line) {
+        line_records.insert(line_records.end(), {
+            intern(line.name),
+            (uint32_t)line.type,
+            config_id(line.character_config),
+            intern(line.script),
+            intern(line.script_after),
+            (uint32_t)payload.size()
+        });
+
+        switch (line.type) {
+        case StoryLine::Type::Output:
+        case StoryLine::Type::InputWait:
+            payload.insert(payload.end(), { intern(line.text), intern(line.next) });
+            break;
+        case StoryLine::Type::VariantInput:
+            payload.push_back(line.variants.size());
+            for (const auto &variant : line.variants)
+                payload.insert(payload.end(), { intern(variant.text), intern(variant.next), intern(variant.condition) });
+            break;
+        case StoryLine::Type::TextInput:
+            payload.insert(payload.end(), {
+                intern(line.before), intern(line.after), intern(line.variable), line.max_length, intern(line.next),
+                (uint32_t)line.filters.size()
+            });
+            for (const auto &filter : line.filters)
+                payload.push_back(intern(filter));
+            break;
+        case StoryLine::Type::Custom:
+            payload.insert(payload.end(), { intern(line.custom_module), intern(line.custom_class) });
+            write_value(line.custom_data);
+            break;
+        }
+    }
+
+    std::vector<uint32_t> finish(uint32_t line_count) {
+        std::vector<uint32_t> string_offsets;
+        std::string string_data;
+        for (const auto &str : strings) {
+            string_offsets.push_back(string_data.size());
+            string_data += str;
+        }
+        string_offsets.push_back(string_data.size());
+        // Keep everything after the strings aligned to words
+        string_data.resize((string_data.size() + 3) / 4 * 4, '\0');
+
+        std::vector<uint32_t> result(StoryBundle::header_words);
+
+        auto string_offsets_at = result.size();
+        result.insert(result.end(), string_offsets.begin(), string_offsets.end());
+
+        auto string_data_at = result.size();
+        result.resize(result.size() + string_data.size() / 4);
+        std::memcpy(result.data() + string_data_at, string_data.data(), string_data.size());
+
+        auto configs_at = result.size();
+        for (const auto &config : configs)
+            result.insert(result.end(), { pack_color(config.color), config.font_size });
+
+        auto lines_at = result.size();
+        result.insert(result.end(), line_records.begin(), line_records.end());
+
+        auto payload_at = result.size();
+        result.insert(result.end(), payload.begin(), payload.end());
+
+        uint32_t header[] = {
+            StoryBundle::magic, StoryBundle::version,
+            (uint32_t)strings.size(), (uint32_t)configs.size(), line_count,
+            (uint32_t)string_offsets_at, (uint32_t)string_data_at, (uint32_t)configs_at, (uint32_t)lines_at, (uint32_t)payload_at,
+            (uint32_t)result.size()
+        };
+        std::copy(std::begin(header), std::end(header), result.begin());
+
+        return result;
+    }
+};
+
+}
+
+void StoryBundle::write(const std::filesystem::path &path, const std::vector<StoryLine> &lines) {
+    BundleWriter writer;
+    for (const auto &line : lines)
+        writer.write_line(line);
+
+    auto result = writer.finish(lines.size());
+
+    std::ofstream file(path, std::ios::binary);
+    file.write((const char *)result.data(), result.size() * sizeof(uint32_t));
+    if (!file.good())
+        throw std::runtime_error(fmt::format("Couldn't write the story bundle to {}", path.string()));
+}
+
+StoryBundle::StoryBundle(const std::filesystem::path &path) {
+    static_assert(sizeof(Header) == sizeof(uint32_t) * header_words);
+
+#ifndef _WIN32
+    if (int fd = open(path.c_str(), O_RDONLY); fd >= 0) {
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0) {
+            void *mapped = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped != MAP_FAILED) {
+                mapping = mapped;
+                mapping_size = file_stat.st_size;
+
+                words = (const uint32_t *)mapping;
+                word_count = mapping_size / sizeof(uint32_t);
+            }
+        }
+        close(fd);
+    }
+#endif
+
+    if (!mapping) {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file.good())
+            throw std::runtime_error(fmt::format("Couldn't open the story bundle {}", path.string()));
+
+        size_t size = file.tellg();
+        file.seekg(0);
+
+        contents.resize(size / sizeof(uint32_t));
+        file.read((char *)contents.data(), contents.size() * sizeof(uint32_t));
+
+        words = contents.data();
+        word_count = contents.size();
+    }
+
+    try {
+        if (word_count < sizeof(Header) / sizeof(uint32_t))
+            throw std::runtime_error("file is too small");
+
+        std::memcpy(&header, words, sizeof(Header));
+
+        if (header.magic != magic)
+            throw std::runtime_error("not a story bundle");
+        if (header.version != version)
+            throw std::runtime_error(fmt::format("version {} is not supported, expected {}", header.version, version));
+        if (header.total_words != word_count)
+            throw std::runtime_error("file is truncated");
+        if (header.string_offsets_at + header.string_count + 1 > header.string_data_at
+            || header.string_data_at > header.configs_at
+            || header.configs_at + header.config_count * config_words > header.lines_at
+            || header.lines_at + header.line_count * line_words > header.payload_at
+            || header.payload_at > word_count)
+            throw std::runtime_error("sections are out of bounds");
+    } catch (const std::runtime_error &e) {
+#ifndef _WIN32
+        if (mapping)
+            munmap(mapping, mapping_size);
+#endif
+
+        throw std::runtime_error(fmt::format("Invalid story bundle {}: {}", path.string(), e.what()));
+    }
+}
+
+StoryBundle::~StoryBundle() {
+#ifndef _WIN32
+    if (mapping)
+        munmap(mapping, mapping_size);
+#endif
+}
+
+uint32_t StoryBundle::word(size_t at) const {
+    if (at >= word_count)
+        throw std::out_of_range("Reading past the end of the story bundle");
+
+    return words[at];
+}
+
+std::string_view StoryBundle::string(uint32_t id) const {
+    if (id >= header.string_count)
+        throw std::out_of_range(fmt::format("String {} is not in the story bundle", id));
+
+    auto start = word(header.string_offsets_at + id), end = word(header.string_offsets_at + id + 1);
+    if (start > end || end > (header.configs_at - header.string_data_at) * sizeof(uint32_t))
+        throw std::out_of_range(fmt::format("String {} is out of bounds", id));
+
+    return std::string_view((const char *)(words + header.string_data_at) + start, end - start);
+}
+
+std::string_view StoryBundle::line_name(size_t index) const {
+    return string(word(header.lines_at + index * line_words));
+}
+
+std::optional<std::string_view> StoryBundle::read_optional_string(size_t &at) const {
+    auto id = word(at++);
+    if (id == no_string)
+        return std::nullopt;
+
+    return string(id);
+}
+
+StoryValue StoryBundle::read_value(size_t &at) const {
+    StoryValue value;
+    value.type = (StoryValue::Type)word(at++);
+
+    switch (value.type) {
+    case StoryValue::Type::Nil:
+        break;
+    case StoryValue::Type::Int:
+        value.int_value = (int32_t)word(at++);
+        break;
+    case StoryValue::Type::Float:
+        value.float_value = bits_float(word(at++));
+        break;
+    case StoryValue::Type::String:
+        value.string_value = read_string(at);
+        break;
+    case StoryValue::Type::Array: {
+        auto count = word(at++);
+        for (uint32_t i = 0; i < count; i++)
+            value.values.push_back(read_value(at));
+        break;
+    }
+    case StoryValue::Type::Map: {
+        auto count = word(at++);
+        for (uint32_t i = 0; i < count; i++) {
+            value.keys.push_back(read_string(at));
+            value.values.push_back(read_value(at));
+        }
+        break;
+    }
+    default:
+        throw std::runtime_error(fmt::format("Unknown value type {} in the story bundle", (uint32_t)value.type));
+    }
+
+    return value;
+}
+
+StoryLine StoryBundle::line(size_t index) const {
+    if (index >= header.line_count)
+        throw std::out_of_range(fmt::format("Line {} is not in the story bundle", index));
+
+    size_t record = header.lines_at + index * line_words;
+
+    StoryLine line;
+    line.name = read_string(record);
+    line.type = (StoryLine::Type)word(record++);
+
+    auto config = word(record++);
+    if (config >= header.config_count)
+        throw std::out_of_range(fmt::format("Character config {} is not in the story bundle", config));
+    auto color = word(header.configs_at + config * config_words);
+    line.character_config = CharacterConfig(
+        sf::Color(color >> 24, (color >> 16) & 0xFF, (color >> 8) & 0xFF, color & 0xFF),
+        word(header.configs_at + config * config_words + 1)
+    );
+
+    line.script = read_optional_string(record);
+    line.script_after = read_optional_string(record);
+
+    size_t at = header.payload_at + word(record);
+    switch (line.type) {
+    case StoryLine::Type::Output:
+    case StoryLine::Type::InputWait:
+        line.text = read_string(at);
+        line.next = read_string(at);
+        break;
+    case StoryLine::Type::VariantInput: {
+        auto count = word(at++);
+        for (uint32_t i = 0; i < count; i++) {
+            auto text = read_string(at);
+            auto next = read_string(at);
+
+            TerminalVariantInputLineData::Variant variant(text, next);
+            variant.condition = read_optional_string(at);
+
+            line.variants.push_back(variant);
+        }
+        break;
+    }
+    case StoryLine::Type::TextInput: {
+        line.before = read_string(at);
+        line.after = read_string(at);
+        line.variable = read_string(at);
+        line.max_length = word(at++);
+        line.next = read_string(at);
+
+        auto count = word(at++);
+        for (uint32_t i = 0; i < count; i++)
+            line.filters.push_back(read_string(at));
+        break;
+    }
+    case StoryLine::Type::Custom:
+        line.custom_module = read_string(at);
+        line.custom_class = read_string(at);
+        line.custom_data = read_value(at);
+        break;
+    default:
+        throw std::runtime_error(fmt::format("Unknown line type {} in the story bundle", (uint32_t)line.type));
+    }
+
+    return line;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <filesystem>
+
+#include "line_data.hpp"
+
+/** Parsed story lines in a compact binary form, made offline by the story compiler so that
+ *  the game doesn't need to parse YAML at startup.
+ *
+ *  The file is made of 32-bit words: a header, a table of all the strings (every string is stored once),
+ *  character configs, fixed size line records and the variable sized data of each line. It is memory mapped
+ *  when loaded and lines are decoded from it one by one.
+ */
+class StoryBundle {
+public:
+    static constexpr uint32_t magic = 0x54534d53; // "SMST"
+    static constexpr uint32_t version = 1;
+
+    static constexpr uint32_t no_string = 0xFFFFFFFF;
+    static constexpr uint32_t header_words = 11;
+
+private:
+    struct Header {
+        uint32_t magic, version;
+        uint32_t string_count, config_count, line_count;
+        // Offsets are in words from the start of the file
+        uint32_t string_offsets_at, string_data_at, configs_at, lines_at, payload_at;
+        uint32_t total_words;
+    };
+
+    static constexpr uint32_t config_words = 2;
+    static constexpr uint32_t line_words = 6;
+
+    const uint32_t *words = nullptr;
+    size_t word_count = 0;
+
+    void *mapping = nullptr;
+    size_t mapping_size = 0;
+    // Used when the file can't be mapped
+    std::vector<uint32_t> contents;
+
+    Header header;
+
+    uint32_t word(size_t at) const;
+
+    StoryValue read_value(size_t &at) const;
+    std::string_view read_string(size_t &at) const { return string(word(at++)); }
+    std::optional<std::string_view> read_optional_string(size_t &at) const;
+public:
+    /** Maps the bundle file, throws if it can't be read or isn't a valid bundle. */
+    explicit StoryBundle(const std::filesystem::path &path);
+    ~StoryBundle();
+
+    StoryBundle(const StoryBundle &) = delete;
+    StoryBundle &operator=(const StoryBundle &) = delete;
+
+    size_t size() const { return header.line_count; }
+
+    std::string_view string(uint32_t id) const;
+    std::string_view line_name(size_t index) const;
+
+    /** Decodes the line at the index, its strings point into the bundle. */
+    StoryLine line(size_t index) const;
+
+    static void write(const std::filesystem::path &path, const std::vector<StoryLine> &lines);
+};
@@ -0,0 +1,55 @@
+#include <iostream>
+
+#include "sol/sol.hpp"
+
+#include "args.hxx"
+
+#include "logger.hpp"
+#include "story_parser.hpp"
+#include "story_bundle.hpp"
+
+// Parses the story files and everything they reference, and writes all the lines to a bundle
+// that the game loads instead of the story files.
+int main(int argc, char **argv) {
+    args::ArgumentParser arg_parser("Someone - story bundle compiler");
+    arg_parser.helpParams.width = 100;
+    arg_parser.helpParams.showProglineOptions = false;
+
+    args::HelpFlag help(arg_parser, "help", "Display this help message", {'h', "help"});
+    args::ValueFlag<std::string> base(
+        arg_parser, "directory", "Directory with the story files", {'b', "base"}, StoryParser::default_base.string()
+    );
+    args::Positional<std::string> output(arg_parser, "output", "Where to write the bundle", args::Options::Required);
+    args::PositionalList<std::string> namespaces(
+        arg_parser, "namespaces", "Story files to start from, e.g. day1/prologue", args::Options::Required
+    );
+    try {
+        arg_parser.ParseCLI(argc, argv);
+    } catch (const args::Help&) {
+        std::cout << arg_parser;
+        return 0;
+    } catch (const args::Error &e) {
+        std::cerr << e.what() << std::endl;
+        std::cerr << arg_parser;
+
+        return 1;
+    }
+
+    // Parsing doesn't need lua, but the parser still wants a place to put lines
+    sol::state lua;
+    sol::table lines = lua.create_table();
+    StoryParser parser(lines, lua);
+
+    std::vector<StoryLine> parsed;
+    try {
+        parser.parse_native(args::get(namespaces), args::get(base), parsed);
+
+        StoryBundle::write(args::get(output), parsed);
+    } catch (const std::exception &e) {
+        spdlog::error("{}", e.what());
+
+        return 1;
+    }
+
+    spdlog::info("Wrote {} lines to {}", parsed.size(), args::get(output));
+}
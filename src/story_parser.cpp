@@ -1,4 +1,7 @@
 #include <filesystem>
+#include <thread>
+#include <atomic>
+#include <stdexcept>
 
 #include "SFML/Graphics/Color.hpp"
 
@@ -10,6 +13,8 @@
 #include "logger.hpp"
 #include "string_utils.hpp"
 #include "line_data.hpp"
+#include "story_bundle.hpp"
+#include "string_interner.hpp"
 
 #ifndef NDEBUG
 #include <fstream>
@@ -48,17 +53,26 @@ template <> struct convert<CharacterConfig> {
 
 #ifndef NDEBUG
 void StoryParser::total_wordcount() {
-  std::vector<std::string> all_strings;
-
-  for (const auto [_key, line_data] : lines) {
-      if (auto line = line_data.as<std::optional<TerminalOutputLineData>>(); line.has_value())
-          all_strings.push_back(line->text);
-      else if (auto line = line_data.as<std::optional<TerminalVariantInputLineData>>(); line.has_value())
-          for (auto &variant : line->variants)
+  std::vector<std::string_view> all_strings;
+
+  for (const auto &[_name, entry] : native_lines->entries) {
+      auto line = native_lines->line(entry);
+
+      switch (line.type) {
+      case StoryLine::Type::Output:
+      case StoryLine::Type::InputWait:
+          all_strings.push_back(line.text);
+          break;
+      case StoryLine::Type::VariantInput:
+          for (auto &variant : line.variants)
               all_strings.push_back(variant.text);
-      else if (auto line = line_data.as<std::optional<TerminalTextInputLineData>>(); line.has_value()) {
-          all_strings.push_back(line->before);
-          all_strings.push_back(line->after);
+          break;
+      case StoryLine::Type::TextInput:
+          all_strings.push_back(line.before);
+          all_strings.push_back(line.after);
+          break;
+      default:
+          break;
       }
   }
 
@@ -106,37 +120,15 @@ void StoryParser::total_wordcount() {
 }
 #endif
 
-std::string namespace_of(std::string next) {
+std::string_view namespace_of(std::string_view next) {
     auto last_separator_pos = next.find_last_of("/");
-    if (last_separator_pos != std::string::npos) {
+    if (last_separator_pos != std::string_view::npos) {
         return next.substr(0, last_separator_pos);
     } else {
         throw std::invalid_argument(fmt::format("{} doesn't not contain a namespace serparator", next));
     }
 }
 
-void StoryParser::maybe_parse_referenced_file(std::string next) {
-    // If it IS namespaced, try parsing a file that it references if it's not parsed yet
-
-    auto next_namespace = namespace_of(next);
-
-    bool any_already = false;
-    for (const auto &[key, value] : lines) {
-        if (namespace_of(key.as<std::string>()) == next_namespace) {
-            any_already = true;
-
-            break;
-        }
-    }
-
-    // If it has not already been parsed, parse the referenced file
-    if (!any_already) {
-        spdlog::debug("Encountered a reference to a new namespace {}, parsing it", next_namespace);
-
-        StoryParser::parse(next_namespace);
-    }
-}
-
 std::optional<std::tuple<std::string, uint32_t>> split_as_numbered(const std::string &name) {
     auto maybe_last_dash = name.rfind('-');
 
@@ -158,12 +150,89 @@ std::optional<std::tuple<std::string, uint32_t>> split_as_numbered(const std::st
     }
 }
 
-void StoryParser::parse(std::string file_name, std::filesystem::path base) {
+StoryLine NativeLines::line(const Entry &entry) const {
+    if (entry.bundle == Entry::no_bundle)
+        return parsed[entry.index];
+
+    return bundles[entry.bundle]->line(entry.index);
+}
+
+StoryParser::StoryParser(sol::table &lines, sol::state &state)
+    : lua(state), native_lines(std::make_shared<NativeLines>()), lines(lines) {
+    auto meta = lua.create_table();
+    meta["__index"] = [native_lines = native_lines](sol::table table, sol::object key, sol::this_state lua) -> sol::object {
+        if (!key.is<std::string>())
+            return sol::lua_nil;
+
+        auto found = native_lines->entries.find(key.as<std::string_view>());
+        if (found == native_lines->entries.end())
+            return sol::lua_nil;
+
+        // Keep the object in the table, so that it's only made once
+        auto object = make_line_object(sol::state_view(lua.L), native_lines->line(found->second), native_lines);
+        table.raw_set(key, object);
+
+        return object;
+    };
+    lines[sol::metatable_key] = meta;
+}
+
+void StoryParser::parse(std::vector<std::string> file_names, std::filesystem::path base) {
+    std::vector<StoryLine> parsed;
+    parse_native(file_names, base, parsed);
+
+    for (auto &line : parsed)
+        store(std::move(line));
+}
+
+void StoryParser::store(StoryLine &&line) {
+    auto [found, inserted] = native_lines->entries.try_emplace(
+        line.name, NativeLines::Entry { NativeLines::Entry::no_bundle, (uint32_t)native_lines->parsed.size() }
+    );
+
+    if (!inserted) {
+        // The file was parsed again, so the object made from the old line is outdated
+        lines.raw_set(line.name, sol::lua_nil);
+        found->second = NativeLines::Entry { NativeLines::Entry::no_bundle, (uint32_t)native_lines->parsed.size() };
+    }
+
+    native_lines->parsed.push_back(std::move(line));
+}
+
+namespace {
+
+struct ParsedFile {
+    std::vector<StoryLine> lines;
+    // Namespaces of other files that the lines in this file reference
+    std::vector<std::string> references;
+    // A map of reference to the nodes to check after everything has been parsed
+    std::map<std::string, std::string> next_references_to_check;
+
+    // Text of the lines, names and references are interned instead
+    std::shared_ptr<StringArena> arena = std::make_shared<StringArena>();
+
+    // Set if parsing has thrown, to rethrow it on the main thread
+    std::exception_ptr error;
+};
+
+/** Parses a single file. Doesn't touch the parser or lua, so multiple files can be parsed at the same time. */
+ParsedFile parse_file(const std::string &file_name, const std::filesystem::path &base) {
+    ParsedFile result;
+    auto &next_references_to_check = result.next_references_to_check;
+
+    auto &arena = *result.arena;
+    auto &interner = StringInterner::instance();
+
     auto full_file_name = base / file_name;
     full_file_name.replace_extension(".yml");
 
     std::string nmspace = file_name;
 
+    // If a name IS namespaced, the file that has it has to be parsed too
+    auto maybe_parse_referenced_file = [&](const std::string &next) {
+        result.references.push_back(std::string(namespace_of(next)));
+    };
+
     YAML::Node root_node = YAML::LoadFile(full_file_name.string());
 
     std::map<std::string, CharacterConfig> character_configs;
@@ -195,9 +264,6 @@ void StoryParser::parse(std::string file_name, std::filesystem::path base) {
         }
     }
 
-    // A map of reference to the nodes to check after everything has been built
-    std::map<std::string, std::string> next_references_to_check;
-
     for (auto name_and_val : root_node) {
         auto name = name_and_val.first.as<std::string>();
         auto node = name_and_val.second;
@@ -232,7 +298,9 @@ void StoryParser::parse(std::string file_name, std::filesystem::path base) {
             }
         }
 
-        CharacterConfig char_config;
+        StoryLine line;
+        line.name = interner.intern(inserted_name);
+
         auto found_char_config = character_configs.find(node_char);
         if (found_char_config == character_configs.end()) {
             spdlog::warn(
@@ -241,22 +309,17 @@ void StoryParser::parse(std::string file_name, std::filesystem::path base) {
                 node_char
             );
         } else {
-            char_config = found_char_config->second;
+            line.character_config = found_char_config->second;
         }
 
-        std::optional<std::string> node_script;
-        if (node["script"]) node_script = node["script"].as<std::string>();
+        if (node["script"]) line.script = arena.store(node["script"].as<std::string>());
 
-        std::optional<std::string> node_script_after;
         if (node["script_after"])
-            node_script_after = node["script_after"].as<std::string>();
-
-
-        sol::object result_object;
+            line.script_after = arena.store(node["script_after"].as<std::string>());
 
         if (node["text"]) {
             // Get the text of the node
-            auto text = node["text"].as<std::string>();
+            line.text = arena.store(node["text"].as<std::string>());
 
             std::string next;
             if (node["next"]) {
@@ -296,14 +359,9 @@ void StoryParser::parse(std::string file_name, std::filesystem::path base) {
                 next_references_to_check.insert({inserted_name, next});
             }
 
-            if (node["wait"] && node["wait"].as<bool>()) {
-                result_object = sol::make_object<TerminalInputWaitLineData>(lua, text, next);
-            } else {
-                result_object = sol::make_object<TerminalOutputLineData>(lua, text, next);
-            }
+            line.next = interner.intern(next);
+            line.type = node["wait"] && node["wait"].as<bool>() ? StoryLine::Type::InputWait : StoryLine::Type::Output;
         } else if (node["responses"]) {
-            decltype(TerminalVariantInputLineData::variants) variants;
-
             if (!node["responses"].IsSequence()) {
                 spdlog::error("'responses' needs to be a sequence, but it's not a sequence in {}", inserted_name);
                 std::terminate();
@@ -358,16 +416,16 @@ void StoryParser::parse(std::string file_name, std::filesystem::path base) {
                     });
 
                 // Create the variant data with the required parameters
-                auto variant = TerminalVariantInputLineData::Variant(resp_text, resp_next);
+                auto variant = TerminalVariantInputLineData::Variant(arena.store(resp_text), interner.intern(resp_next));
 
                 // If there's a condition, add it too
                 if (resp["condition"])
-                    variant.condition = resp["condition"].as<std::string>();
+                    variant.condition = arena.store(resp["condition"].as<std::string>());
 
-                variants.push_back(variant);
+                line.variants.push_back(variant);
             }
 
-            result_object = sol::make_object<TerminalVariantInputLineData>(lua, variants);
+            line.type = StoryLine::Type::VariantInput;
         } else if (node["text_input"]) {
             auto data = node["text_input"];
 
@@ -409,19 +467,19 @@ void StoryParser::parse(std::string file_name, std::filesystem::path base) {
                 next_references_to_check.insert({inserted_name, next});
             }
 
-            std::vector<std::string> filters;
             if (data["filters"]) {
-                filters = data["filters"].as<std::vector<std::string>>();
+                for (const auto &filter : data["filters"].as<std::vector<std::string>>())
+                    line.filters.push_back(interner.intern(filter));
             } else {
-                filters = { "alpha" };
+                line.filters = { interner.intern("alpha") };
             }
 
-            result_object =
-                sol::make_object<TerminalTextInputLineData>(
-                    lua,
-                    data["before"].as<std::string>(), data["after"].as<std::string>(), data["variable"].as<std::string>(),
-                    data["max_length"].as<uint32_t>(), filters, next
-                );
+            line.type = StoryLine::Type::TextInput;
+            line.before = arena.store(data["before"].as<std::string>());
+            line.after = arena.store(data["after"].as<std::string>());
+            line.variable = interner.intern(data["variable"].as<std::string>());
+            line.max_length = data["max_length"].as<uint32_t>();
+            line.next = interner.intern(next);
         } else if (node["custom"]) {
             auto custom = node["custom"];
 
@@ -439,41 +497,17 @@ void StoryParser::parse(std::string file_name, std::filesystem::path base) {
 
                 std::terminate();
             }
-            auto module = custom_name.substr(0, last_dot);
-            auto class_ = custom_name.substr(last_dot + 1, custom_name.size());
-
-            sol::object imported_module = lua.script(fmt::format("return require('{}')", module));
-            if (!imported_module.is<sol::table>()) {
-              std::string string_repr = lua["tostring"](imported_module);
-
-              spdlog::error(
-                "The {} module for the {} custom line is expected to export a table, but exports {}",
-                module, inserted_name, string_repr
-              );
-              std::terminate();
-            }
-
-            sol::optional<sol::object> maybe_class = imported_module.as<sol::table>().get<sol::optional<sol::object>>(class_);
-            if (!maybe_class) {
-                spdlog::error("Cannot find the {} class in the {} module for the {} custom line", class_, module, inserted_name);
-                std::terminate();
-            }
-            if (!maybe_class->is<sol::table>()) {
-              std::string string_repr = lua["tostring"](*maybe_class);
-              spdlog::error(
-                "The object that is supposed to be a custom line class {}.{} for the line {} is actually {}",
-                module, class_, inserted_name, string_repr
-              );
-              std::terminate();
-            }
+            line.custom_module = interner.intern(custom_name.substr(0, last_dot));
+            line.custom_class = interner.intern(custom_name.substr(last_dot + 1, custom_name.size()));
 
-            std::function<sol::object (const YAML::Node &)> convert =
-                [&](const YAML::Node &data_entry) -> sol::object {
+            std::function<StoryValue (const YAML::Node &)> convert =
+                [&](const YAML::Node &data_entry) -> StoryValue {
                     using namespace YAML;
 
+                    StoryValue result;
                     switch (data_entry.Type()) {
                     case NodeType::Null:
-                        return sol::lua_nil;
+                        return result;
                     case NodeType::Scalar:
                         // If there's a line-name tag, parse the data as a line name and try resolving the reference
                         if (data_entry.Tag() == "!line-name") {
@@ -484,65 +518,274 @@ void StoryParser::parse(std::string file_name, std::filesystem::path base) {
                                 // If the name is namespaced, parse the referenced file now
                                 maybe_parse_referenced_file(val);
 
-                            return sol::make_object(lua, val);
+                            result.type = StoryValue::Type::String;
+                            result.string_value = interner.intern(val);
+
+                            return result;
                         }
 
                         // int convertion must be first, since a convertion
                         // to a float succeedes from an integer just fine
-                        if (int val; YAML::convert<int>::decode(data_entry, val))
-                            return sol::make_object(lua, val);
-                        else if (float val; YAML::convert<float>::decode(data_entry, val))
-                            return sol::make_object(lua, val);
-                        else if (std::string val; YAML::convert<std::string>::decode(data_entry, val))
-                            return sol::make_object(lua, val);
-                    case NodeType::Sequence: {
-                        auto arr = lua.create_table();
-                        for (auto val : data_entry) {
-                            arr.add(convert(val));
+                        if (int val; YAML::convert<int>::decode(data_entry, val)) {
+                            result.type = StoryValue::Type::Int;
+                            result.int_value = val;
+                        } else if (float val; YAML::convert<float>::decode(data_entry, val)) {
+                            result.type = StoryValue::Type::Float;
+                            result.float_value = val;
+                        } else {
+                            result.type = StoryValue::Type::String;
+                            result.string_value = arena.store(data_entry.as<std::string>());
                         }
 
-                        return arr;
-                    }
-                    case NodeType::Map: {
-                        sol::table table = lua.create_table();
+                        return result;
+                    case NodeType::Sequence:
+                        result.type = StoryValue::Type::Array;
+                        for (auto val : data_entry) {
+                            result.values.push_back(convert(val));
+                        }
 
+                        return result;
+                    case NodeType::Map:
+                        result.type = StoryValue::Type::Map;
                         for (const auto &kv : data_entry) {
-                            auto name = kv.first.as<std::string>();
-                            auto data_entry = kv.second;
-
-                            table[name] = convert(data_entry);
+                            result.keys.push_back(interner.intern(kv.first.as<std::string>()));
+                            result.values.push_back(convert(kv.second));
                         }
 
-                        return table;
-                    }
+                        return result;
                     case NodeType::Undefined:
+                    default:
                         throw std::runtime_error("Undefined key found?");
                     }
                 };
 
-            result_object = sol::make_object<TerminalCustomLineData>(lua, *maybe_class, convert(custom[custom_name]));
+            line.type = StoryLine::Type::Custom;
+            line.custom_data = convert(custom[custom_name]);
         } else {
             spdlog::error("Unknown line type at {}", inserted_name);
             std::terminate();
         }
 
-        auto &general_line = result_object.as<TerminalLineData>();
-        general_line.character_config = char_config;
-        general_line.script = node_script;
-        general_line.script_after = node_script_after;
+        result.lines.push_back(std::move(line));
+    }
+
+    return result;
+}
+
+/** Calls the function for every index up to count, using all the available threads. */
+template <typename F>
+void parallel_for(size_t count, F function) {
+#ifdef SOMEONE_EMSCRIPTEN
+    // No threads on the web
+    for (size_t i = 0; i < count; i++)
+        function(i);
+#else
+    size_t worker_count = std::min<size_t>(count, std::max(std::thread::hardware_concurrency(), 1u));
+
+    std::atomic<size_t> next_index = 0;
+    auto work = [&]() {
+        for (size_t i = next_index++; i < count; i = next_index++)
+            function(i);
+    };
+
+    // The current thread works too
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < worker_count; i++)
+        workers.emplace_back(work);
+    work();
+
+    for (auto &worker : workers)
+        worker.join();
+#endif
+}
 
-        lines[inserted_name] = result_object;
+}
+
+void StoryParser::parse_native(std::vector<std::string> file_names, std::filesystem::path base, std::vector<StoryLine> &into) {
+    auto &interner = StringInterner::instance();
+
+    std::map<std::string, std::string> next_references_to_check;
+
+    // Files are parsed in waves: first the requested ones, then all the files they reference that haven't been parsed yet, and so on.
+    // Requested files are parsed even if they were parsed before, only references skip them
+    std::vector<std::string> wave;
+    for (auto &file_name : file_names) {
+        parsed_namespaces.insert(interner.intern(file_name));
+        wave.push_back(file_name);
     }
 
-    for (auto &[at, expected_next] : next_references_to_check) {
-        sol::optional maybe_next = lines[expected_next];
+    bool first_wave = true;
+    while (!wave.empty()) {
+        std::vector<ParsedFile> parsed(wave.size());
+        parallel_for(wave.size(), [&](size_t i) {
+            try {
+                // Referenced files are always looked for in the main story directory
+                parsed[i] = parse_file(wave[i], first_wave ? base : default_base);
+            } catch (...) {
+                parsed[i].error = std::current_exception();
+            }
+        });
+        first_wave = false;
+
+        std::vector<std::string> next_wave;
+        for (auto &file : parsed) {
+            if (file.error)
+                std::rethrow_exception(file.error);
+
+            native_lines->arenas.push_back(file.arena);
+            for (auto &line : file.lines) {
+                line_names.insert(line.name);
+                into.push_back(std::move(line));
+            }
+
+            for (auto &reference : file.references) {
+                if (parsed_namespaces.insert(interner.intern(reference)).second) {
+                    spdlog::debug("Encountered a reference to a new namespace {}, parsing it", reference);
+
+                    next_wave.push_back(reference);
+                }
+            }
+
+            next_references_to_check.merge(file.next_references_to_check);
+        }
 
-        if (!maybe_next) {
+        wave = std::move(next_wave);
+    }
+
+    // Everything that could be referenced is parsed now
+    for (auto &[at, expected_next] : next_references_to_check) {
+        if (!has_line(expected_next)) {
             spdlog::warn("{} wants {} as next, but it does not exist", at, expected_next);
         }
     }
 }
 
+static sol::object story_value_to_lua(sol::state_view &lua, const StoryValue &value) {
+    switch (value.type) {
+    case StoryValue::Type::Int:
+        return sol::make_object(lua, value.int_value);
+    case StoryValue::Type::Float:
+        return sol::make_object(lua, value.float_value);
+    case StoryValue::Type::String:
+        return sol::make_object(lua, value.string_value);
+    case StoryValue::Type::Array: {
+        auto arr = lua.create_table();
+        for (const auto &element : value.values)
+            arr.add(story_value_to_lua(lua, element));
+
+        return arr;
+    }
+    case StoryValue::Type::Map: {
+        auto table = lua.create_table();
+        for (size_t i = 0; i < value.keys.size(); i++)
+            table[value.keys[i]] = story_value_to_lua(lua, value.values[i]);
+
+        return table;
+    }
+    case StoryValue::Type::Nil:
+    default:
+        return sol::lua_nil;
+    }
+}
+
+sol::object StoryParser::make_line_object(sol::state_view lua, const StoryLine &line, std::shared_ptr<const void> storage) {
+    sol::object result_object;
+
+    switch (line.type) {
+    case StoryLine::Type::Output:
+        result_object = sol::make_object<TerminalOutputLineData>(lua, line.text, line.next);
+        break;
+    case StoryLine::Type::InputWait:
+        result_object = sol::make_object<TerminalInputWaitLineData>(lua, line.text, line.next);
+        break;
+    case StoryLine::Type::VariantInput:
+        result_object = sol::make_object<TerminalVariantInputLineData>(lua, line.variants);
+        break;
+    case StoryLine::Type::TextInput:
+        result_object =
+            sol::make_object<TerminalTextInputLineData>(
+                lua, line.before, line.after, line.variable, line.max_length, line.filters, line.next
+            );
+        break;
+    case StoryLine::Type::Custom: {
+        sol::table class_;
+        try {
+            class_ = custom_line_class(lua, line);
+        } catch (const std::runtime_error &e) {
+            spdlog::error("{}", e.what());
+            std::terminate();
+        }
+
+        result_object = sol::make_object<TerminalCustomLineData>(lua, class_, story_value_to_lua(lua, line.custom_data));
+        break;
+    }
+    }
+
+    auto &general_line = result_object.as<TerminalLineData>();
+    general_line.character_config = line.character_config;
+    general_line.script = line.script;
+    general_line.script_after = line.script_after;
+    general_line.storage = std::move(storage);
+
+    return result_object;
+}
+
+sol::table StoryParser::custom_line_class(sol::state_view lua, const StoryLine &line) {
+    const auto &module = line.custom_module, &class_ = line.custom_class;
+
+    sol::object imported_module = lua.script(fmt::format("return require('{}')", module));
+    if (!imported_module.is<sol::table>()) {
+        std::string string_repr = lua["tostring"](imported_module);
+
+        throw std::runtime_error(fmt::format(
+            "The {} module for the {} custom line is expected to export a table, but exports {}",
+            module, line.name, string_repr
+        ));
+    }
+
+    sol::optional<sol::object> maybe_class = imported_module.as<sol::table>().get<sol::optional<sol::object>>(class_);
+    if (!maybe_class)
+        throw std::runtime_error(fmt::format("Cannot find the {} class in the {} module for the {} custom line", class_, module, line.name));
+    if (!maybe_class->is<sol::table>()) {
+        std::string string_repr = lua["tostring"](*maybe_class);
+
+        throw std::runtime_error(fmt::format(
+            "The object that is supposed to be a custom line class {}.{} for the line {} is actually {}",
+            module, class_, line.name, string_repr
+        ));
+    }
+
+    return maybe_class->as<sol::table>();
+}
+
+void StoryParser::validate_custom_lines() {
+    for (const auto &[name, entry] : native_lines->entries) {
+        auto line = native_lines->line(entry);
+        if (line.type == StoryLine::Type::Custom)
+            custom_line_class(lua, line);
+    }
+}
+
+void StoryParser::load_bundle(const std::filesystem::path &path) {
+    auto bundle = std::make_shared<StoryBundle>(path);
+
+    uint32_t bundle_index = native_lines->bundles.size();
+    native_lines->bundles.push_back(bundle);
+
+    // Only the names are read now, the lines themselves are decoded when they are used.
+    // Strings in the bundle are already stored only once, so they point into it instead of being interned
+    for (uint32_t i = 0; i < bundle->size(); i++) {
+        auto name = bundle->line_name(i);
+
+        if (auto found = native_lines->entries.find(name); found != native_lines->entries.end())
+            lines.raw_set(name, sol::lua_nil);
+        native_lines->entries[name] = NativeLines::Entry { bundle_index, i };
+
+        parsed_namespaces.insert(StringInterner::instance().intern(namespace_of(name)));
+        line_names.insert(name);
+    }
+}
+
 sol::table StoryParser::load_mods(sol::state &lua) {
   namespace fs = std::filesystem;
 
@@ -587,7 +830,10 @@ sol::table StoryParser::load_mods(sol::state &lua) {
         auto entrypoint_line = entrypoint.substr(last_slash + 1, entrypoint.size());
 
         mod_data.first_line = fmt::format("{}/{}", entrypoint_file, entrypoint_line);
-        mod_data.parser.parse(entrypoint_file, mods_path / name);
+        if (auto bundle = dir.path() / "story.bundle"; fs::exists(bundle))
+            mod_data.parser.load_bundle(bundle);
+        else
+            mod_data.parser.parse(entrypoint_file, mods_path / name);
     } else if (root_node["entrypoint_walking"]) {
         mod_data.first_room = root_node["entrypoint_walking"].as<std::string>();
     } else {
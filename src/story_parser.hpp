@@ -1,26 +1,98 @@
 #pragma once
 
 #include <map>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
 #include <filesystem>
 
 #include <sol/sol.hpp>
 
+#include "line_data.hpp"
+
 struct ModData;
+class StoryBundle;
+class StringArena;
+
+/** Parsed lines that are only turned into lua objects when they are looked up in the lines table for the first time,
+ *  since only a small part of the story is ever used in one session.
+ */
+struct NativeLines {
+    struct Entry {
+        static constexpr uint32_t no_bundle = 0xFFFFFFFF;
+
+        // Either an index into the parsed lines, or into one of the bundles
+        uint32_t bundle;
+        uint32_t index;
+    };
+
+    std::vector<StoryLine> parsed;
+    // Where the strings of the parsed lines are stored
+    std::vector<std::shared_ptr<StringArena>> arenas;
+    std::vector<std::shared_ptr<StoryBundle>> bundles;
+
+    std::unordered_map<std::string_view, Entry> entries;
+
+    StoryLine line(const Entry &entry) const;
+};
 
 class StoryParser {
     sol::state &lua;
+
+    // Shared with the lookup function of the lines table, which may outlive the parser
+    std::shared_ptr<NativeLines> native_lines;
+
+    // Namespaces that have been parsed or are being parsed right now, so that references
+    // to them (including circular ones) don't parse the file again
+    std::unordered_set<std::string_view> parsed_namespaces;
+    // Names of all the lines parsed so far, for checking references without going through the lua table
+    std::unordered_set<std::string_view> line_names;
 public:
     sol::table &lines;
 
-    StoryParser(sol::table &lines, sol::state &state)
-        : lua(state), lines(lines) { }
+    inline static const std::filesystem::path default_base = "resources/story/";
+    inline static const std::filesystem::path bundle_path = "resources/story.bundle";
 
-    void parse(std::string file_name, std::filesystem::path base = std::filesystem::path("resources/story/"));
+    /** Makes the lines table look up lines that haven't been used yet in the parsed lines. */
+    StoryParser(sol::table &lines, sol::state &state);
 
-    /** If "next" references a namespace, parse the file that contains
-     *  this namespace if it hasn't already been parsed.
+    /** Parses the files and the files they reference, and puts their lines into the lines table.
+     *  The files are parsed again even if they were parsed before, referenced files only if they weren't.
      */
-    void maybe_parse_referenced_file(std::string next);
+    void parse(std::vector<std::string> file_names, std::filesystem::path base = default_base);
+    void parse(std::string file_name, std::filesystem::path base = default_base) {
+        parse(std::vector { file_name }, base);
+    }
+
+    /** Parses the files and the files they reference without touching lua, appending the lines to the vector.
+     *
+     *  Files that haven't been parsed yet are parsed on multiple threads at the same time, the
+     *  references between them are checked after everything is parsed.
+     */
+    void parse_native(std::vector<std::string> file_names, std::filesystem::path base, std::vector<StoryLine> &into);
+    void parse_native(std::string file_name, std::filesystem::path base, std::vector<StoryLine> &into) {
+        parse_native(std::vector { file_name }, base, into);
+    }
+
+    /** Stores the parsed line, it will be turned into line data when it's looked up in the lines table. */
+    void store(StoryLine &&line);
+
+    /** Turns a parsed line into the line data object for it, which keeps the storage of the line's strings alive. */
+    static sol::object make_line_object(sol::state_view lua, const StoryLine &line, std::shared_ptr<const void> storage);
+
+    /** Looks up the class of a custom line in its module, throws if either of them isn't there. */
+    static sol::table custom_line_class(sol::state_view lua, const StoryLine &line);
+
+    /** Checks that every custom line's module and class exist, throws if one doesn't.
+     *  Line objects are only made when the lines are used, so this is what finds the mistakes up front.
+     */
+    void validate_custom_lines();
+
+    /** Loads all the lines from a story bundle made by the story compiler instead of parsing them. */
+    void load_bundle(const std::filesystem::path &path);
+
+    bool has_line(std::string_view name) const { return line_names.contains(name); }
+    bool has_namespace(std::string_view nmspace) const { return parsed_namespaces.contains(nmspace); }
 
     static sol::table load_mods(sol::state &lua);
 
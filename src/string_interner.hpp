@@ -0,0 +1,76 @@
+#pragma once
+
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <cstring>
+#include <string_view>
+#include <unordered_set>
+
+/** Stores strings in big blocks that never move, so views into them stay valid for as long as the arena lives. */
+class StringArena {
+    static constexpr size_t block_size = 64 * 1024;
+
+    std::vector<std::unique_ptr<char[]>> blocks;
+
+    char *current = nullptr;
+    size_t left = 0;
+public:
+    std::string_view store(std::string_view str) {
+        if (str.empty())
+            return std::string_view("");
+
+        char *at;
+        if (str.size() > block_size / 4) {
+            // Big strings get their own block, so that they don't waste what's left of the current one
+            at = blocks.emplace_back(std::make_unique<char[]>(str.size())).get();
+        } else {
+            if (str.size() > left) {
+                current = blocks.emplace_back(std::make_unique<char[]>(block_size)).get();
+                left = block_size;
+            }
+
+            at = current;
+            current += str.size();
+            left -= str.size();
+        }
+
+        std::memcpy(at, str.data(), str.size());
+
+        return std::string_view(at, str.size());
+    }
+};
+
+/** Keeps a single copy of every string given to it, so that interned strings that are equal
+ *  also point to the same memory and can be compared by pointer. Can be used from multiple threads.
+ */
+class StringInterner {
+    std::mutex mutex;
+
+    std::unordered_set<std::string_view> strings;
+    StringArena arena;
+
+    StringInterner() = default;
+public:
+    static StringInterner &instance() {
+        static StringInterner interner;
+        return interner;
+    }
+
+    std::string_view intern(std::string_view str) {
+        std::lock_guard lock(mutex);
+
+        if (auto found = strings.find(str); found != strings.end())
+            return *found;
+
+        auto stored = arena.store(str);
+        strings.insert(stored);
+
+        return stored;
+    }
+
+    /** Both strings have to be interned. */
+    static bool same(std::string_view a, std::string_view b) {
+        return a.data() == b.data() && a.size() == b.size();
+    }
+};
@@ -1,7 +1,10 @@
 #pragma once
 
+#include <stdexcept>
+
 #include "story_parser.hpp"
 #include "lua_module_env.hpp"
+#include "logger.hpp"
 
 class TerminalEnv : public LuaModuleEnv {
 private:
@@ -58,10 +61,31 @@ public:
 
         load_mod_f = lua.script("return require('terminal.instance_menu').InstanceMenuLine.load_mod");
 
-        // Parse the lines from the prologue file and going forward from it
-        parser.parse("day1/prologue");
-        parser.parse("instances/menu");
-        parser.parse("save_load/save_load");
+#ifdef NDEBUG
+        // Release builds have the story compiled ahead of time
+        bool use_bundle = std::filesystem::exists(StoryParser::bundle_path);
+#else
+        // Debug builds always parse the story, a bundle left in the build directory by a release build
+        // would be made from the story files as they were back then
+        bool use_bundle = false;
+#endif
+
+        if (use_bundle) {
+            parser.load_bundle(StoryParser::bundle_path);
+        } else {
+            // Parse the lines from the prologue file and going forward from it
+            parser.parse(std::vector<std::string> { "day1/prologue", "instances/menu", "save_load/save_load" });
+        }
+
+#ifndef NDEBUG
+        // Custom lines are only checked when they're shown, so mistakes in them are found right away instead
+        try {
+            parser.validate_custom_lines();
+        } catch (const std::runtime_error &e) {
+            spdlog::error("{}", e.what());
+            std::terminate();
+        }
+#endif
 
         // Add the lines from the loaded file
         set_lines();
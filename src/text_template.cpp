@@ -0,0 +1,140 @@
+#include <stdexcept>
+
+#include "fmt/format.h"
+
+#include "text_template.hpp"
+
+namespace {
+
+/** The globals liluat lets templates use, made once per lua state and kept in the registry. */
+sol::table sandbox(sol::state_view lua) {
+    constexpr auto registry_key = "someone.text_template.sandbox";
+
+    sol::object cached = lua.registry()[registry_key];
+    if (cached.get_type() == sol::type::table)
+        return cached;
+
+    auto globals = lua.globals();
+    auto result = lua.create_table();
+    for (auto name : {
+        "ipairs", "next", "pairs", "rawequal", "rawget", "rawset", "select",
+        "tonumber", "tostring", "type", "unpack", "string", "table", "math", "coroutine"
+    }) {
+        result[name] = globals.get<sol::object>(name);
+    }
+
+    // Only the functions that tell the time, not the ones that touch the system
+    if (auto os = globals.get<sol::optional<sol::table>>("os")) {
+        result["os"] = lua.create_table_with(
+            "date", os->get<sol::object>("date"),
+            "difftime", os->get<sol::object>("difftime"),
+            "time", os->get<sol::object>("time")
+        );
+    }
+
+    lua.registry()[registry_key] = result;
+
+    return result;
+}
+
+}
+
+TextTemplate::TextTemplate(std::string_view source) : source(source), kind(Kind::Plain) {
+    size_t at = 0;
+    while (at < source.size()) {
+        auto tag_start = source.find(start_tag, at);
+        if (tag_start == std::string_view::npos) {
+            segments.push_back(Segment { source.substr(at), false });
+            break;
+        }
+
+        if (tag_start > at)
+            segments.push_back(Segment { source.substr(at, tag_start - at), false });
+
+        auto tag_end = source.find(end_tag, tag_start + start_tag.size());
+        auto inside = tag_start + start_tag.size();
+        // Anything but an expression (or a tag that doesn't end) is left for liluat to deal with
+        if (tag_end == std::string_view::npos || inside == tag_end || source[inside] != '=') {
+            kind = Kind::Code;
+            segments.clear();
+
+            return;
+        }
+
+        kind = Kind::Substitutions;
+        segments.push_back(Segment { source.substr(inside + 1, tag_end - inside - 1), true });
+
+        at = tag_end + end_tag.size();
+    }
+}
+
+std::string TextTemplate::render(sol::this_state lua, sol::table environment, std::string_view name) const {
+    if (kind == Kind::Code)
+        throw std::runtime_error(fmt::format("The text of {} has code in it and has to be rendered by liluat", name));
+
+    sol::state_view lua_view(lua);
+
+    if (compiled.empty()) {
+        compiled.resize(segments.size());
+
+        for (size_t i = 0; i < segments.size(); i++) {
+            if (!segments[i].expression)
+                continue;
+
+            sol::load_result chunk = lua_view.load(fmt::format("return {}", segments[i].text), std::string(name));
+            if (!chunk.valid()) {
+                compiled.clear();
+
+                sol::error err = chunk;
+                throw std::runtime_error(err.what());
+            }
+
+            compiled[i] = chunk;
+        }
+    }
+
+    // Same as liluat, the values of the environment are put over the sandboxed globals
+    auto combined = lua_view.create_table();
+    for (const auto &[key, value] : environment)
+        combined.raw_set(key, value);
+    combined[sol::metatable_key] = lua_view.create_table_with(sol::meta_function::index, sandbox(lua_view));
+
+    sol::environment env(combined);
+
+    std::string result;
+    for (size_t i = 0; i < segments.size(); i++) {
+        const auto &segment = segments[i];
+        if (!segment.expression) {
+            result += segment.text;
+            continue;
+        }
+
+        auto &expression = compiled[i];
+        // The environment can change between renders, so it's set every time
+        sol::set_environment(env, expression);
+
+        sol::protected_function_result value = expression();
+        if (!value.valid()) {
+            sol::error err = value;
+            throw std::runtime_error(err.what());
+        }
+
+        // Same as liluat, which concatenates the values with table.concat
+        sol::object object = value;
+        if (object.get_type() == sol::type::string) {
+            result += object.as<std::string_view>();
+        } else if (object.get_type() == sol::type::number) {
+            // Converted the way table.concat does it, which doesn't need tostring to be there
+            object.push(lua);
+            size_t length;
+            auto string = lua_tolstring(lua, -1, &length);
+            result.append(string, length);
+            lua_pop(lua, 1);
+        } else
+            throw std::runtime_error(fmt::format(
+                "<={}> in {} is a {}, not a string or a number", segment.text, name, sol::type_name(lua, object.get_type())
+            ));
+    }
+
+    return result;
+}
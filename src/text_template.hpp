@@ -0,0 +1,53 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <string_view>
+
+#include <sol/sol.hpp>
+
+/** Text of a story line, split into the literal parts and the <...> tags once, so it doesn't
+ *  have to go through the liluat template compiler every time the line is shown.
+ *
+ *  Text that only has <= expression > tags is rendered natively, with every expression
+ *  compiled the first time it's rendered. The expressions see the same sandboxed globals as in liluat,
+ *  with the environment over them. Text with code tags (<if ...>, <end> etc.) still needs liluat.
+ */
+class TextTemplate {
+public:
+    enum class Kind {
+        // No tags at all, the text is used as is
+        Plain,
+        // Only <= expression > tags
+        Substitutions,
+        // Has code, has to be compiled by liluat
+        Code
+    };
+
+    struct Segment {
+        std::string_view text;
+        // If true, the text is a lua expression whose value is inserted
+        bool expression;
+    };
+private:
+    std::string_view source;
+    Kind kind;
+
+    std::vector<Segment> segments;
+    // Compiled expressions of the segments, empty until the template is rendered for the first time
+    mutable std::vector<sol::protected_function> compiled;
+public:
+    static constexpr std::string_view start_tag = "<", end_tag = ">";
+
+    explicit TextTemplate(std::string_view source = {});
+
+    std::string_view get_source() const { return source; }
+    Kind get_kind() const { return kind; }
+    const std::vector<Segment> &get_segments() const { return segments; }
+
+    /** Inserts the values of the expressions, evaluated in the environment. The name is used in error messages.
+     *
+     *  Throws if the template has code tags or an expression can't be compiled or evaluated.
+     */
+    std::string render(sol::this_state lua, sol::table environment, std::string_view name) const;
+};
@@ -0,0 +1,74 @@
+#include <memory>
+#include <iostream>
+#include <filesystem>
+
+#include "SDL_gpu.h"
+
+#include "args.hxx"
+
+#include "logger.hpp"
+#include "raw_image.hpp"
+
+namespace fs = std::filesystem;
+
+// Makes raw images of the large images, like room backgrounds and environment images, so that the game
+// uploads them without decoding them. Smaller images load quickly enough, and are mostly in atlases anyway.
+int main(int argc, char **argv) {
+    args::ArgumentParser arg_parser("Someone - raw texture compiler");
+    arg_parser.helpParams.width = 100;
+    arg_parser.helpParams.showProglineOptions = false;
+
+    args::HelpFlag help(arg_parser, "help", "Display this help message", {'h', "help"});
+    args::ValueFlag<unsigned> min_size(
+        arg_parser, "pixels", "Images with neither side at least this large are left out", {"min-size"}, 512
+    );
+    args::Positional<std::string> input(arg_parser, "input", "Directory with the images", args::Options::Required);
+    args::Positional<std::string> output(
+        arg_parser, "output", "Where to write the raw images, the same directory as the game loads the images from",
+        args::Options::Required
+    );
+    try {
+        arg_parser.ParseCLI(argc, argv);
+    } catch (const args::Help&) {
+        std::cout << arg_parser;
+        return 0;
+    } catch (const args::Error &e) {
+        std::cerr << e.what() << std::endl;
+        std::cerr << arg_parser;
+
+        return 1;
+    }
+
+    fs::path input_root = args::get(input), output_root = args::get(output);
+
+    size_t written = 0;
+    try {
+        for (const auto &entry : fs::recursive_directory_iterator(input_root)) {
+            if (!entry.is_regular_file() || entry.path().extension() != ".png")
+                continue;
+
+            std::unique_ptr<SDL_Surface, decltype(&SDL_FreeSurface)> surface(
+                GPU_LoadSurface(entry.path().string().c_str()), SDL_FreeSurface
+            );
+            if (!surface) {
+                spdlog::warn("Skipping {}, couldn't load it: {}", entry.path().string(), GPU_PopErrorCode().details);
+                continue;
+            }
+
+            if ((unsigned)surface->w < args::get(min_size) && (unsigned)surface->h < args::get(min_size))
+                continue;
+
+            auto raw_path = RawImage::path_for(output_root / fs::relative(entry.path(), input_root));
+            fs::create_directories(raw_path.parent_path());
+
+            RawImage::write(raw_path, surface.get(), entry.path());
+            written++;
+        }
+    } catch (const std::exception &e) {
+        spdlog::error("{}", e.what());
+
+        return 1;
+    }
+
+    spdlog::info("Wrote {} raw images to {}", written, output_root.string());
+}
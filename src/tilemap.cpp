@@ -0,0 +1,397 @@
+#include <cmath>
+#include <array>
+#include <algorithm>
+#include <filesystem>
+#include <stdexcept>
+
+#include <zlib.h>
+#ifdef SOMEONE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "fmt/format.h"
+#include "yaml-cpp/yaml.h"
+
+#include "tilemap.hpp"
+
+namespace {
+
+constexpr uint8_t base64_whitespace = 0xFD, base64_padding = 0xFE, base64_invalid = 0xFF;
+
+constexpr std::array<uint8_t, 256> base64_table = [] {
+    std::array<uint8_t, 256> table {};
+    table.fill(base64_invalid);
+
+    const char *chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    for (uint8_t i = 0; i < 64; i++)
+        table[(uint8_t)chars[i]] = i;
+
+    for (char ch : { ' ', '\n', '\r', '\t' })
+        table[(uint8_t)ch] = base64_whitespace;
+    table[(uint8_t)'='] = base64_padding;
+
+    return table;
+}();
+
+/** Decodes base64 a piece at a time, so it can be fed straight into the decompressor. */
+class Base64Decoder {
+    const std::string &encoded;
+    size_t position = 0;
+
+    uint32_t bits = 0;
+    int bit_count = 0;
+public:
+    Base64Decoder(const std::string &encoded) : encoded(encoded) { }
+
+    bool finished() const { return position >= encoded.size(); }
+
+    /** Decodes as much as fits into out, returns the number of bytes written. */
+    size_t read(uint8_t *out, size_t capacity) {
+        size_t written = 0;
+
+        while (position < encoded.size() && written < capacity) {
+            // Most of the time there are four valid characters in a row, which make three bytes
+            if (bit_count == 0 && position + 4 <= encoded.size() && written + 3 <= capacity) {
+                uint8_t a = base64_table[(uint8_t)encoded[position]],
+                    b = base64_table[(uint8_t)encoded[position + 1]],
+                    c = base64_table[(uint8_t)encoded[position + 2]],
+                    d = base64_table[(uint8_t)encoded[position + 3]];
+
+                if ((a | b | c | d) < 64) {
+                    out[written++] = (a << 2) | (b >> 4);
+                    out[written++] = (b << 4) | (c >> 2);
+                    out[written++] = (c << 6) | d;
+
+                    position += 4;
+                    continue;
+                }
+            }
+
+            // Otherwise go one character at a time, skipping whitespace and stopping at the padding
+            uint8_t value = base64_table[(uint8_t)encoded[position++]];
+            if (value == base64_padding) {
+                position = encoded.size();
+                break;
+            }
+            if (value >= 64)
+                continue;
+
+            bits = (bits << 6) | value;
+            bit_count += 6;
+            if (bit_count >= 8) {
+                bit_count -= 8;
+                out[written++] = (bits >> bit_count) & 0xFF;
+            }
+        }
+
+        return written;
+    }
+};
+
+/** Decompression state that is kept between layers instead of being allocated for each one. */
+struct Decompressors {
+    z_stream zlib {};
+    bool zlib_initialized = false;
+
+#ifdef SOMEONE_ZSTD
+    ZSTD_DCtx *zstd = nullptr;
+#endif
+
+    z_stream &reset_zlib() {
+        if (!zlib_initialized) {
+            // 32 enables the automatic detection of zlib and gzip headers
+            if (inflateInit2(&zlib, MAX_WBITS + 32) != Z_OK)
+                throw std::runtime_error(fmt::format("Failed to initialize zlib: {}", zlib.msg ? zlib.msg : ""));
+            zlib_initialized = true;
+        } else {
+            inflateReset(&zlib);
+        }
+
+        return zlib;
+    }
+
+#ifdef SOMEONE_ZSTD
+    ZSTD_DCtx *reset_zstd() {
+        if (zstd == nullptr)
+            zstd = ZSTD_createDCtx();
+        else
+            ZSTD_DCtx_reset(zstd, ZSTD_reset_session_only);
+
+        return zstd;
+    }
+#endif
+
+    ~Decompressors() {
+        if (zlib_initialized)
+            inflateEnd(&zlib);
+#ifdef SOMEONE_ZSTD
+        if (zstd != nullptr)
+            ZSTD_freeDCtx(zstd);
+#endif
+    }
+};
+
+Decompressors &decompressors() {
+    thread_local Decompressors instance;
+    return instance;
+}
+
+/** JSON numbers are all the same to yaml-cpp, this keeps whole ones as integers in lua. */
+sol::object number_to_lua(sol::state_view &lua, const YAML::Node &node) {
+    double value = node.as<double>();
+    if (value == std::floor(value))
+        return sol::make_object(lua, (int64_t)value);
+
+    return sol::make_object(lua, value);
+}
+
+sol::object property_to_lua(sol::state_view &lua, const YAML::Node &node, const std::string &type) {
+    if (type == "bool")
+        return sol::make_object(lua, node.as<bool>());
+    if (type == "int" || type == "float")
+        return number_to_lua(lua, node);
+
+    return sol::make_object(lua, node.as<std::string>());
+}
+
+}
+
+void Tilemap::decode_layer_data(const std::string &encoded, const std::string &compression, size_t size, std::vector<uint32_t> &into) {
+    into.resize(size);
+
+    auto out = (uint8_t *)into.data();
+    size_t out_size = size * sizeof(uint32_t), written = 0;
+
+    Base64Decoder decoder(encoded);
+    // Base64 is decoded into this piece by piece and then decompressed, the whole decoded data is never stored
+    std::array<uint8_t, 16 * 1024> chunk;
+
+    if (compression.empty()) {
+        written = decoder.read(out, out_size);
+    } else if (compression == "zlib" || compression == "gzip") {
+        auto &stream = decompressors().reset_zlib();
+        stream.next_out = out;
+        stream.avail_out = out_size;
+
+        int status = Z_OK;
+        while (status == Z_OK && stream.avail_out > 0 && !decoder.finished()) {
+            stream.next_in = chunk.data();
+            stream.avail_in = decoder.read(chunk.data(), chunk.size());
+
+            while (stream.avail_in > 0 && stream.avail_out > 0 && status == Z_OK)
+                status = inflate(&stream, Z_NO_FLUSH);
+        }
+        if (status != Z_OK && status != Z_STREAM_END)
+            throw std::runtime_error(fmt::format("Failed to decompress tile layer data: {}", stream.msg ? stream.msg : zError(status)));
+
+        written = out_size - stream.avail_out;
+    } else if (compression == "zstd") {
+#ifdef SOMEONE_ZSTD
+        auto context = decompressors().reset_zstd();
+        ZSTD_outBuffer output { out, out_size, 0 };
+
+        while (output.pos < output.size && !decoder.finished()) {
+            ZSTD_inBuffer input { chunk.data(), decoder.read(chunk.data(), chunk.size()), 0 };
+
+            while (input.pos < input.size && output.pos < output.size) {
+                auto result = ZSTD_decompressStream(context, &output, &input);
+                if (ZSTD_isError(result))
+                    throw std::runtime_error(fmt::format("Failed to decompress tile layer data: {}", ZSTD_getErrorName(result)));
+            }
+        }
+
+        written = output.pos;
+#else
+        throw std::runtime_error("Tile layer is compressed with zstd, but zstd support is not built in");
+#endif
+    } else {
+        throw std::runtime_error(fmt::format("Unsupported tile layer compression: {}", compression));
+    }
+
+    // A truncated or badly encoded layer shouldn't load as a partly empty room
+    if (written != out_size)
+        throw std::runtime_error(fmt::format(
+            "Tile layer data has {} bytes, expected {} for {} tiles", written, out_size, size
+        ));
+}
+
+Tilemap Tilemap::load(sol::this_state lua_, const std::string &path) {
+    sol::state_view lua(lua_);
+
+    auto map_path = std::filesystem::path(path);
+    YAML::Node root = YAML::LoadFile(map_path.string());
+
+    Tilemap result;
+    result.width = root["width"].as<unsigned>();
+    result.height = root["height"].as<unsigned>();
+    result.tile_width = root["tilewidth"].as<unsigned>();
+    result.tile_height = root["tileheight"].as<unsigned>();
+
+    // Tile types by GID, to be put into the flat lookup when its size is known
+    std::vector<std::pair<uint32_t, std::string>> typed_gids;
+    uint32_t max_gid = 0;
+
+    for (const auto &tset_info : root["tilesets"]) {
+        TilemapTileset tileset;
+        tileset.first_gid = tset_info["firstgid"].as<uint32_t>();
+
+        // The tileset may be either in a separate file or embedded in the map
+        YAML::Node set = tset_info;
+        auto set_dir = map_path.parent_path();
+        if (tset_info["source"]) {
+            auto set_path = set_dir / tset_info["source"].as<std::string>();
+            set = YAML::LoadFile(set_path.string());
+            set_dir = set_path.parent_path();
+        }
+
+        tileset.name = set["name"].as<std::string>();
+        tileset.image = set["image"].as<std::string>();
+        tileset.image_path = (set_dir / tileset.image).lexically_normal().string();
+        tileset.tile_width = set["tilewidth"].as<unsigned>();
+        tileset.tile_height = set["tileheight"].as<unsigned>();
+        tileset.margin = set["margin"] ? set["margin"].as<unsigned>() : 0;
+        tileset.spacing = set["spacing"] ? set["spacing"].as<unsigned>() : 0;
+
+        // How many tiles fit along a side of the image, after the margins and between the spacing
+        auto tiles_along = [&](const char *image_side, unsigned tile_side) {
+            auto side = set[image_side].as<unsigned>();
+            if (side < 2 * tileset.margin + tile_side)
+                return 0u;
+            return (side - 2 * tileset.margin + tileset.spacing) / (tile_side + tileset.spacing);
+        };
+
+        tileset.columns = set["columns"]
+            ? set["columns"].as<unsigned>()
+            : tiles_along("imagewidth", tileset.tile_width);
+
+        uint32_t tile_count = set["tilecount"]
+            ? set["tilecount"].as<uint32_t>()
+            : tileset.columns * tiles_along("imageheight", tileset.tile_height);
+        max_gid = std::max(max_gid, tileset.first_gid + tile_count);
+
+        if (set["tiles"]) {
+            for (const auto &tile : set["tiles"]) {
+                // Newer Tiled versions call the type "class"
+                auto type_node = tile["type"] ? tile["type"] : tile["class"];
+                if (type_node)
+                    typed_gids.emplace_back(tileset.first_gid + tile["id"].as<uint32_t>(), type_node.as<std::string>());
+            }
+        }
+
+        result.tilesets.push_back(tileset);
+    }
+
+    std::sort(
+        result.tilesets.begin(), result.tilesets.end(),
+        [](const auto &a, const auto &b) { return a.first_gid < b.first_gid; }
+    );
+
+    result.gid_tilesets.resize(max_gid, 0);
+    result.gid_types.resize(max_gid);
+    for (size_t i = 0; i < result.tilesets.size(); i++) {
+        uint32_t from = result.tilesets[i].first_gid;
+        uint32_t to = i + 1 < result.tilesets.size() ? result.tilesets[i + 1].first_gid : max_gid;
+
+        std::fill(result.gid_tilesets.begin() + from, result.gid_tilesets.begin() + to, i + 1);
+    }
+    for (auto &[gid, type] : typed_gids) {
+        if (gid < max_gid)
+            result.gid_types[gid] = type;
+    }
+
+    for (const auto &layer_node : root["layers"]) {
+        TilemapLayer layer;
+        layer.name = layer_node["name"] ? layer_node["name"].as<std::string>() : "";
+        layer.type = layer_node["type"].as<std::string>();
+
+        if (layer.type == "tilelayer") {
+            layer.width = layer_node["width"].as<unsigned>();
+            layer.height = layer_node["height"].as<unsigned>();
+
+            auto data_node = layer_node["data"];
+            if (data_node.IsSequence()) {
+                layer.data = data_node.as<std::vector<uint32_t>>();
+            } else {
+                auto compression = layer_node["compression"] ? layer_node["compression"].as<std::string>() : "";
+                decode_layer_data(data_node.as<std::string>(), compression, layer.width * layer.height, layer.data);
+            }
+
+            for (size_t n = 0; n < layer.data.size(); n++) {
+                uint32_t gid = layer.data[n] & ~flags_mask;
+                if (gid == 0 || gid >= max_gid || result.gid_types[gid].empty())
+                    continue;
+
+                layer.typed_tiles.push_back(TilemapTypedTile {
+                    (unsigned)(n % layer.width),
+                    (unsigned)(n / layer.width),
+                    gid,
+                    (uint8_t)((layer.data[n] & (flipped_horizontally_flag | flipped_vertically_flag | flipped_diagonally_flag)) >> 29),
+                    result.gid_tilesets[gid],
+                    result.frame_of(gid),
+                    result.gid_types[gid]
+                });
+            }
+        } else if (layer.type == "objectgroup") {
+            layer.objects = lua.create_table();
+
+            for (const auto &obj : layer_node["objects"]) {
+                auto props = lua.create_table();
+                if (obj["properties"]) {
+                    for (const auto &prop : obj["properties"]) {
+                        auto type = prop["type"] ? prop["type"].as<std::string>() : "string";
+                        props[prop["name"].as<std::string>()] = property_to_lua(lua, prop["value"], type);
+                    }
+                }
+
+                auto lua_obj = lua.create_table_with(
+                    "x", number_to_lua(lua, obj["x"]),
+                    "y", number_to_lua(lua, obj["y"]),
+                    "width", obj["width"] ? number_to_lua(lua, obj["width"]) : sol::make_object(lua, 0),
+                    "height", obj["height"] ? number_to_lua(lua, obj["height"]) : sol::make_object(lua, 0),
+                    "properties", props
+                );
+                if (obj["name"])
+                    lua_obj["name"] = obj["name"].as<std::string>();
+                if (obj["gid"])
+                    lua_obj["gid"] = obj["gid"].as<uint32_t>();
+
+                layer.objects.add(lua_obj);
+            }
+        }
+
+        result.layers.push_back(std::move(layer));
+    }
+
+    return result;
+}
+
+uint16_t Tilemap::tileset_of(uint32_t gid) const {
+    gid &= ~flags_mask;
+
+    return gid < gid_tilesets.size() ? gid_tilesets[gid] : 0;
+}
+
+sf::IntRect Tilemap::frame_of(uint32_t gid) const {
+    auto tileset_index = tileset_of(gid);
+    if (tileset_index == 0)
+        return sf::IntRect(0, 0, 0, 0);
+
+    gid &= ~flags_mask;
+
+    auto &set = tilesets[tileset_index - 1];
+    auto id = gid - set.first_gid;
+
+    return sf::IntRect(
+        set.margin + (id % set.columns) * (set.tile_width + set.spacing),
+        set.margin + (id / set.columns) * (set.tile_height + set.spacing),
+        set.tile_width, set.tile_height
+    );
+}
+
+const std::string &Tilemap::type_of(uint32_t gid) const {
+    static const std::string no_type;
+
+    gid &= ~flags_mask;
+
+    return gid < gid_types.size() ? gid_types[gid] : no_type;
+}
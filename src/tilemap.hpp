@@ -0,0 +1,78 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "SFML/System/Rect.hpp"
+
+#include <sol/sol.hpp>
+
+struct TilemapTileset {
+    std::string name;
+    // The image as written in the tileset and the path to it relative to the working directory
+    std::string image, image_path;
+    uint32_t first_gid;
+    unsigned tile_width, tile_height, columns;
+    // Pixels around the tiles at the image edges and between neighbouring tiles
+    unsigned margin = 0, spacing = 0;
+};
+
+/** A tile that has a type (e.g. Wall or Player), these are the only tiles that need to be entities. */
+struct TilemapTypedTile {
+    unsigned x, y;
+    uint32_t gid;
+    // Flip flags shifted to the lowest bits: 4 = horizontal, 2 = vertical, 1 = diagonal
+    uint8_t flips;
+    // 1-based index of the tileset
+    uint16_t tileset;
+    sf::IntRect frame;
+    std::string type;
+};
+
+struct TilemapLayer {
+    std::string name, type;
+    unsigned width = 0, height = 0;
+
+    // GIDs of the layer, row by row, with the flip flags still in place
+    std::vector<uint32_t> data;
+    std::vector<TilemapTypedTile> typed_tiles;
+
+    // Object group objects, with properties converted to a name -> value table
+    sol::table objects;
+};
+
+class Tilemap {
+    // Flat lookups by GID, the index into the tileset is 1-based so that 0 means there's no such tile
+    std::vector<uint16_t> gid_tilesets;
+    std::vector<std::string> gid_types;
+
+public:
+    static constexpr uint32_t flipped_horizontally_flag = 0x80000000;
+    static constexpr uint32_t flipped_vertically_flag = 0x40000000;
+    static constexpr uint32_t flipped_diagonally_flag = 0x20000000;
+    static constexpr uint32_t rotated_hexagonal_120_flag = 0x10000000;
+    static constexpr uint32_t flags_mask =
+        flipped_horizontally_flag | flipped_vertically_flag | flipped_diagonally_flag | rotated_hexagonal_120_flag;
+
+    unsigned width = 0, height = 0, tile_width = 0, tile_height = 0;
+
+    std::vector<TilemapTileset> tilesets;
+    std::vector<TilemapLayer> layers;
+
+    static Tilemap load(sol::this_state lua, const std::string &path);
+
+    /** Decodes base64 encoded and possibly compressed (zlib, gzip or zstd) layer data into size GIDs.
+     *  Throws if the data can't be decoded or doesn't have exactly size GIDs in it.
+     *
+     *  The data is written straight into the passed vector, so its memory can be reused.
+     */
+    static void decode_layer_data(const std::string &encoded, const std::string &compression, size_t size, std::vector<uint32_t> &into);
+
+    /** 1-based tileset index of the tile, or 0 if there's no such tile. Flip flags are ignored. */
+    uint16_t tileset_of(uint32_t gid) const;
+    /** Rectangle of the tile in its tileset image. */
+    sf::IntRect frame_of(uint32_t gid) const;
+    /** Type of the tile, empty if it has none. */
+    const std::string &type_of(uint32_t gid) const;
+};
@@ -1,11 +1,16 @@
 #include <filesystem>
 #include <numeric>
 
-#include <zlib.h>
-
 #include "story_parser.hpp"
 #include "usertypes.hpp"
 #include "line_data.hpp"
+#include "tilemap.hpp"
+#include "room_manifest.hpp"
+#include "collision_world.hpp"
+#include "profiler.hpp"
+#include "asset_loader.hpp"
+#include "asset_cache.hpp"
+#include "logger.hpp"
 
 #include "toml.hpp"
 
@@ -36,6 +41,95 @@ void register_usertypes(sol::state &lua, StaticFonts &fonts) {
         "font_size", sol::var(std::ref(fonts.font_size))
     );
 
+    // Same names as in bump, so it can be used the same way
+    auto collision_world_type = lua.new_usertype<CollisionWorld>(
+        "CollisionWorld", sol::constructors<CollisionWorld(), CollisionWorld(double)>(),
+        "add", &CollisionWorld::add,
+        "update", &CollisionWorld::update,
+        "remove", &CollisionWorld::remove,
+        "hasItem", &CollisionWorld::has_item,
+        "getRect", &CollisionWorld::get_rect,
+        "queryRect", &CollisionWorld::query_rect,
+        "queryPoint", &CollisionWorld::query_point,
+        "check", &CollisionWorld::check,
+        "set_response", &CollisionWorld::set_response
+    );
+    auto collision_response_enum = lua.new_enum(
+        "CollisionResponse",
+        "Slide", CollisionWorld::Response::Slide,
+        "Cross", CollisionWorld::Response::Cross,
+        "Touch", CollisionWorld::Response::Touch
+    );
+
+    lua["Profiler"] = lua.create_table_with(
+        "begin_scope", [](const std::string &name) { someone::Profiler::instance().begin(name); },
+        "end_scope", []() { someone::Profiler::instance().end(); },
+        "export_trace", [](const std::string &path) { return someone::Profiler::instance().export_chrome_trace(path); }
+    );
+
+    // Lua logs to the same place as everything else instead of stdout
+    lua["logger"] = lua.create_table_with(
+        "debug", [](const std::string &message) { spdlog::debug("{}", message); },
+        "info", [](const std::string &message) { spdlog::info("{}", message); },
+        "warn", [](const std::string &message) { spdlog::warn("{}", message); },
+        "error", [](const std::string &message) { spdlog::error("{}", message); }
+    );
+
+    auto asset_request_type = lua.new_usertype<someone::AssetRequest>(
+        "AssetRequest",
+        "path", sol::property(&someone::AssetRequest::get_path),
+        "ready", sol::property(&someone::AssetRequest::is_ready),
+        "done", sol::property(&someone::AssetRequest::is_done),
+        "failed", sol::property(&someone::AssetRequest::is_failed),
+        "cancelled", sol::property(&someone::AssetRequest::is_cancelled),
+        "texture", sol::property(&someone::AssetRequest::get_texture),
+        "sound_buffer", sol::property(&someone::AssetRequest::get_sound_buffer),
+        "wait", [](someone::AssetRequest &request) { someone::AssetLoader::instance().wait(request); },
+        "cancel", &someone::AssetRequest::cancel
+    );
+
+    lua["AssetLoader"] = lua.create_table_with(
+        "load_texture", [](const std::string &path, sol::optional<std::string> cache_key) {
+            return someone::AssetLoader::instance().load_texture(path, cache_key.value_or(""));
+        },
+        "load_sound", [](const std::string &path, sol::optional<std::string> cache_key) {
+            return someone::AssetLoader::instance().load_sound(path, cache_key.value_or(""));
+        },
+        "pending", []() { return someone::AssetLoader::instance().pending(); }
+    );
+
+    // Asset types are named the same as in assets.lua
+    lua["AssetCache"] = lua.create_table_with(
+        "get_texture", [](const std::string &key) { return someone::AssetCache::instance().get_texture(key); },
+        "get_sound_buffer", [](const std::string &key) { return someone::AssetCache::instance().get_sound_buffer(key); },
+        "add_texture", [](const std::string &key, std::shared_ptr<sf::Texture> texture) {
+            someone::AssetCache::instance().add_texture(key, std::move(texture));
+        },
+        "add_sound_buffer", [](const std::string &key, std::shared_ptr<someone::SoundBuffer> sound_buffer) {
+            someone::AssetCache::instance().add_sound_buffer(key, std::move(sound_buffer));
+        },
+        "contains", [](const std::string &type, const std::string &key) {
+            auto &cache = someone::AssetCache::instance();
+            return cache.contains(cache.type_of(type), key);
+        },
+        "acquire", [](const std::string &type, const std::string &key) {
+            auto &cache = someone::AssetCache::instance();
+            return cache.acquire(cache.type_of(type), key);
+        },
+        "release", [](const std::string &type, uint64_t reference) {
+            auto &cache = someone::AssetCache::instance();
+            cache.release(cache.type_of(type), reference);
+        },
+        "remove", [](const std::string &type, const std::string &key) {
+            auto &cache = someone::AssetCache::instance();
+            cache.remove(cache.type_of(type), key);
+        },
+        "set_budget", [](const std::string &type, size_t bytes) {
+            auto &cache = someone::AssetCache::instance();
+            cache.set_budget(cache.type_of(type), bytes);
+        }
+    );
+
     lua["TOML"] = lua.create_table_with(
         "parse", &parse_toml,
         "encode", [](sol::this_state lua_, sol::object obj) { return encode_toml(lua_, obj); },
@@ -53,6 +147,19 @@ void register_usertypes(sol::state &lua, StaticFonts &fonts) {
         "font_size", sol::readonly(&CharacterConfig::font_size)
     );
 
+    auto text_template_type = lua.new_usertype<TextTemplate>(
+        "TextTemplate",
+        "source", sol::property(&TextTemplate::get_source),
+        "kind", sol::property(&TextTemplate::get_kind),
+        "render", &TextTemplate::render
+    );
+    auto text_template_kind_enum = lua.new_enum(
+        "TextTemplateKind",
+        "Plain", TextTemplate::Kind::Plain,
+        "Substitutions", TextTemplate::Kind::Substitutions,
+        "Code", TextTemplate::Kind::Code
+    );
+
     auto term_line_type = lua.new_usertype<TerminalLineData>(
         "TerminalLineData",
         "character_config", sol::readonly(&TerminalLineData::character_config),
@@ -63,6 +170,7 @@ void register_usertypes(sol::state &lua, StaticFonts &fonts) {
         "TerminalOutputLineData",
         sol::base_classes, sol::bases<TerminalLineData>(),
         "text", sol::readonly(&TerminalOutputLineData::text),
+        "text_template", sol::readonly(&TerminalOutputLineData::text_template),
         "next", sol::readonly(&TerminalOutputLineData::next)
     );
 
@@ -76,6 +184,7 @@ void register_usertypes(sol::state &lua, StaticFonts &fonts) {
     auto term_variant_variant_type = lua.new_usertype<Variant>(
         "TerminalVariantInputLineDataVariant",
         "text", sol::readonly(&Variant::text),
+        "text_template", sol::readonly(&Variant::text_template),
         "next", sol::readonly(&Variant::next),
         "condition", sol::readonly(&Variant::condition)
     );
@@ -91,6 +200,8 @@ void register_usertypes(sol::state &lua, StaticFonts &fonts) {
         sol::base_classes, sol::bases<TerminalLineData>(),
         "before", sol::readonly(&TerminalTextInputLineData::before),
         "after", sol::readonly(&TerminalTextInputLineData::after),
+        "before_template", sol::readonly(&TerminalTextInputLineData::before_template),
+        "after_template", sol::readonly(&TerminalTextInputLineData::after_template),
         "variable", sol::readonly(&TerminalTextInputLineData::variable),
         "max_length", sol::readonly(&TerminalTextInputLineData::max_length),
         "filters", sol::readonly(&TerminalTextInputLineData::filters),
@@ -121,66 +232,78 @@ void register_usertypes(sol::state &lua, StaticFonts &fonts) {
             return result;
         }
     );
-    lua["decode_base64_and_decompress_zlib"] = [](const std::string &encoded, int dataSize) {
-        auto base64_decode = [](std::string const& encoded_string) {
-            static const std::string base64_chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-            auto is_base64 = [](unsigned char c) { return (isalnum(c) || (c == '+') || (c == '/')); };
-
-            int in_len = encoded_string.size();
-            int i = 0;
-            int j = 0;
-            int in_ = 0;
-            unsigned char char_array_4[4], char_array_3[3];
-            std::vector<unsigned char> ret;
-
-            while (in_len-- && ( encoded_string[in_] != '=') && is_base64(encoded_string[in_])) {
-                char_array_4[i++] = encoded_string[in_]; in_++;
-                if (i ==4) {
-                    for (i = 0; i <4; i++)
-                        char_array_4[i] = base64_chars.find(char_array_4[i]);
-
-                    char_array_3[0] = (char_array_4[0] << 2) + ((char_array_4[1] & 0x30) >> 4);
-                    char_array_3[1] = ((char_array_4[1] & 0xf) << 4) + ((char_array_4[2] & 0x3c) >> 2);
-                    char_array_3[2] = ((char_array_4[2] & 0x3) << 6) + char_array_4[3];
-
-                    for (i = 0; (i < 3); i++)
-                        ret.push_back(char_array_3[i]);
-                    i = 0;
-                }
-            }
-
-            if (i) {
-                for (j = i; j <4; j++)
-                    char_array_4[j] = 0;
-
-                for (j = 0; j <4; j++)
-                    char_array_4[j] = base64_chars.find(char_array_4[j]);
-
-                char_array_3[0] = (char_array_4[0] << 2) + ((char_array_4[1] & 0x30) >> 4);
-                char_array_3[1] = ((char_array_4[1] & 0xf) << 4) + ((char_array_4[2] & 0x3c) >> 2);
-                char_array_3[2] = ((char_array_4[2] & 0x3) << 6) + char_array_4[3];
-
-                for (j = 0; (j < i - 1); j++) ret.push_back(char_array_3[j]);
-            }
-
-            return ret;
-        };
+    auto tilemap_tileset_type = lua.new_usertype<TilemapTileset>(
+        "TilemapTileset",
+        "name", sol::readonly(&TilemapTileset::name),
+        "image", sol::readonly(&TilemapTileset::image),
+        "image_path", sol::readonly(&TilemapTileset::image_path),
+        "first_gid", sol::readonly(&TilemapTileset::first_gid),
+        "tile_width", sol::readonly(&TilemapTileset::tile_width),
+        "tile_height", sol::readonly(&TilemapTileset::tile_height),
+        "columns", sol::readonly(&TilemapTileset::columns),
+        "margin", sol::readonly(&TilemapTileset::margin),
+        "spacing", sol::readonly(&TilemapTileset::spacing)
+    );
 
-        auto decoded = base64_decode(encoded);
-        uint32_t decodedSize = decoded.size();
+    auto tilemap_typed_tile_type = lua.new_usertype<TilemapTypedTile>(
+        "TilemapTypedTile",
+        "x", sol::readonly(&TilemapTypedTile::x),
+        "y", sol::readonly(&TilemapTypedTile::y),
+        "gid", sol::readonly(&TilemapTypedTile::gid),
+        "flipped_horizontally", sol::property([](TilemapTypedTile &tile) { return (tile.flips & 4) != 0; }),
+        "flipped_vertically", sol::property([](TilemapTypedTile &tile) { return (tile.flips & 2) != 0; }),
+        "flipped_diagonally", sol::property([](TilemapTypedTile &tile) { return (tile.flips & 1) != 0; }),
+        "tileset", sol::readonly(&TilemapTypedTile::tileset),
+        "frame", sol::readonly(&TilemapTypedTile::frame),
+        "type", sol::readonly(&TilemapTypedTile::type)
+    );
 
-        uLongf decompressedSize = dataSize * sizeof(uint32_t);
+    auto tilemap_layer_type = lua.new_usertype<TilemapLayer>(
+        "TilemapLayer",
+        "name", sol::readonly(&TilemapLayer::name),
+        "type", sol::readonly(&TilemapLayer::type),
+        "width", sol::readonly(&TilemapLayer::width),
+        "height", sol::readonly(&TilemapLayer::height),
+        // Pushed by reference, so lua indexes the loaded data directly instead of a copy
+        "data", sol::readonly(&TilemapLayer::data),
+        "typed_tiles", sol::readonly(&TilemapLayer::typed_tiles),
+        "objects", sol::readonly(&TilemapLayer::objects)
+    );
 
-        std::vector<Bytef> decompressedData(decompressedSize);
-        uncompress(decompressedData.data(), &decompressedSize,
-                   (const Bytef*)decoded.data(), decodedSize);
+    auto tilemap_type = lua.new_usertype<Tilemap>(
+        "Tilemap",
+        "load", &Tilemap::load,
+        // The vector is moved into a userdata, lua sees it as an array without it being converted to a table
+        "decode_layer_data", [](const std::string &encoded, const std::string &compression, size_t size) {
+            std::vector<uint32_t> data;
+            Tilemap::decode_layer_data(encoded, compression, size, data);
+
+            return data;
+        },
+        "width", sol::readonly(&Tilemap::width),
+        "height", sol::readonly(&Tilemap::height),
+        "tile_width", sol::readonly(&Tilemap::tile_width),
+        "tile_height", sol::readonly(&Tilemap::tile_height),
+        "tilesets", sol::readonly(&Tilemap::tilesets),
+        "layers", sol::readonly(&Tilemap::layers),
+        "tileset_of", &Tilemap::tileset_of,
+        "frame_of", &Tilemap::frame_of,
+        "type_of", &Tilemap::type_of
+    );
 
-        std::vector<uint32_t> data;
-        data.reserve(dataSize);
-        auto tileIds = (uint32_t*)decompressedData.data();
-        for (auto i = 0; i < dataSize; i++)
-            data.push_back(tileIds[i]);
+    auto room_manifest_file_type = lua.new_usertype<RoomManifestFile>(
+        "RoomManifestFile",
+        "key", sol::readonly(&RoomManifestFile::key),
+        "path", sol::readonly(&RoomManifestFile::path)
+    );
 
-        return data;
-    };
+    auto room_manifest_type = lua.new_usertype<RoomManifest>(
+        "RoomManifest",
+        "load", &RoomManifest::load,
+        "textures", sol::readonly(&RoomManifest::textures),
+        "sounds", sol::readonly(&RoomManifest::sounds),
+        "shaders", sol::readonly(&RoomManifest::shaders),
+        "texture_files", sol::readonly(&RoomManifest::texture_files),
+        "adjacent_rooms", sol::readonly(&RoomManifest::adjacent_rooms)
+    );
 }
@@ -8,6 +8,7 @@
 #include "SFML/Graphics/Color.hpp"
 #include "SFML/Graphics/RectangleShape.hpp"
 #include "SFML/Graphics/Texture.hpp"
+#include "SFML/Graphics/TileLayer.hpp"
 #include "SFML/Graphics/RenderTarget.hpp"
 #include "SFML/Graphics/Transformable.hpp"
 #include "SFML/Graphics/View.hpp"
@@ -175,7 +176,13 @@ void register_sfml_usertypes(sol::state &lua, StaticFonts &fonts) {
 
     auto drawable_type = lua.new_usertype<sf::Drawable>("Drawable");
 
-    auto font_type = lua.new_usertype<sf::Font>("Font");
+    auto font_type = lua.new_usertype<sf::Font>(
+        "Font",
+        "measure", [](sf::Font &font, const std::string &text, unsigned int size, unsigned int wrap_width) {
+            return sf::Vector2f(font.measureWrapped(text, size, wrap_width));
+        },
+        "wrap", [](sf::Font &, const std::string &text, unsigned int wrap_width) { return sf::Font::wrap(text, wrap_width); }
+    );
 
     auto text_type = lua.new_usertype<sf::Text>(
         "Text", sol::constructors<sf::Text(const std::string&, sf::Font&, unsigned int)>(),
@@ -190,6 +197,17 @@ void register_sfml_usertypes(sol::state &lua, StaticFonts &fonts) {
         "character_size", sol::property(&sf::Text::getCharacterSize, &sf::Text::setCharacterSize)
     );
 
+    auto progressive_text_type = lua.new_usertype<sf::ProgressiveText>(
+        "ProgressiveText", sol::constructors<sf::ProgressiveText(const std::string&, sf::Font&, unsigned int)>(),
+        sol::base_classes, sol::bases<sf::Text, sf::Drawable, sf::Transformable>(),
+        "string", sol::property(
+            [](sf::ProgressiveText &self) { return self.getFullString(); },
+            [](sf::ProgressiveText &self, std::string str) { return self.setFullString(str); }
+        ),
+        "wrap_width", sol::property(&sf::ProgressiveText::getWrapWidth, &sf::ProgressiveText::setWrapWidth),
+        "visible_length", sol::property(&sf::ProgressiveText::getVisibleLength, &sf::ProgressiveText::setVisibleLength)
+    );
+
     auto text_style_enum = lua.new_enum(
         "TextStyle",
         "Regular", sf::Text::Regular,
@@ -221,6 +239,7 @@ void register_sfml_usertypes(sol::state &lua, StaticFonts &fonts) {
     auto texture_type = lua.new_usertype<sf::Texture>(
         "Texture", sol::constructors<sf::Texture()>(),
         "load_from_file", [](sf::Texture &texture, const std::string filename) { texture.loadFromFile(filename); },
+        "from_region", &sf::Texture::fromRegion,
         "size", sol::property(&sf::Texture::getSize)
     );
 
@@ -238,6 +257,20 @@ void register_sfml_usertypes(sol::state &lua, StaticFonts &fonts) {
         "size", sol::property(&sf::NineSliceSprite::getSize, &sf::NineSliceSprite::setSize)
     );
 
+    auto tile_layer_type = lua.new_usertype<sf::TileLayer>(
+        "TileLayer", sol::constructors<sf::TileLayer(unsigned, unsigned, unsigned, unsigned)>(),
+        sol::base_classes, sol::bases<sf::Drawable, sf::Transformable>(),
+        "add_tileset", &sf::TileLayer::addTileset,
+        "bake", [](sf::TileLayer &layer, const std::vector<uint32_t> &gids, sol::table skipped) {
+            std::unordered_set<uint32_t> skippedGids;
+            for (auto &[gid, _] : skipped)
+                skippedGids.insert(gid.as<uint32_t>());
+
+            layer.bake(gids, skippedGids);
+        },
+        "chunk_count", sol::property(&sf::TileLayer::getChunkCount)
+    );
+
     auto event_type = lua.new_usertype<sf::Event>(
         "Event",
         "type", sol::readonly(&sf::Event::type),
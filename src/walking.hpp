@@ -1,6 +1,10 @@
 #pragma once
 
-#include <map>
+#include <tuple>
+#include <memory>
+#include <vector>
+#include <optional>
+#include <algorithm>
 
 #include "SFML/System/Vector2.hpp"
 #include "SFML/Graphics/RenderTexture.hpp"
@@ -18,8 +22,211 @@ private:
     sol::table shaders;
 
     sf::RenderTexture shaders_texture;
+
+    /** A uniform of a room shader. Values that come from lua functions are set again every frame. */
+    struct ShaderParam {
+        enum class Type {
+            Float,
+            Vector
+        };
+
+        std::string name;
+        int location;
+
+        Type type = Type::Float;
+        // Floats only use x
+        sf::Vector2f value;
+
+        std::optional<sol::protected_function> dynamic;
+
+        /** Returns false if the value is not a float or a vector of two numbers. */
+        bool set(const sol::object &obj) {
+            if (obj.is<float>()) {
+                type = Type::Float;
+                value.x = obj.as<float>();
+
+                return true;
+            } else if (obj.get_type() == sol::type::table) {
+                auto tbl = obj.as<sol::table>();
+                if (tbl.size() == 2) {
+                    type = Type::Vector;
+                    value = sf::Vector2f(tbl.get<float>(1), tbl.get<float>(2));
+
+                    return true;
+                }
+            }
+
+            return false;
+        }
+    };
+
+    /** A room shader, they are drawn in the order of n.
+     *
+     *  Overlay shaders (the default) are blended over the image. Post-process shaders, with mode = "post"
+     *  in the room's shaders table, sample the image made by everything before them through currentTexture
+     *  and replace it. They can draw into a smaller target with e.g. scale = 0.5, which is useful for blurs.
+     */
+    struct ShaderPass {
+        enum class Mode {
+            Overlay,
+            Post
+        };
+
+        std::string name;
+        int32_t n;
+        Mode mode = Mode::Overlay;
+        float scale = 1.0f;
+
+        sf::Shader *shader;
+        std::optional<int> screen_size_location;
+        // Size of the image that a post-process shader samples, set if the shader has an inputSize uniform
+        std::optional<int> input_size_location;
+
+        // Only for post-process shaders with a scale other than 1
+        std::unique_ptr<sf::RenderTexture> scaled_target;
+
+        bool enabled = true;
+        std::optional<sol::protected_function> enabled_f;
+
+        std::vector<ShaderParam> params;
+    };
+
+    std::vector<ShaderPass> shader_passes;
+    // Set when the room shaders change, the passes are compiled again before drawing
+    bool shader_passes_dirty = true;
+    // Overlays after the last post-process shader are drawn right onto the window
+    std::optional<size_t> last_post_pass;
+
+    // Post-process shaders draw into one of these, sampling the other one
+    sf::RenderTexture ping_pong[2];
+
+    /** Picks the texture a post-process shader draws into, which can't be the one it samples. */
+    sf::RenderTexture &post_pass_target(ShaderPass &pass, sf::RenderTexture *input, sf::Vector2u screen_size) {
+        if (pass.scale == 1.0f)
+            return input == &ping_pong[0] ? ping_pong[1] : ping_pong[0];
+
+        sf::Vector2u size(
+            std::max(1u, (unsigned)(screen_size.x * pass.scale)), std::max(1u, (unsigned)(screen_size.y * pass.scale))
+        );
+        if (!pass.scaled_target)
+            pass.scaled_target = std::make_unique<sf::RenderTexture>();
+        if (pass.scaled_target->getSize() != size) {
+            pass.scaled_target->create(size.x, size.y);
+            // Scaled images are stretched back up, so they shouldn't be blocky
+            GPU_SetImageFilter(pass.scaled_target->getTexture().texture, GPU_FILTER_LINEAR);
+        }
+
+        return *pass.scaled_target;
+    }
+
+    /** Resolves the shaders, uniform locations and parameter types of the room shaders,
+     *  so that drawing them doesn't need to look anything up.
+     */
+    void compile_shader_passes() {
+        shader_passes.clear();
+        shader_passes_dirty = false;
+        last_post_pass.reset();
+
+        sol::table shaders_data = call_or_throw(room_shaders_f);
+        for (auto &[key, value] : shaders_data) {
+            if (key.get_type() != sol::type::string || value.get_type() != sol::type::table)
+                continue;
+
+            auto shader_name = key.as<std::string>();
+            sol::table shader_data = value;
+
+            sol::optional<sol::table> shader_tbl = shaders[shader_name];
+            if (!shader_tbl)
+                continue;
+
+            ShaderPass pass;
+            pass.name = shader_name;
+            pass.n = shader_data.get_or("n", 0);
+            pass.shader = (*shader_tbl)["shader"];
+
+            if (sol::optional<bool> need_screen_size = (*shader_tbl)["need_screen_size"]; need_screen_size && *need_screen_size)
+                pass.screen_size_location = pass.shader->getUniformLocation("screenSize");
+            if (auto location = pass.shader->getUniformLocation("inputSize"); location >= 0)
+                pass.input_size_location = location;
+
+            // Parameters described as functions are compiled into the metatable
+            sol::optional<sol::table> compiled = shader_data[sol::metatable_key];
+
+            auto compiled_function = [&](const std::string &name) -> std::optional<sol::protected_function> {
+                if (!compiled)
+                    return std::nullopt;
+
+                sol::optional<sol::protected_function> function = (*compiled)[name + "_compiled"];
+                if (!function)
+                    return std::nullopt;
+
+                return *function;
+            };
+
+            for (auto &[param_key, param_value] : shader_data) {
+                auto name = param_key.as<std::string>();
+
+                if (name == "n")
+                    continue;
+
+                if (name == "mode") {
+                    auto mode = param_value.as<std::string>();
+                    if (mode == "post")
+                        pass.mode = ShaderPass::Mode::Post;
+                    else if (mode != "overlay")
+                        spdlog::error("Unknown mode {} of shader {}, expected overlay or post", mode, shader_name);
+
+                    continue;
+                }
+                if (name == "scale") {
+                    pass.scale = std::clamp(param_value.as<float>(), 0.01f, 1.0f);
+
+                    continue;
+                }
+
+                if (name == "enabled") {
+                    pass.enabled_f = compiled_function(name);
+                    if (!pass.enabled_f)
+                        pass.enabled = param_value.as<bool>();
+
+                    continue;
+                }
+
+                ShaderParam param;
+                param.name = name;
+                param.location = pass.shader->getUniformLocation(name);
+                param.dynamic = compiled_function(name);
+
+                if (!param.dynamic && !param.set(param_value)) {
+                    spdlog::error("Parameter {} of unknown type in shader {}", name, shader_name);
+
+                    continue;
+                }
+
+                pass.params.push_back(std::move(param));
+            }
+
+            shader_passes.push_back(std::move(pass));
+        }
+
+        // Sort the shaders based on the N value, lower going first
+        std::sort(shader_passes.begin(), shader_passes.end(), [](const auto &lhs, const auto &rhs) {
+            return std::tie(lhs.n, lhs.name) < std::tie(rhs.n, rhs.name);
+        });
+
+        last_post_pass.reset();
+        for (size_t i = 0; i < shader_passes.size(); i++) {
+            if (shader_passes[i].mode == ShaderPass::Mode::Post)
+                last_post_pass = i;
+        }
+    }
 public:
     WalkingEnv(sol::state &lua) : LuaModuleEnv(lua) {
+        lua["ShaderPasses"] = lua.create_table_with(
+            // Called when the room shaders change outside of loading a room, e.g. from the debug menu
+            "invalidate", [this]() { shader_passes_dirty = true; }
+        );
+
         // This both defines a global for the module and returns it
         module = lua.require_script("WalkingModule", "return require('walking')");
 
@@ -59,9 +266,6 @@ public:
     }
 
     void draw_target_to_window(sf::RenderWindow &target_window, sf::RenderTexture &final_sprite) {
-        // First, draw the actual sprite
-        target_window.draw(final_sprite);
-
         // If the texture is not the same size as the window, recreate it.
         // This will also create it the first time it's used and is not yet initialized;
         auto screen_size = target_window.getSize();
@@ -70,88 +274,93 @@ public:
         }
         shaders_texture.clear(sf::Color::Transparent);
 
-        auto shaders_data_obj = call_or_throw(room_shaders_f);
-        auto shaders_data = shaders_data_obj.get<std::map<std::string, std::map<std::string, sol::object>>>();
+        if (shader_passes_dirty)
+            compile_shader_passes();
 
-        // Sort the shaders based on the N value, lower going first
-        std::vector<std::pair<std::string, std::map<std::string, sol::object>>> sorted_shaders;
-        std::copy(shaders_data.begin(), shaders_data.end(), std::back_inserter(sorted_shaders));
-        std::sort(
-            sorted_shaders.begin(),
-            sorted_shaders.end(),
-            [](auto &lhs, auto &rhs) {
-                return lhs.second["n"].template as<int32_t>() < rhs.second["n"].template as<int32_t>();
+        if (last_post_pass) {
+            for (auto &texture : ping_pong) {
+                if (texture.getSize() != screen_size)
+                    texture.create(screen_size.x, screen_size.y);
             }
-        );
-
-        // Then, draw the shaders for the room over the sprite, blending them together
-        if (sorted_shaders.size() > 0) {
-            for (auto &[shader_name, shader_data] : sorted_shaders) {
-                sol::optional<sol::table> shader_tbl_ = shaders[shader_name];
-                if (!shader_tbl_) {
-                    continue;
-                }
-
-                auto shader_tbl = *shader_tbl_;
-                sf::Shader *shader = shader_tbl["shader"];
-
-                bool enabled = true;
-                sol::optional<sol::object> compiled_enabled = shaders_data_obj.get<sol::table>()[shader_name][sol::metatable_key]["enabled_compiled"];
-                if (compiled_enabled) {
-                    // If "enabled" is a function, call it and convert result to bool
-                    auto result_function = (*compiled_enabled).as<sol::protected_function>();
-                    enabled = bool(call_or_throw(result_function));
-                } else if (shader_data.contains("enabled")) {
-                    // Otherwise just convert to bool
-                    enabled = shader_data.at("enabled").as<bool>();
-                }
-
-                // If the shader is evaluated as enabled, skip the paramter
-                // and go to the next one, if it's disabled, stop processing and don't run the shader
-                if (!enabled) continue;
-
-                shader->activate();
+        }
 
-                if (sol::optional<bool> need_screen_size = shader_tbl["need_screen_size"];
-                    need_screen_size.has_value() && *need_screen_size) {
-                    shader->setUniform("screenSize", sf::Vector2f(target_window.getSize()));
-                }
+        // The image made so far, until it's drawn to the window
+        sf::RenderTexture *current = &final_sprite;
+        bool presented = false;
+        auto present = [&]() {
+            if (presented)
+                return;
+
+            if (current->getSize() == screen_size)
+                target_window.draw(*current);
+            else
+                target_window.drawStretched(*current);
+            presented = true;
+        };
+
+        // Then, draw the shaders for the room, in the order of n
+        for (size_t i = 0; i < shader_passes.size(); i++) {
+            auto &pass = shader_passes[i];
+
+            bool enabled = pass.enabled;
+            if (pass.enabled_f) {
+                // If "enabled" is a function, call it and convert result to bool
+                enabled = bool(call_or_throw(*pass.enabled_f));
+            }
 
-                for (auto &param_data : shader_data) {
-                    auto [name, value] = param_data;
+            // If the shader is evaluated as enabled, skip the paramter
+            // and go to the next one, if it's disabled, stop processing and don't run the shader
+            if (!enabled) continue;
 
-                    // Skip the n and enabled field
-                    if (name == "n" || name == "enabled") continue;
+            pass.shader->activate();
 
-                    sol::optional<sol::protected_function> compiled =
-                        shaders_data_obj.get<sol::table>()[shader_name][sol::metatable_key][name + "_compiled"];
-                    //lua.script("return print").get<sol::protected_function>()(
-                    //    lua.script("return require('inspect')").get<sol::protected_function>()(compiled)
-                    //);
-                    if (compiled)
-                        value = call_or_throw(*compiled);
+            if (pass.screen_size_location)
+                pass.shader->setUniform(*pass.screen_size_location, sf::Vector2f(screen_size));
 
-                    if (value.is<float>()) {
-                        shader->setUniform(name, value.as<float>());
+            for (auto &param : pass.params) {
+                if (param.dynamic) {
+                    sol::object value = call_or_throw(*param.dynamic);
+                    if (!param.set(value)) {
+                        spdlog::error("Parameter {} of unknown type in shader {}", param.name, pass.name);
 
                         continue;
-                    } else if (value.is<std::vector<int32_t>>()) {
-                        auto vec = value.as<std::vector<int32_t>>();
-                        if (vec.size() == 2) {
-                            shader->setUniform(name, sf::Vector2f(vec[0], vec[1]));
-
-                            continue;
-                        }
                     }
+                }
 
-                    spdlog::error("Parameter {} of unknown type in shader {}", name, shader_name);
+                switch (param.type) {
+                case ShaderParam::Type::Float:
+                    pass.shader->setUniform(param.location, param.value.x);
+                    break;
+                case ShaderParam::Type::Vector:
+                    pass.shader->setUniform(param.location, param.value);
+                    break;
                 }
+            }
+
+            if (pass.mode == ShaderPass::Mode::Post) {
+                auto &output = post_pass_target(pass, current, screen_size);
 
+                if (pass.input_size_location)
+                    pass.shader->setUniform(*pass.input_size_location, sf::Vector2f(current->getSize()));
 
-                target_window.draw(shaders_texture, shader);
+                // Whatever was drawn into the target before would be blended with the new image
+                output.clear(sf::Color::Transparent);
+                pass.shader->drawWithTexture(*current, output);
+
+                current = &output;
+            } else if (last_post_pass && i < *last_post_pass) {
+                // A post-process shader comes later and needs this overlay in its input
+                pass.shader->drawWithTexture(shaders_texture, *current);
+            } else {
+                present();
+                target_window.draw(shaders_texture, pass.shader);
             }
-            sf::Shader::deactivate();
         }
+
+        if (!shader_passes.empty())
+            sf::Shader::deactivate();
+
+        present();
     }
 
     void debug_menu() {
@@ -164,5 +373,7 @@ public:
 
     void load_room(const std::string &name, bool switch_namespace) {
         call_or_throw(load_room_f, name, switch_namespace);
+
+        compile_shader_passes();
     }
 };
@@ -7,6 +7,9 @@ class Drawable {
 public:
     virtual void drawToTarget(GPU_Target *toTarget) { }
 
+    /** Whether the drawable only adds quads to the QuadBatch, otherwise the batch is flushed before drawing it. */
+    virtual bool isBatched() { return false; }
+
     virtual ~Drawable() {}
 };
 }
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+#include "SDL_gpu.h"
+
+#include "profiler.hpp"
+
+namespace sf {
+
+struct BatchVertex {
+    float x, y, u, v;
+    float r = 1.0, g = 1.0, b = 1.0, a = 1.0;
+} __attribute__((packed));
+
+/** Collects textured quads and draws all consecutive quads with the same texture and target
+ *  with a single GPU_TriangleBatch. Anything that draws to a target without going through the batch
+ *  (or changes the shader, the clip rect, etc) needs to flush it first.
+ */
+class QuadBatch {
+    GPU_Image *image = nullptr;
+    GPU_Target *target = nullptr;
+
+    std::vector<BatchVertex> vertices;
+
+    QuadBatch() = default;
+public:
+    // The vertex count of a single GPU_TriangleBatch call has to fit in an unsigned short
+    static constexpr size_t maxQuadsPerBatch = 4096;
+
+    static QuadBatch &instance() {
+        static QuadBatch batch;
+        return batch;
+    }
+
+    /** Indices for maxQuadsPerBatch quads, each made of four vertices: top left, top right, bottom left, bottom right. */
+    static const std::vector<uint16_t> &quadIndices() {
+        static std::vector<uint16_t> indices = [] {
+            std::vector<uint16_t> result;
+            result.reserve(maxQuadsPerBatch * 6);
+            for (uint16_t quad = 0; quad < maxQuadsPerBatch; quad++) {
+                uint16_t first = quad * 4;
+                for (uint16_t offset : { 0, 1, 2, 2, 1, 3 })
+                    result.push_back(first + offset);
+            }
+
+            return result;
+        }();
+
+        return indices;
+    }
+
+    void add(GPU_Image *quadImage, GPU_Target *quadTarget, const BatchVertex *quadVertices, size_t quadCount) {
+        if (quadImage != image || quadTarget != target) {
+            flush();
+
+            image = quadImage;
+            target = quadTarget;
+        }
+
+        vertices.insert(vertices.end(), quadVertices, quadVertices + quadCount * 4);
+    }
+
+    void flush() {
+        if (!vertices.empty()) {
+            // Only the time it takes to hand the batch to the driver, the GPU isn't waited for
+            someone::Profiler::Scope scope("GPU submit");
+            someone::Profiler::instance().count(someone::Profiler::Counter::GPUFlushes);
+
+            auto &indices = quadIndices();
+            for (size_t first = 0; first < vertices.size(); first += maxQuadsPerBatch * 4) {
+                size_t count = std::min(vertices.size() - first, maxQuadsPerBatch * 4);
+
+                GPU_TriangleBatch(image, target,
+                                  count, (float*)(vertices.data() + first),
+                                  count / 4 * 6, (unsigned short*)indices.data(),
+                                  GPU_BATCH_XY_ST_RGBA);
+            }
+
+            vertices.clear();
+        }
+
+        image = nullptr;
+        target = nullptr;
+    }
+
+    /** Flushes the batch if it has quads that use the image, e.g. before it's freed or drawn to. */
+    void flushIfUses(GPU_Image *usedImage) {
+        if (usedImage != nullptr && (image == usedImage || (target != nullptr && target->image == usedImage)))
+            flush();
+    }
+};
+
+}
@@ -8,6 +8,7 @@
 #include "SFML/Graphics/RenderTarget.hpp"
 #include "SFML/System/Vector2.hpp"
 #include "SFML/Graphics/Color.hpp"
+#include "SFML/Graphics/QuadBatch.hpp"
 
 namespace sf {
 
@@ -33,32 +34,52 @@ public:
         return texture.getSize();
     }
 
+    Texture &getTexture() {
+        return texture;
+    }
+
     void setView(View other) override {
+        // Quads batched before the view change were meant for the old clip rect
+        QuadBatch::instance().flushIfUses(texture.texture);
+
         RenderTarget::setView(other);
 
         if (view.isDefault()) {
             GPU_UnsetViewport(texture.getTarget());
             GPU_UnsetClip(texture.getTarget());
+            GPU_SetCamera(texture.getTarget(), nullptr);
         } else {
             // This doesn't work for some reason, but I don't really need it anyway
             //GPU_SetViewport(texture.getTarget(), GPU_MakeRect(view.viewport.left, view.viewport.top, view.viewport.width, view.viewport.height));
-            GPU_SetClipRect(texture.getTarget(), GPU_MakeRect(view.shownRect.left, view.shownRect.top, view.shownRect.width, view.shownRect.height));
+            GPU_SetClipRect(texture.getTarget(), GPU_MakeRect(view.viewport.left, view.viewport.top, view.viewport.width, view.viewport.height));
+
+            // The shown rectangle is moved onto the viewport, so moving it scrolls everything drawn with the view
+            GPU_Camera camera = GPU_GetDefaultCamera();
+            camera.x = view.shownRect.left - view.viewport.left;
+            camera.y = view.shownRect.top - view.viewport.top;
+            GPU_SetCamera(texture.getTarget(), &camera);
         }
     }
 
     void display() override {
+        QuadBatch::instance().flushIfUses(texture.texture);
         GPU_Flip(texture.getTarget());
     }
 
     void clear(const sf::Color &color) {
+        QuadBatch::instance().flushIfUses(texture.texture);
         GPU_ClearColor(texture.getTarget(), SDL_Color { color.r, color.g, color.b, color.a });
     }
 
     void drawToTarget(GPU_Target *toTarget) override {
+        QuadBatch::instance().flush();
         GPU_Blit(texture.texture, nullptr, toTarget, 0, 0);
     }
 
     void draw(Drawable &drawable) override {
+        if (!drawable.isBatched())
+            QuadBatch::instance().flush();
+
         drawable.drawToTarget(texture.getTarget());
     }
 };
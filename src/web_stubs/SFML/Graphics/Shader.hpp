@@ -19,6 +19,7 @@
 
 #include "SFML/System/Vector2.hpp"
 #include "SFML/Graphics/RenderTexture.hpp"
+#include "SFML/Graphics/QuadBatch.hpp"
 
 #include "logger.hpp"
 
@@ -29,7 +30,8 @@ class Shader {
     GPU_ShaderBlock block;
 
     std::map<std::string, int> uniformLocations;
-
+public:
+    // Locations can be kept and used instead of the names, to skip looking them up
     int getUniformLocation(const std::string &name) {
         int location;
         if (uniformLocations.contains(name)) {
@@ -40,7 +42,7 @@ class Shader {
         }
         return location;
     }
-public:
+
     enum Type {
         Fragment
     };
@@ -111,24 +113,31 @@ public:
         return true;
     }
 
-    void activate() { GPU_ActivateShaderProgram(program, &block); }
-    static void deactivate() { GPU_DeactivateShaderProgram(); }
+    // The shader is global state, so anything batched before has to be drawn without it
+    void activate() {
+        QuadBatch::instance().flush();
+        GPU_ActivateShaderProgram(program, &block);
+    }
+    static void deactivate() {
+        QuadBatch::instance().flush();
+        GPU_DeactivateShaderProgram();
+    }
 
-    void setUniform(std::string name, Vector2f value) {
+    void setUniform(int location, Vector2f value) {
         float values[] = { value.x, value.y };
-        GPU_SetUniformfv(
-            getUniformLocation(name),
-            2,
-            1,
-            values
-        );
+        GPU_SetUniformfv(location, 2, 1, values);
     }
 
-    void setUniform(std::string name, float value) {
-        GPU_SetUniformf(
-            getUniformLocation(name),
-            value
-        );
+    void setUniform(int location, float value) {
+        GPU_SetUniformf(location, value);
+    }
+
+    void setUniform(const std::string &name, Vector2f value) {
+        setUniform(getUniformLocation(name), value);
+    }
+
+    void setUniform(const std::string &name, float value) {
+        setUniform(getUniformLocation(name), value);
     }
 
     void drawWithTexture(RenderTexture &renderTexture, GPU_Target *target)  {
@@ -136,6 +145,11 @@ public:
         GPU_Blit(texture.texture, nullptr, target, 0, 0);
     }
 
+    // Stretches the texture over the whole target texture, which can be of a different size
+    void drawWithTexture(RenderTexture &renderTexture, RenderTexture &target) {
+        GPU_BlitRect(renderTexture.texture.texture, nullptr, target.texture.getTarget(), nullptr);
+    }
+
 
     ~Shader() { }
 };
@@ -1,9 +1,13 @@
 #pragma once
 
+#include <array>
+#include <cmath>
+
 #include "SFML/System/Rect.hpp"
 #include "SFML/Graphics/Transformable.hpp"
 #include "SFML/Graphics/RenderTexture.hpp"
 #include "SFML/Graphics/Texture.hpp"
+#include "SFML/Graphics/QuadBatch.hpp"
 
 namespace sf {
 class Sprite : public Transformable, public Drawable {
@@ -55,46 +59,63 @@ public:
         return result;
     }
 
+    bool isBatched() override { return true; }
+
     void drawToTarget(GPU_Target *toTarget) override {
-        GPU_Rect texRect;
-        texRect.x = textureRect.left;
-        texRect.y = textureRect.top;
-        texRect.h = textureRect.height;
-        texRect.w = textureRect.width;
+        if (textureRect.width == 0 || textureRect.height == 0)
+            return;
 
         auto bounds = getGlobalBounds();
-
-        auto orig = getOrigin();
         auto scale = getScale();
+        auto unscaledOrigin = getUnscaledOrigin();
 
-        GPU_Rect dstRect;
-        dstRect.x = bounds.left;
-        dstRect.y = bounds.top;
-        dstRect.w = bounds.width;
-        dstRect.h = bounds.height;
-
-        GPU_FlipEnum flip = GPU_FLIP_NONE;
+        // Same transformation GPU_BlitRectX does: the quad is scaled and rotated around the pivot,
+        // which is then moved to where it is in the destination rectangle
+        float w = textureRect.width, h = textureRect.height;
+        float scaleX = bounds.width / w, scaleY = bounds.height / h;
+        float x = bounds.left, y = bounds.top;
+        float pivotX = unscaledOrigin.x, pivotY = unscaledOrigin.y;
         if (scale.x < 0) {
-            flip = (SDL_RendererFlip)(flip | GPU_FLIP_HORIZONTAL);
+            scaleX = -scaleX;
+            x += bounds.width;
+            pivotX = w - pivotX;
         }
         if (scale.y < 0) {
-            flip = (SDL_RendererFlip)(flip | GPU_FLIP_VERTICAL);
+            scaleY = -scaleY;
+            y += bounds.height;
+            pivotY = h - pivotY;
         }
+        x += pivotX * scaleX;
+        y += pivotY * scaleY;
 
-        auto unscaledOrigin = getUnscaledOrigin();
+        float radians = getRotation() * M_PI / 180.0f;
+        float cosine = std::cos(radians), sine = std::sin(radians);
+
+        // Textures in an atlas are somewhere in a larger image
+        auto &region = texture->getRegion();
+        auto imageSize = texture->getImageSize();
+        float left = region.left + textureRect.left, top = region.top + textureRect.top;
+        float lu = left / imageSize.x, ru = (left + textureRect.width) / imageSize.x;
+        float tv = top / imageSize.y, bv = (top + textureRect.height) / imageSize.y;
+
+        float r = color.r / 255.0f, g = color.g / 255.0f, b = color.b / 255.0f, a = color.a / 255.0f;
 
-        GPU_SetRGBA(texture->texture, color.r, color.g, color.b, color.a);
-        GPU_BlitRectX(
-            texture->texture,
-            &texRect,
-            toTarget,
-            &dstRect,
-            getRotation(),
-            unscaledOrigin.x,
-            unscaledOrigin.y,
-            flip
-        );
-        GPU_UnsetColor(texture->texture);
+        std::array<BatchVertex, 4> quad = {
+            {
+                { 0, 0, lu, tv, r, g, b, a },
+                { w, 0, ru, tv, r, g, b, a },
+                { 0, h, lu, bv, r, g, b, a },
+                { w, h, ru, bv, r, g, b, a }
+            }
+        };
+        for (auto &vertex : quad) {
+            float localX = (vertex.x - pivotX) * scaleX, localY = (vertex.y - pivotY) * scaleY;
+
+            vertex.x = x + localX * cosine - localY * sine;
+            vertex.y = y + localX * sine + localY * cosine;
+        }
+
+        QuadBatch::instance().add(texture->texture, toTarget, quad.data(), 1);
     }
 
     Texture *getTexture() {
@@ -115,6 +136,9 @@ public:
     const Vector2i &getSize() { return size; };
     void setSize(Vector2i other) { size = other; };
 
+    // Uses its own index layout, so it's drawn directly
+    bool isBatched() override { return false; }
+
     void drawToTarget(GPU_Target *toTarget) override {
         auto bounds = getGlobalBounds();
         auto texSize = texture->getSize();
@@ -127,10 +151,15 @@ public:
         float centerTopY = textureRect.top;
         float centerBottomY = centerTopY + textureRect.height;
 
-        auto lx = leftX / texSize.x;
-        auto rx = rightX / texSize.x;
-        auto ty = centerTopY / texSize.y;
-        auto by = centerBottomY / texSize.y;
+        // Texture coordinates in the image, which is larger than the texture if it's in an atlas
+        auto &region = texture->getRegion();
+        auto imageSize = texture->getImageSize();
+        auto u = [&](float x) { return (region.left + x) / imageSize.x; };
+        auto v = [&](float y) { return (region.top + y) / imageSize.y; };
+
+        auto lx = u(leftX), rx = u(rightX);
+        auto ty = v(centerTopY), by = v(centerBottomY);
+        auto u0 = u(0), u1 = u(texSize.x), v0 = v(0), v1 = v(texSize.y);
 
         // Offsets to be used on the stretched texture to determine where the stretch points end
         auto rightXOffset = texSize.x - rightX;
@@ -189,25 +218,25 @@ public:
         std::array<Vertex, 16> verts = {
             {
                 // First row
-                { posX, posY, 0, 0 },
-                { leftX, posY, lx, 0 },
-                { rightX, posY, rx, 0 },
-                { w, posY, 1, 0 },
+                { posX, posY, u0, v0 },
+                { leftX, posY, lx, v0 },
+                { rightX, posY, rx, v0 },
+                { w, posY, u1, v0 },
                 // Second row
-                { posX, centerTopY, 0, ty },
+                { posX, centerTopY, u0, ty },
                 { leftX, centerTopY, lx, ty },
                 { rightX, centerTopY, rx, ty },
-                { w, centerTopY, 1, ty },
+                { w, centerTopY, u1, ty },
                 // Third row
-                { posX, centerBottomY, 0, by },
+                { posX, centerBottomY, u0, by },
                 { leftX, centerBottomY, lx, by },
                 { rightX, centerBottomY, rx, by },
-                { w, centerBottomY, 1, by },
+                { w, centerBottomY, u1, by },
                 // Fourth row
-                { posX, h, 0, 1 },
-                { leftX, h, lx, 1 },
-                { rightX, h, rx, 1 },
-                { w, h, 1, 1 }
+                { posX, h, u0, v1 },
+                { leftX, h, lx, v1 },
+                { rightX, h, rx, v1 },
+                { w, h, u1, v1 }
             }
         };
 
@@ -2,6 +2,14 @@
 
 #include <string>
 #include <map>
+#include <memory>
+#include <list>
+#include <tuple>
+#include <functional>
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <cctype>
 
 #include "SDL_gpu.h"
 #include "SDL_ttf.h"
@@ -12,15 +20,57 @@
 #include "SFML/Graphics/Transformable.hpp"
 #include "SFML/Graphics/Color.hpp"
 #include "SFML/Graphics/Texture.hpp"
+#include "SFML/Graphics/QuadBatch.hpp"
 
 #include "logger.hpp"
+#include "profiler.hpp"
 
 namespace sf {
 
 class Text;
 class Font {
+public:
+    struct Glyph {
+        // Position of the rendered glyph in the atlas page
+        IntRect rect;
+        size_t page = 0;
+        // Offset from the pen position to the left side of the rendered glyph
+        int offsetX = 0;
+        int advance = 0;
+
+        bool rasterized = false;
+    };
+
+    // Side of an atlas page, grown only if a single glyph doesn't fit
+    static constexpr int atlasPageSize = 512;
+    // Position of the solid white block used for underlines and strikethroughs
+    static constexpr IntRect whiteRect { 0, 0, 2, 2 };
+private:
+    // Glyphs are rendered white and tinted with vertex colors, so one atlas is shared between
+    // all colors. Underline and strikethrough are drawn as quads, so they don't need their own atlas either.
+    struct GlyphAtlas {
+        std::vector<std::unique_ptr<Texture>> pages;
+        std::map<uint32_t, Glyph> glyphs;
+
+        int pageSize = atlasPageSize;
+        // Shelf packing state for the last page
+        int penX = 0, penY = 0, rowHeight = 0;
+    };
+
     std::string fontFile;
     std::map<unsigned int, TTF_Font *> fonts;
+    std::map<std::pair<unsigned int, int>, GlyphAtlas> atlases;
+
+    // Least recently used cache of wrapped text sizes, the front is the most recently used
+    struct MeasuredText {
+        std::string text;
+        Vector2u size;
+    };
+    using MeasureKey = std::tuple<size_t, unsigned int, unsigned int>;
+    static constexpr size_t measureCacheCapacity = 256;
+
+    std::list<std::pair<MeasureKey, MeasuredText>> measureCache;
+    std::map<MeasureKey, decltype(measureCache)::iterator> measureCacheIndex;
 
     bool loadFontSize(unsigned int size) {
         if (!fonts.contains(size)) {
@@ -35,6 +85,83 @@ class Font {
         return true;
     }
 
+    static int atlasStyle(int style) {
+        return style & (TTF_STYLE_BOLD | TTF_STYLE_ITALIC);
+    }
+
+    TTF_Font *fontWithStyle(unsigned int size, int style) {
+        if (!loadFontSize(size))
+            return nullptr;
+
+        TTF_Font *font = fonts[size];
+        // Changing the style flushes SDL_ttf's internal cache, so only do it when needed
+        if (TTF_GetFontStyle(font) != atlasStyle(style))
+            TTF_SetFontStyle(font, atlasStyle(style));
+
+        return font;
+    }
+
+    void addAtlasPage(GlyphAtlas &atlas) {
+        auto page = std::make_unique<Texture>(GPU_CreateImage(atlas.pageSize, atlas.pageSize, GPU_FORMAT_RGBA));
+        GPU_ClearRGBA(page->getTarget(), 0, 0, 0, 0);
+
+        // Every page starts with a white block for drawing lines
+        SDL_Surface *white = SDL_CreateRGBSurfaceWithFormat(0, whiteRect.width, whiteRect.height, 32, SDL_PIXELFORMAT_RGBA32);
+        SDL_FillRect(white, nullptr, SDL_MapRGBA(white->format, 255, 255, 255, 255));
+        GPU_Rect whiteDest { (float)whiteRect.left, (float)whiteRect.top, (float)whiteRect.width, (float)whiteRect.height };
+        GPU_UpdateImage(page->texture, &whiteDest, white, nullptr);
+        SDL_FreeSurface(white);
+
+        atlas.pages.push_back(std::move(page));
+        atlas.penX = whiteRect.width + 1;
+        atlas.penY = 0;
+        atlas.rowHeight = whiteRect.height;
+    }
+
+    void rasterizeGlyph(GlyphAtlas &atlas, Glyph &glyph, TTF_Font *font, uint32_t codepoint) {
+        glyph.rasterized = true;
+
+        // Whitespace has nothing to draw
+        if (codepoint == ' ' || codepoint == '\t')
+            return;
+
+        someone::Profiler::Scope scope("Text rasterization");
+        someone::Profiler::instance().count(someone::Profiler::Counter::TextRasterizations);
+
+        SDL_Surface *surface = TTF_RenderGlyph32_Blended(font, codepoint, SDL_Color { 255, 255, 255, 255 });
+        if (!surface) {
+            spdlog::error("{}", TTF_GetError());
+            return;
+        }
+
+        if (surface->w + 1 > atlas.pageSize || surface->h + 1 > atlas.pageSize) {
+            // Only happens with huge font sizes, start a bigger page
+            atlas.pageSize = std::max(surface->w, surface->h) * 2;
+            addAtlasPage(atlas);
+        } else if (atlas.pages.empty()) {
+            addAtlasPage(atlas);
+        }
+
+        // Move to the next shelf, or to the next page if that doesn't fit either
+        if (atlas.penX + surface->w + 1 > atlas.pageSize) {
+            atlas.penX = 0;
+            atlas.penY += atlas.rowHeight + 1;
+            atlas.rowHeight = 0;
+        }
+        if (atlas.penY + surface->h + 1 > atlas.pageSize)
+            addAtlasPage(atlas);
+
+        glyph.page = atlas.pages.size() - 1;
+        glyph.rect = IntRect(atlas.penX, atlas.penY, surface->w, surface->h);
+
+        GPU_Rect dest { (float)glyph.rect.left, (float)glyph.rect.top, (float)glyph.rect.width, (float)glyph.rect.height };
+        GPU_UpdateImage(atlas.pages.back()->texture, &dest, surface, nullptr);
+        SDL_FreeSurface(surface);
+
+        atlas.penX += glyph.rect.width + 1;
+        atlas.rowHeight = std::max(atlas.rowHeight, glyph.rect.height);
+    }
+
     friend class Text;
 public:
     Font() {
@@ -42,13 +169,202 @@ public:
             TTF_Init();
     }
 
+    Font(const Font&) = delete;
+    void operator=(Font const &) = delete;
+
     bool loadFromFile(std::string file, int defaultSize = 16) {
         fontFile = file;
 
         return loadFontSize(defaultSize);
     }
 
+    /** Returns the glyph for the codepoint, rasterizing it into the atlas
+     *  only if asked to and it wasn't rasterized yet. Metrics are always available.
+     */
+    const Glyph &getGlyph(uint32_t codepoint, unsigned int size, int style, bool rasterize = true) {
+        auto &atlas = atlases[{ size, atlasStyle(style) }];
+
+        auto found = atlas.glyphs.find(codepoint);
+        if (found != atlas.glyphs.end() && (found->second.rasterized || !rasterize))
+            return found->second;
+
+        TTF_Font *font = fontWithStyle(size, style);
+        auto &glyph = atlas.glyphs[codepoint];
+        if (!font)
+            return glyph;
+
+        if (found == atlas.glyphs.end()) {
+            int minx, maxx, miny, maxy, advance;
+            if (TTF_GlyphMetrics32(font, codepoint, &minx, &maxx, &miny, &maxy, &advance) == 0) {
+                glyph.offsetX = std::min(0, minx);
+                glyph.advance = advance;
+            }
+        }
+
+        if (rasterize)
+            rasterizeGlyph(atlas, glyph, font, codepoint);
+
+        return glyph;
+    }
+
+    Texture &getAtlasPage(unsigned int size, int style, size_t page) {
+        auto &atlas = atlases[{ size, atlasStyle(style) }];
+        // The first page always exists, since lines are drawn from it even without any glyphs
+        if (atlas.pages.empty())
+            addAtlasPage(atlas);
+
+        return *atlas.pages[page];
+    }
+
+    int getKerning(uint32_t previous, uint32_t current, unsigned int size, int style) {
+        TTF_Font *font = fontWithStyle(size, style);
+        return font ? TTF_GetFontKerningSizeGlyphs32(font, previous, current) : 0;
+    }
+
+    int getLineSpacing(unsigned int size) {
+        return loadFontSize(size) ? TTF_FontLineSkip(fonts[size]) : 0;
+    }
+
+    int getHeight(unsigned int size) {
+        return loadFontSize(size) ? TTF_FontHeight(fonts[size]) : 0;
+    }
+
+    int getAscent(unsigned int size) {
+        return loadFontSize(size) ? TTF_FontAscent(fonts[size]) : 0;
+    }
+
+    /** Decodes one UTF-8 codepoint starting at pos and moves pos past it.
+     *  Invalid sequences are returned byte by byte.
+     */
+    static uint32_t decodeUtf8(const std::string &str, size_t &pos) {
+        auto byte = (unsigned char)str[pos++];
+
+        int continuation;
+        uint32_t codepoint;
+        if (byte < 0x80) {
+            return byte;
+        } else if ((byte & 0xE0) == 0xC0) {
+            continuation = 1;
+            codepoint = byte & 0x1F;
+        } else if ((byte & 0xF0) == 0xE0) {
+            continuation = 2;
+            codepoint = byte & 0x0F;
+        } else if ((byte & 0xF8) == 0xF0) {
+            continuation = 3;
+            codepoint = byte & 0x07;
+        } else {
+            return byte;
+        }
+
+        for (; continuation > 0 && pos < str.size(); continuation--) {
+            auto next = (unsigned char)str[pos];
+            if ((next & 0xC0) != 0x80)
+                break;
+
+            codepoint = (codepoint << 6) | (next & 0x3F);
+            pos++;
+        }
+
+        return codepoint;
+    }
+
+    /** Wraps the text the same way lume.wordwrap does, breaking lines before words that would make
+     *  the line at least wrapWidth characters long. If breaks is passed, positions in the original text
+     *  before which the line breaks were inserted are put there.
+     */
+    static std::string wrap(const std::string &text, unsigned int wrapWidth, std::vector<size_t> *breaks = nullptr) {
+        std::string wrapped;
+        wrapped.reserve(text.size() + (wrapWidth > 0 ? text.size() / wrapWidth + 1 : 0));
+
+        auto isSpace = [](char ch) { return std::isspace((unsigned char)ch); };
+
+        size_t lineLength = 0;
+        for (size_t pos = 0; pos < text.size();) {
+            size_t wordEnd = pos;
+            while (wordEnd < text.size() && !isSpace(text[wordEnd]))
+                wordEnd++;
+
+            size_t wordLength = wordEnd - pos;
+            if (wrapWidth > 0 && lineLength > 0 && lineLength + wordLength >= wrapWidth) {
+                wrapped += '\n';
+                if (breaks)
+                    breaks->push_back(pos);
+                lineLength = 0;
+            }
+            wrapped.append(text, pos, wordLength);
+            lineLength += wordLength;
+
+            // Spaces after the word stay on the same line
+            for (pos = wordEnd; pos < text.size() && isSpace(text[pos]); pos++) {
+                wrapped += text[pos];
+                lineLength = text[pos] == '\n' ? 0 : lineLength + 1;
+            }
+        }
+
+        return wrapped;
+    }
+
+    /** Size the text would take when drawn, calculated from glyph metrics without rasterizing anything. */
+    Vector2u measure(const std::string &text, unsigned int size, int style = 0) {
+        unsigned int width = 0, lineWidth = 0, lines = 1;
+
+        uint32_t previous = 0;
+        for (size_t pos = 0; pos < text.size();) {
+            auto codepoint = decodeUtf8(text, pos);
+
+            if (codepoint == '\n') {
+                width = std::max(width, lineWidth);
+                lineWidth = 0;
+                lines++;
+                previous = 0;
+
+                continue;
+            }
+
+            if (previous != 0)
+                lineWidth += getKerning(previous, codepoint, size, style);
+            lineWidth += getGlyph(codepoint, size, style, false).advance;
+
+            previous = codepoint;
+        }
+        width = std::max(width, lineWidth);
+
+        return { width, (lines - 1) * getLineSpacing(size) + getHeight(size) };
+    }
+
+    /** Size of the text after wrapping it to wrapWidth characters, cached for recently measured texts. */
+    Vector2u measureWrapped(const std::string &text, unsigned int size, unsigned int wrapWidth) {
+        MeasureKey key { std::hash<std::string>()(text), size, wrapWidth };
+
+        if (auto found = measureCacheIndex.find(key); found != measureCacheIndex.end()) {
+            auto entry = found->second;
+            // Make sure it's not just a hash collision
+            if (entry->second.text == text) {
+                measureCache.splice(measureCache.begin(), measureCache, entry);
+
+                return entry->second.size;
+            }
+
+            measureCache.erase(entry);
+            measureCacheIndex.erase(found);
+        }
+
+        auto result = measure(wrap(text, wrapWidth), size);
+
+        measureCache.push_front({ key, { text, result } });
+        measureCacheIndex[key] = measureCache.begin();
+        if (measureCache.size() > measureCacheCapacity) {
+            measureCacheIndex.erase(measureCache.back().first);
+            measureCache.pop_back();
+        }
+
+        return result;
+    }
+
     ~Font() {
+        // Free the atlas textures before SDL_gpu is gone
+        atlases.clear();
+
         for (auto kv : fonts) {
             TTF_CloseFont(kv.second);
         }
@@ -64,7 +380,9 @@ public:
         Underlined = TTF_STYLE_UNDERLINE,
         StrikeThrough = TTF_STYLE_STRIKETHROUGH
     };
-private:
+protected:
+    using Vertex = BatchVertex;
+
     std::string text;
     Color color;
     Style style = Regular;
@@ -72,38 +390,130 @@ private:
     Font &font;
     unsigned int size;
 
-    Texture texture;
+    // Quads in local coordinates, split by atlas page
+    std::vector<std::vector<Vertex>> localVertices;
+    // Same quads moved to the current position, ready to be drawn
+    std::vector<std::vector<Vertex>> vertices;
+    // Offset in the string of the character each quad belongs to, split by atlas page
+    std::vector<std::vector<size_t>> quadSources;
+    // Incremented every time the layout is rebuilt, so that derived classes can tell
+    uint32_t layoutGeneration = 0;
 
-    void recreateTexture() {
-        font.loadFontSize(size);
+    Vector2f builtPosition;
+    bool layoutDirty = true, verticesDirty = true;
 
-        TTF_SetFontStyle(font.fonts[size], style);
-        SDL_Surface *textSurface =
-            TTF_RenderUTF8_Blended_Wrapped(
-                // SDL_ttf doesn't like empty text
-                font.fonts[size], text.empty() ? " " : text.c_str(),
-                SDL_Color { .r = color.r, .g = color.g, .b = color.b, .a = color.a },
-                0
-            );
+    Vector2u bounds;
 
-        if(!textSurface) {
-            spdlog::error("{}", TTF_GetError());
-        } else {
-            texture = Texture(GPU_CopyImageFromSurface(textSurface));
-            SDL_FreeSurface(textSurface);
+    void addQuad(size_t page, size_t source, float x, float y, const IntRect &rect, float w, float h) {
+        if (localVertices.size() <= page) {
+            localVertices.resize(page + 1);
+            quadSources.resize(page + 1);
         }
+        quadSources[page].push_back(source);
+
+        auto pageSize = font.getAtlasPage(size, style, page).getSize();
+        float lu = (float)rect.left / pageSize.x, ru = (float)(rect.left + rect.width) / pageSize.x;
+        float tv = (float)rect.top / pageSize.y, bv = (float)(rect.top + rect.height) / pageSize.y;
+
+        auto &quad = localVertices[page];
+        quad.push_back({ x, y, lu, tv });
+        quad.push_back({ x + w, y, ru, tv });
+        quad.push_back({ x, y + h, lu, bv });
+        quad.push_back({ x + w, y + h, ru, bv });
     }
-public:
-    Text(const std::string &text, Font &font, unsigned int size) : text(text), font(font), size(size) {
-        recreateTexture();
+
+    void rebuildLayout() {
+        localVertices.clear();
+        quadSources.clear();
+
+        int lineSpacing = font.getLineSpacing(size);
+        int ascent = font.getAscent(size);
+        int lineThickness = std::max(1, (int)size / 16);
+
+        // Widths of each line, for the bounds
+        std::vector<int> lineWidths;
+
+        int penX = 0, penY = 0;
+        uint32_t previous = 0;
+        for (size_t pos = 0; pos < text.size();) {
+            size_t source = pos;
+            auto codepoint = Font::decodeUtf8(text, pos);
+
+            if (codepoint == '\n') {
+                lineWidths.push_back(penX);
+                penX = 0;
+                penY += lineSpacing;
+                previous = 0;
+
+                continue;
+            }
+
+            // Where the previous character's underline and strikethrough ended
+            int decorationX = penX;
+
+            if (previous != 0)
+                penX += font.getKerning(previous, codepoint, size, style);
+
+            auto &glyph = font.getGlyph(codepoint, size, style);
+            if (glyph.rect.width > 0 && glyph.rect.height > 0) {
+                addQuad(glyph.page, source, penX + glyph.offsetX, penY, glyph.rect, glyph.rect.width, glyph.rect.height);
+            }
+
+            penX += glyph.advance;
+            previous = codepoint;
+
+            // Every character gets its own piece of the lines, so they are revealed along with it.
+            // The white block is at the start of every page, so just use the first one
+            if (style & Underlined)
+                addQuad(0, source, decorationX, penY + ascent + 1, Font::whiteRect, penX - decorationX, lineThickness);
+            if (style & StrikeThrough)
+                addQuad(0, source, decorationX, penY + ascent / 2.0f, Font::whiteRect, penX - decorationX, lineThickness);
+        }
+        lineWidths.push_back(penX);
+
+        bounds.x = *std::max_element(lineWidths.begin(), lineWidths.end());
+        bounds.y = penY + font.getHeight(size);
+
+        layoutDirty = false;
+        verticesDirty = true;
+        layoutGeneration++;
     }
 
+    void rebuildVertices() {
+        if (layoutDirty)
+            rebuildLayout();
+
+        auto &pos = getPosition();
+        float r = color.r / 255.0f, g = color.g / 255.0f, b = color.b / 255.0f, a = color.a / 255.0f;
+
+        vertices.resize(localVertices.size());
+        for (size_t page = 0; page < localVertices.size(); page++) {
+            auto &from = localVertices[page];
+            auto &to = vertices[page];
+
+            to.resize(from.size());
+            for (size_t i = 0; i < from.size(); i++) {
+                to[i] = { from[i].x + pos.x, from[i].y + pos.y, from[i].u, from[i].v, r, g, b, a };
+            }
+        }
+
+        builtPosition = pos;
+        verticesDirty = false;
+    }
+
+    /** Amount of quads on the page that should be drawn, called after the layout is up to date. */
+    virtual size_t visibleQuadCount(size_t page) {
+        return vertices[page].size() / 4;
+    }
+public:
+    Text(const std::string &text, Font &font, unsigned int size) : text(text), font(font), size(size) { }
+
     std::string getString() { return text; }
     void setString(const std::string other) {
         if (text != other) {
             text = other;
 
-            recreateTexture();
+            layoutDirty = true;
         }
     }
 
@@ -112,7 +522,8 @@ public:
         if (color != other) {
             color = other;
 
-            recreateTexture();
+            // Only the vertex colors change, the glyphs stay the same
+            verticesDirty = true;
         }
     }
 
@@ -121,7 +532,7 @@ public:
         if (style != other) {
             style = other;
 
-            recreateTexture();
+            layoutDirty = true;
         }
     }
 
@@ -130,27 +541,123 @@ public:
         if (size != other) {
             size = other;
 
-            recreateTexture();
+            layoutDirty = true;
         }
     }
 
     IntRect getGlobalBounds() {
+        if (layoutDirty)
+            rebuildLayout();
+
         IntRect result;
 
         auto pos = getPosition();
         result.left = pos.x;
         result.top = pos.y;
-        result.width = texture.getSize().x;
-        result.height = texture.getSize().y;
+        result.width = bounds.x;
+        result.height = bounds.y;
 
         return result;
     }
 
-    virtual void drawToTarget(GPU_Target *target) {
-        auto pos = getGlobalBounds();
-        GPU_Rect dest { (float)pos.left, (float)pos.top, (float)pos.width, (float)pos.height };
+    bool isBatched() override { return true; }
+
+    void drawToTarget(GPU_Target *target) override {
+        if (layoutDirty || verticesDirty || !(builtPosition == getPosition()))
+            rebuildVertices();
+
+        // Texts with the same font, size and style share atlas pages, so they end up in the same batch
+        auto &batch = QuadBatch::instance();
+        for (size_t page = 0; page < vertices.size(); page++) {
+            auto *image = font.getAtlasPage(size, style, page).texture;
+
+            batch.add(image, target, vertices[page].data(), visibleQuadCount(page));
+        }
+    }
+};
+
+/** Text that is laid out once for the whole string and then revealed character by character,
+ *  like the terminal does. Changing the visible length doesn't touch the layout.
+ */
+class ProgressiveText : public Text {
+    std::string fullText;
+
+    // Maximum line length in characters, 0 means no wrapping
+    unsigned int wrapWidth = 0;
+    // Positions in the full text before which wrapping inserted a line break
+    std::vector<size_t> wrapBreaks;
+
+    size_t visibleLength = 0;
+    // Amount of wrap breaks before the visible length, moved along with it
+    size_t visibleBreaks = 0;
+
+    // Amount of visible quads on each page, moved along with the visible length
+    std::vector<size_t> pageCursors;
+    uint32_t cursorsGeneration = 0;
+
+    void rewrap() {
+        wrapBreaks.clear();
+        auto wrapped = Font::wrap(fullText, wrapWidth, &wrapBreaks);
+
+        visibleBreaks = 0;
+        moveVisibleBreaks();
+
+        setString(wrapped);
+    }
+
+    void moveVisibleBreaks() {
+        while (visibleBreaks < wrapBreaks.size() && wrapBreaks[visibleBreaks] < visibleLength)
+            visibleBreaks++;
+        while (visibleBreaks > 0 && wrapBreaks[visibleBreaks - 1] >= visibleLength)
+            visibleBreaks--;
+    }
+protected:
+    size_t visibleQuadCount(size_t page) override {
+        if (cursorsGeneration != layoutGeneration) {
+            cursorsGeneration = layoutGeneration;
+            pageCursors.assign(quadSources.size(), 0);
+        }
+
+        // Every inserted break shifts the characters after it by one in the wrapped string
+        size_t threshold = visibleLength + visibleBreaks;
+
+        auto &sources = quadSources[page];
+        auto &cursor = pageCursors[page];
+        while (cursor < sources.size() && sources[cursor] < threshold)
+            cursor++;
+        while (cursor > 0 && sources[cursor - 1] >= threshold)
+            cursor--;
+
+        return cursor;
+    }
+public:
+    ProgressiveText(const std::string &text, Font &font, unsigned int size) : Text("", font, size), fullText(text) {
+        rewrap();
+    }
+
+    const std::string &getFullString() { return fullText; }
+    void setFullString(const std::string &other) {
+        if (fullText != other) {
+            fullText = other;
+
+            rewrap();
+        }
+    }
+
+    unsigned int getWrapWidth() { return wrapWidth; }
+    void setWrapWidth(unsigned int other) {
+        if (wrapWidth != other) {
+            wrapWidth = other;
+
+            rewrap();
+        }
+    }
+
+    size_t getVisibleLength() { return visibleLength; }
+    void setVisibleLength(size_t other) {
+        visibleLength = std::min(other, fullText.size());
 
-        GPU_BlitRect(texture.texture, nullptr, target, &dest);
+        moveVisibleBreaks();
     }
 };
 
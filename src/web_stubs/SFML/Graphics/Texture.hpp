@@ -1,12 +1,17 @@
 #pragma once
 
 #include <string>
+#include <memory>
 
 #include "SDL_gpu.h"
 
 #include "SFML/System/Vector2.hpp"
+#include "SFML/System/Rect.hpp"
+#include "SFML/Graphics/QuadBatch.hpp"
 
 #include "logger.hpp"
+#include "profiler.hpp"
+#include "raw_image.hpp"
 
 namespace sf {
 
@@ -15,13 +20,34 @@ class Texture {
 
     GPU_Target *target = nullptr;
 
+    // Textures packed into an atlas are a region of the page's image, which they keep alive
+    std::shared_ptr<Texture> page;
+    IntRect region;
+
     void updateForTexture() {
         w = texture->w;
         h = texture->h;
         format = texture->format;
+        region = IntRect(0, 0, w, h);
 
         GPU_SetImageFilter(texture, GPU_FILTER_NEAREST);
     }
+
+    void release() {
+        // Regions of a page don't own the image, but the target is their own
+        bool ownsImage = texture != nullptr && !page;
+        if (ownsImage || target != nullptr)
+            QuadBatch::instance().flushIfUses(texture);
+
+        if (target != nullptr)
+            GPU_FreeTarget(target);
+        if (ownsImage)
+            GPU_FreeImage(texture);
+
+        texture = nullptr;
+        target = nullptr;
+        page.reset();
+    }
 public:
     uint32_t format = 0;
 
@@ -36,16 +62,41 @@ public:
     Texture(const Texture&) = delete;
     void operator=(Texture const &) = delete;
     Texture &operator=(Texture&& other) {
+        if (this == &other)
+            return *this;
+
+        release();
+
+        w = other.w;
+        h = other.h;
+        format = other.format;
         texture = other.texture;
-        updateForTexture();
+        target = other.target;
+        page = std::move(other.page);
+        region = other.region;
 
+        other.w = other.h = 0;
+        other.format = 0;
         other.texture = nullptr;
+        other.target = nullptr;
+        other.region = IntRect();
 
         return *this;
     }
 
     void loadFromFile(const std::string &filename) {
-        texture = GPU_LoadImage(filename.c_str());
+        someone::Profiler::Scope scope("Texture upload");
+        someone::Profiler::instance().count(someone::Profiler::Counter::TextureUploads);
+
+        // Large images can be preprocessed into raw pixels, which are uploaded without decoding them
+        if (auto raw = RawImage::find(filename)) {
+            auto surface = raw->surface();
+            texture = GPU_CopyImageFromSurface(surface);
+            SDL_FreeSurface(surface);
+        } else {
+            texture = GPU_LoadImage(filename.c_str());
+        }
+
         if (!texture) {
             spdlog::error("Failed loading {}: {}", filename, GPU_PopErrorCode().details);
             return;
@@ -53,10 +104,33 @@ public:
         updateForTexture();
     }
 
+    /** A texture that's drawn from a part of the page, texture coordinates are mapped with getRegion and getImageSize. */
+    static std::shared_ptr<Texture> fromRegion(std::shared_ptr<Texture> page, const IntRect &region) {
+        auto result = std::make_shared<Texture>();
+        result->texture = page->texture;
+        result->format = page->format;
+        result->w = region.width;
+        result->h = region.height;
+        result->region = IntRect(page->region.left + region.left, page->region.top + region.top, region.width, region.height);
+        result->page = std::move(page);
+
+        return result;
+    }
+
     Vector2u getSize() const {
         return Vector2u(w, h);
     }
 
+    /** The atlas page the texture is a region of, null unless it's in an atlas. */
+    const std::shared_ptr<Texture> &getPage() const { return page; }
+
+    /** Where the texture is in its image, the whole image unless it's in an atlas. */
+    const IntRect &getRegion() const { return region; }
+
+    Vector2u getImageSize() const {
+        return page ? page->getImageSize() : getSize();
+    }
+
     GPU_Target *getTarget() {
         if (target == nullptr)
             target = GPU_LoadTarget(texture);
@@ -64,10 +138,7 @@ public:
     }
 
     ~Texture() {
-        if (texture != nullptr)
-            GPU_FreeImage(texture);
-        if (target != nullptr)
-            GPU_FreeTarget(target);
+        release();
     }
 };
 }
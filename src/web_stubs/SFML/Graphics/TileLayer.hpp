@@ -0,0 +1,206 @@
+#pragma once
+
+#include <array>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <unordered_set>
+
+#include "SFML/Graphics/Drawable.hpp"
+#include "SFML/Graphics/Transformable.hpp"
+#include "SFML/Graphics/RenderTexture.hpp"
+#include "SFML/Graphics/Texture.hpp"
+#include "SFML/Graphics/QuadBatch.hpp"
+
+namespace sf {
+
+/** A Tiled tile layer that is rendered once into chunk-sized render textures,
+ *  which are then drawn instead of drawing every tile separately.
+ */
+class TileLayer : public Transformable, public Drawable {
+public:
+    static constexpr uint32_t FlippedHorizontally = 0x80000000;
+    static constexpr uint32_t FlippedVertically = 0x40000000;
+    static constexpr uint32_t FlippedDiagonally = 0x20000000;
+    static constexpr uint32_t RotatedHexagonal120 = 0x10000000;
+    static constexpr uint32_t FlagsMask = FlippedHorizontally | FlippedVertically | FlippedDiagonally | RotatedHexagonal120;
+
+    // Maximum size of a chunk texture side in pixels
+    static constexpr unsigned chunkSize = 1024;
+
+private:
+    struct Tileset {
+        Texture *texture;
+        uint32_t firstGid;
+        unsigned tileWidth, tileHeight, columns;
+        unsigned margin, spacing;
+    };
+
+    struct Chunk {
+        Vector2f offset;
+        std::unique_ptr<RenderTexture> texture;
+    };
+
+    unsigned width, height, tileWidth, tileHeight;
+
+    // Sorted by the first GID
+    std::vector<Tileset> tilesets;
+    std::vector<Chunk> chunks;
+
+    const Tileset *findTileset(uint32_t gid) const {
+        auto after = std::upper_bound(
+            tilesets.begin(), tilesets.end(), gid,
+            [](uint32_t gid, const Tileset &set) { return gid < set.firstGid; }
+        );
+        if (after == tilesets.begin())
+            return nullptr;
+
+        return &*std::prev(after);
+    }
+
+public:
+    TileLayer(unsigned width, unsigned height, unsigned tileWidth, unsigned tileHeight)
+        : width(width), height(height), tileWidth(tileWidth), tileHeight(tileHeight) { }
+
+    /** Adds a tileset laid out the way Tiled describes it, with columns, margin and spacing taken from the map. */
+    void addTileset(
+        Texture *texture, uint32_t firstGid, unsigned setTileWidth, unsigned setTileHeight,
+        unsigned columns, unsigned margin, unsigned spacing
+    ) {
+        Tileset set { texture, firstGid, setTileWidth, setTileHeight, std::max(columns, 1u), margin, spacing };
+        tilesets.insert(
+            std::upper_bound(
+                tilesets.begin(), tilesets.end(), firstGid,
+                [](uint32_t gid, const Tileset &set) { return gid < set.firstGid; }
+            ),
+            set
+        );
+    }
+
+    /** Renders all tiles of the layer into chunks, except empty ones and those with GIDs in the skipped set.
+     *  The tilesets are forgotten afterwards, so their textures can be freed, and have to be added again to bake again.
+     *
+     *  gids is the layer data, row by row, with flip flags still in place.
+     */
+    void bake(const std::vector<uint32_t> &gids, const std::unordered_set<uint32_t> &skipped) {
+        chunks.clear();
+        if (tilesets.empty() || tileWidth == 0 || tileHeight == 0)
+            return;
+
+        // Tiles bigger than the grid cell are aligned to its bottom left corner, so they may
+        // stick out to the top and to the right. Chunks get padded to fit them.
+        unsigned padTop = 0, padRight = 0;
+        for (auto &set : tilesets) {
+            padTop = std::max(padTop, set.tileHeight > tileHeight ? set.tileHeight - tileHeight : 0);
+            padRight = std::max(padRight, set.tileWidth > tileWidth ? set.tileWidth - tileWidth : 0);
+        }
+
+        unsigned chunkColumns = std::max(chunkSize / tileWidth, 1u);
+        unsigned chunkRows = std::max(chunkSize / tileHeight, 1u);
+
+        auto &batch = QuadBatch::instance();
+        for (unsigned chunkY = 0; chunkY < height; chunkY += chunkRows) {
+            for (unsigned chunkX = 0; chunkX < width; chunkX += chunkColumns) {
+                unsigned columns = std::min(chunkColumns, width - chunkX);
+                unsigned rows = std::min(chunkRows, height - chunkY);
+
+                Chunk chunk {
+                    Vector2f(chunkX * tileWidth, chunkY * tileHeight - (float)padTop),
+                    nullptr
+                };
+
+                for (unsigned y = chunkY; y < chunkY + rows; y++) {
+                    for (unsigned x = chunkX; x < chunkX + columns; x++) {
+                        size_t n = (size_t)y * width + x;
+                        if (n >= gids.size())
+                            break;
+
+                        uint32_t flags = gids[n] & FlagsMask;
+                        uint32_t gid = gids[n] & ~FlagsMask;
+                        // 0 = no tile
+                        if (gid == 0 || skipped.count(gid) > 0)
+                            continue;
+
+                        auto set = findTileset(gid);
+                        if (set == nullptr)
+                            continue;
+
+                        // Only create the chunk texture when it actually has something in it
+                        if (chunk.texture == nullptr) {
+                            chunk.texture = std::make_unique<RenderTexture>();
+                            chunk.texture->create(columns * tileWidth + padRight, rows * tileHeight + padTop);
+                            chunk.texture->clear(Color::Transparent);
+                        }
+
+                        auto id = gid - set->firstGid;
+                        auto &region = set->texture->getRegion();
+                        auto imageSize = set->texture->getImageSize();
+                        float left = region.left + set->margin + (id % set->columns) * (set->tileWidth + set->spacing);
+                        float top = region.top + set->margin + (id / set->columns) * (set->tileHeight + set->spacing);
+                        float lu = left / imageSize.x, ru = (left + set->tileWidth) / imageSize.x;
+                        float tv = top / imageSize.y, bv = (top + set->tileHeight) / imageSize.y;
+
+                        float posX = (x - chunkX) * tileWidth;
+                        float posY = (y - chunkY + 1) * tileHeight + padTop - set->tileHeight;
+                        float w = set->tileWidth, h = set->tileHeight;
+
+                        // Corners go top left, top right, bottom left, bottom right
+                        std::array<BatchVertex, 4> quad = {
+                            {
+                                { posX, posY, lu, tv },
+                                { posX + w, posY, ru, tv },
+                                { posX, posY + h, lu, bv },
+                                { posX + w, posY + h, ru, bv }
+                            }
+                        };
+
+                        // Flips are applied in the order Tiled does: diagonal first, then horizontal, then vertical
+                        auto swapUV = [&quad](size_t a, size_t b) {
+                            // Packed fields can't be bound to references, so no std::swap
+                            float u = quad[a].u, v = quad[a].v;
+                            quad[a].u = quad[b].u;
+                            quad[a].v = quad[b].v;
+                            quad[b].u = u;
+                            quad[b].v = v;
+                        };
+                        if (flags & FlippedDiagonally)
+                            swapUV(1, 2);
+                        if (flags & FlippedHorizontally) {
+                            swapUV(0, 1);
+                            swapUV(2, 3);
+                        }
+                        if (flags & FlippedVertically) {
+                            swapUV(0, 2);
+                            swapUV(1, 3);
+                        }
+
+                        batch.add(set->texture->texture, chunk.texture->getTexture().getTarget(), quad.data(), 1);
+                    }
+                }
+
+                if (chunk.texture != nullptr) {
+                    chunk.texture->display();
+                    chunks.push_back(std::move(chunk));
+                }
+            }
+        }
+
+        // Nothing points to the tileset textures after this, they aren't kept alive for the layer
+        tilesets.clear();
+    }
+
+    size_t getChunkCount() const { return chunks.size(); }
+
+    void drawToTarget(GPU_Target *toTarget) override {
+        auto &position = getPosition();
+
+        for (auto &chunk : chunks) {
+            GPU_Blit(
+                chunk.texture->getTexture().texture, nullptr, toTarget,
+                position.x + chunk.offset.x, position.y + chunk.offset.y
+            );
+        }
+    }
+};
+
+}
@@ -11,6 +11,7 @@
 #include "SFML/Graphics/Shader.hpp"
 #include "SFML/Graphics/RenderTarget.hpp"
 #include "SFML/Graphics/Sprite.hpp"
+#include "SFML/Graphics/QuadBatch.hpp"
 #include "SFML/System/Vector2.hpp"
 
 namespace sf {
@@ -107,10 +108,20 @@ public:
     }
 
     void draw(RenderTexture &texture, Shader *shader) {
+        QuadBatch::instance().flush();
         shader->drawWithTexture(texture, target);
     }
 
+    // Stretches the texture over the whole window
+    void drawStretched(RenderTexture &texture) {
+        QuadBatch::instance().flush();
+        GPU_BlitRect(texture.getTexture().texture, nullptr, target, nullptr);
+    }
+
     void draw(Drawable &drawable) override {
+        if (!drawable.isBatched())
+            QuadBatch::instance().flush();
+
         drawable.drawToTarget(target);
     }
 
@@ -125,6 +136,7 @@ public:
     }
 
     void display() override {
+        QuadBatch::instance().flush();
         GPU_Flip(target);
     }
 
@@ -183,6 +195,7 @@ public:
     }
 
     void clear() {
+        QuadBatch::instance().flush();
         GPU_Clear(target);
     }
 
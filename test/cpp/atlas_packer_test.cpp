@@ -0,0 +1,64 @@
+#include "catch2/catch.hpp"
+
+#include "atlas_packer.hpp"
+
+namespace {
+
+bool overlap(const sf::IntRect &a, const sf::IntRect &b, int padding) {
+    return a.left < b.left + b.width + padding && b.left < a.left + a.width + padding
+        && a.top < b.top + b.height + padding && b.top < a.top + a.height + padding;
+}
+
+}
+
+TEST_CASE("Atlas packer", "[atlas_packer]") {
+    SECTION("Rectangles are placed in the order of the sizes without overlapping") {
+        AtlasPacker packer(256, 1);
+
+        std::vector<sf::Vector2u> sizes;
+        for (unsigned i = 1; i <= 40; i++)
+            sizes.emplace_back(i * 7 % 60 + 4, i * 13 % 50 + 4);
+
+        auto placements = packer.pack(sizes);
+        REQUIRE(placements.size() == sizes.size());
+
+        for (size_t i = 0; i < placements.size(); i++) {
+            REQUIRE(placements[i]);
+
+            auto rect = placements[i]->rect;
+            REQUIRE(rect.width == (int)sizes[i].x);
+            REQUIRE(rect.height == (int)sizes[i].y);
+            REQUIRE(rect.left >= 0);
+            REQUIRE(rect.top >= 0);
+            REQUIRE(rect.left + rect.width <= 256);
+            REQUIRE(rect.top + rect.height <= 256);
+
+            for (size_t j = 0; j < i; j++) {
+                if (placements[j]->page == placements[i]->page)
+                    REQUIRE_FALSE(overlap(placements[j]->rect, rect, 1));
+            }
+        }
+    }
+
+    SECTION("New pages are added when a page is full") {
+        AtlasPacker packer(64, 0);
+
+        auto placements = packer.pack({ sf::Vector2u(64, 64), sf::Vector2u(32, 32), sf::Vector2u(32, 32) });
+
+        REQUIRE(packer.page_count() == 2);
+        REQUIRE(placements[0]->page == 0);
+        REQUIRE(placements[1]->page == 1);
+        REQUIRE(placements[2]->page == 1);
+        REQUIRE(packer.page_extent(1) == sf::Vector2u(64, 32));
+    }
+
+    SECTION("Rectangles larger than a page aren't placed") {
+        AtlasPacker packer(64, 1);
+
+        auto placements = packer.pack({ sf::Vector2u(100, 10), sf::Vector2u(10, 10) });
+
+        REQUIRE_FALSE(placements[0]);
+        REQUIRE(placements[1]);
+        REQUIRE(packer.page_count() == 1);
+    }
+}
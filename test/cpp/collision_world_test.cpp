@@ -0,0 +1,114 @@
+#include "catch2/catch.hpp"
+
+#include "sol/sol.hpp"
+
+#include "collision_world.hpp"
+
+TEST_CASE("Collision world", "[collision_world]") {
+    sol::state lua;
+    sol::this_state this_lua(lua);
+
+    CollisionWorld world;
+
+    sol::table player = lua.create_table(), wall = lua.create_table(), trigger = lua.create_table();
+    world.add(player, 0, 0, 10, 10);
+    world.add(wall, 20, 0, 10, 10);
+    world.add(trigger, 100, 0, 10, 10);
+    world.set_response(trigger, CollisionWorld::Response::Cross);
+
+    SECTION("Items can be added and removed") {
+        REQUIRE(world.has_item(player));
+        REQUIRE(std::get<0>(world.get_rect(wall)) == 20);
+
+        world.remove(wall);
+        REQUIRE_FALSE(world.has_item(wall));
+        REQUIRE_THROWS(world.get_rect(wall));
+    }
+
+    SECTION("Rectangle queries only return intersecting items") {
+        auto [items, count] = world.query_rect(this_lua, 5, 5, 20, 2, sol::nullopt);
+
+        REQUIRE(count == 2);
+
+        auto [far_items, far_count] = world.query_rect(this_lua, 300, 300, 10, 10, sol::nullopt);
+        REQUIRE(far_count == 0);
+    }
+
+    SECTION("Point queries return items containing the point") {
+        auto [items, count] = world.query_point(this_lua, 25, 5, sol::nullopt);
+
+        REQUIRE(count == 1);
+        REQUIRE(items.get<sol::object>(1).pointer() == wall.pointer());
+
+        // Edges don't count, same as in bump
+        auto [edge_items, edge_count] = world.query_point(this_lua, 20, 5, sol::nullopt);
+        REQUIRE(edge_count == 0);
+    }
+
+    SECTION("Query filters are checked for Lua truthiness") {
+        sol::function nil_for_walls = lua.script("return function(item) if item.wall then return nil end return 1 end");
+        wall["wall"] = true;
+
+        auto [items, count] = world.query_rect(this_lua, 5, 5, 20, 2, nil_for_walls);
+        REQUIRE(count == 1);
+        REQUIRE(items.get<sol::object>(1).pointer() == player.pointer());
+
+        auto [point_items, point_count] = world.query_point(this_lua, 25, 5, nil_for_walls);
+        REQUIRE(point_count == 0);
+    }
+
+    SECTION("Query filters can query the world too") {
+        // Spans two cells, so a nested query that forgets it was seen would make it show up twice or not at all
+        sol::table big = lua.create_table();
+        world.add(big, 60, 0, 10, 10);
+
+        lua.set_function("nested_query", [&](sol::object) {
+            world.query_point(this_lua, 65, 5, sol::nullopt);
+            return true;
+        });
+        sol::function nested_query = lua["nested_query"];
+
+        auto [items, count] = world.query_rect(this_lua, 0, 0, 128, 10, nested_query);
+        REQUIRE(count == 4);
+    }
+
+    SECTION("Updated items are found at the new position") {
+        world.update(wall, 500, 500, sol::nullopt, sol::nullopt);
+
+        auto [items, count] = world.query_point(this_lua, 505, 505, sol::nullopt);
+        REQUIRE(count == 1);
+
+        auto [old_items, old_count] = world.query_point(this_lua, 25, 5, sol::nullopt);
+        REQUIRE(old_count == 0);
+    }
+
+    SECTION("Moving into a solid item slides against it") {
+        auto [x, y, cols, count] = world.check(this_lua, player, 15, 0, sol::nullopt);
+
+        REQUIRE(count == 1);
+        REQUIRE(x == 10);
+        REQUIRE(y == 0);
+        REQUIRE(cols[1]["type"].get<std::string>() == "slide");
+        REQUIRE(cols[1]["other"].get<sol::object>().pointer() == wall.pointer());
+    }
+
+    SECTION("Moving into a trigger crosses it") {
+        world.remove(wall);
+
+        auto [x, y, cols, count] = world.check(this_lua, player, 95, 0, sol::nullopt);
+
+        REQUIRE(count == 1);
+        REQUIRE(x == 95);
+        REQUIRE(cols[1]["type"].get<std::string>() == "cross");
+    }
+
+    SECTION("A filter function overrides the responses") {
+        auto filter = lua.load("return function(item, other) return 'cross' end")().get<sol::function>();
+
+        auto [x, y, cols, count] = world.check(this_lua, player, 15, 0, filter);
+
+        REQUIRE(count == 1);
+        REQUIRE(x == 15);
+        REQUIRE(cols[1]["type"].get<std::string>() == "cross");
+    }
+}
@@ -0,0 +1,176 @@
+#include "catch2/catch.hpp"
+
+#include "sol/sol.hpp"
+
+#include "coroutine_scheduler.hpp"
+
+TEST_CASE("Coroutine scheduler", "[coroutines]") {
+    sol::state lua;
+    lua.open_libraries(sol::lib::base, sol::lib::coroutine, sol::lib::table);
+
+    CoroutineScheduler scheduler(lua.lua_state());
+    lua["scheduler"] = lua.create_table_with(
+        "create", [&](sol::this_state state, sol::variadic_args args) { return scheduler.create(state, args); },
+        "abandon", [&](sol::thread coroutine) { scheduler.abandon(coroutine); },
+        "wait_event", [&](sol::this_state state, const std::string &name) { scheduler.wait_event(state, name); },
+        "sleep", [&](sol::this_state state, float seconds) { scheduler.sleep(state, seconds); },
+        "wait_until", [&](sol::this_state state, sol::protected_function condition, sol::optional<float> interval) {
+            scheduler.wait_until(state, condition, interval);
+        },
+        "signal", [&](const std::string &name) { scheduler.signal(name); }
+    );
+
+    SECTION("Coroutines get their arguments first and then the time") {
+        lua.script(R"(
+            result = {}
+            scheduler.create(function(a, b)
+                table.insert(result, a + b)
+                table.insert(result, coroutine.yield())
+            end, 1, 2)
+        )");
+
+        scheduler.run(0.5f);
+        scheduler.run(0.25f);
+
+        REQUIRE(lua["result"][1].get<int>() == 3);
+        REQUIRE(lua["result"][2].get<float>() == 0.25f);
+        REQUIRE(scheduler.size() == 0);
+    }
+
+    SECTION("Yielding a function waits for a coroutine made from it") {
+        lua.script(R"(
+            order = {}
+            scheduler.create(function()
+                coroutine.yield(function(name)
+                    table.insert(order, name)
+                    coroutine.yield()
+                    table.insert(order, "child done")
+                end, "child")
+
+                table.insert(order, "parent")
+            end)
+        )");
+
+        scheduler.run(0);
+        scheduler.run(0);
+        REQUIRE(lua["order"].get<sol::table>().size() == 2);
+
+        scheduler.run(0);
+        REQUIRE(lua["order"][3].get<std::string>() == "parent");
+        REQUIRE(scheduler.size() == 0);
+    }
+
+    SECTION("Sleeping coroutines wake up after the time passes") {
+        lua.script(R"(
+            woke = false
+            scheduler.create(function()
+                scheduler.sleep(1)
+                coroutine.yield()
+                woke = true
+            end)
+        )");
+
+        scheduler.run(0);
+        scheduler.run(0.5f);
+        REQUIRE_FALSE(lua["woke"].get<bool>());
+
+        scheduler.run(0.6f);
+        REQUIRE(lua["woke"].get<bool>());
+    }
+
+    SECTION("Timers far in the future wake up on time") {
+        lua.script(R"(
+            woke = false
+            scheduler.create(function()
+                scheduler.sleep(100)
+                coroutine.yield()
+                woke = true
+            end)
+        )");
+
+        scheduler.run(0);
+        for (int i = 0; i < 99; i++)
+            scheduler.run(1);
+        REQUIRE_FALSE(lua["woke"].get<bool>());
+
+        scheduler.run(1.5f);
+        REQUIRE(lua["woke"].get<bool>());
+    }
+
+    SECTION("Conditions are checked on their interval") {
+        lua.script(R"(
+            checks = 0
+            open = false
+            woke = false
+            scheduler.create(function()
+                scheduler.wait_until(function()
+                    checks = checks + 1
+                    return open
+                end, 1)
+                coroutine.yield()
+                woke = true
+            end)
+        )");
+
+        scheduler.run(0);
+        scheduler.run(0.5f);
+        REQUIRE(lua["checks"].get<int>() == 0);
+
+        scheduler.run(0.6f);
+        REQUIRE(lua["checks"].get<int>() == 1);
+        REQUIRE_FALSE(lua["woke"].get<bool>());
+
+        lua["open"] = true;
+        scheduler.run(1.1f);
+        REQUIRE(lua["woke"].get<bool>());
+    }
+
+    SECTION("Events wake up the coroutines waiting for them") {
+        lua.script(R"(
+            woke = 0
+            for i = 1, 2 do
+                scheduler.create(function()
+                    scheduler.wait_event("door")
+                    coroutine.yield()
+                    woke = woke + 1
+                end)
+            end
+        )");
+
+        scheduler.run(0);
+        scheduler.run(0);
+        REQUIRE(lua["woke"].get<int>() == 0);
+
+        scheduler.signal("door");
+        scheduler.run(0);
+        REQUIRE(lua["woke"].get<int>() == 2);
+    }
+
+    SECTION("Abandoned coroutines stop running") {
+        lua.script(R"(
+            runs = 0
+            abandoned = scheduler.create(function()
+                while true do
+                    runs = runs + 1
+                    coroutine.yield()
+                end
+            end)
+        )");
+
+        scheduler.run(0);
+        lua.script("scheduler.abandon(abandoned)");
+        scheduler.run(0);
+
+        REQUIRE(lua["runs"].get<int>() == 1);
+        REQUIRE(scheduler.size() == 0);
+    }
+
+    SECTION("Errors are thrown and the coroutine is removed") {
+        lua.script(R"(
+            scheduler.create(function() error("broken") end)
+        )");
+
+        REQUIRE_THROWS_AS(scheduler.run(0), sol::error);
+        REQUIRE(scheduler.size() == 0);
+    }
+}
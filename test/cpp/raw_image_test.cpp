@@ -0,0 +1,66 @@
+#include <fstream>
+#include <cstring>
+#include <filesystem>
+
+#include "catch2/catch.hpp"
+
+#include "raw_image.hpp"
+
+TEST_CASE("Raw image", "[raw_image]") {
+    auto directory = std::filesystem::temp_directory_path() / "someone_raw_image_test";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+
+    auto image_path = directory / "image.png";
+    auto raw_path = RawImage::path_for(image_path);
+    REQUIRE(raw_path == directory / "image.rgba");
+
+    const uint8_t pixels[] = {
+        255, 0, 0, 255,    0, 255, 0, 128,    0, 0, 255, 0,
+        10, 20, 30, 40,    50, 60, 70, 80,    90, 100, 110, 120
+    };
+    std::ofstream(image_path) << "four";
+
+    auto surface = SDL_CreateRGBSurfaceWithFormatFrom((void *)pixels, 3, 2, 32, 3 * 4, SDL_PIXELFORMAT_RGBA32);
+    REQUIRE(surface);
+    RawImage::write(raw_path, surface, image_path);
+    SDL_FreeSurface(surface);
+
+    SECTION("Pixels are read back as they were written") {
+        auto raw = RawImage::find(image_path);
+        REQUIRE(raw);
+        REQUIRE(raw->width() == 3);
+        REQUIRE(raw->height() == 2);
+
+        auto read = raw->surface();
+        REQUIRE(read);
+        REQUIRE(std::memcmp(read->pixels, pixels, sizeof(pixels)) == 0);
+        SDL_FreeSurface(read);
+    }
+
+    SECTION("Raw images made from another version of the image aren't used") {
+        REQUIRE(RawImage::find(image_path));
+
+        SECTION("With a different size") {
+            std::ofstream(image_path) << "changed";
+            REQUIRE_FALSE(RawImage::find(image_path));
+        }
+
+        SECTION("With the same size") {
+            std::ofstream(image_path) << "fore";
+            REQUIRE_FALSE(RawImage::find(image_path));
+        }
+    }
+
+    SECTION("Raw images are used without the image") {
+        std::filesystem::remove(image_path);
+        REQUIRE(RawImage::find(image_path));
+    }
+
+    SECTION("Invalid raw images aren't used") {
+        std::ofstream(raw_path, std::ios::binary) << "not an image";
+        REQUIRE_FALSE(RawImage::find(image_path));
+    }
+
+    std::filesystem::remove_all(directory);
+}
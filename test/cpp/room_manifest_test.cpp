@@ -0,0 +1,36 @@
+#include <filesystem>
+
+#include "catch2/catch.hpp"
+
+#include "room_manifest.hpp"
+
+TEST_CASE("Room manifest", "[rooms]") {
+    const std::string rooms_root = "resources/rooms/manifest";
+
+    SECTION("Assets are collected from the room, its prefab room and the entity prefabs") {
+        auto manifest = RoomManifest::build(rooms_root, "room");
+
+        REQUIRE(manifest.textures == std::vector<std::string> { "base_background", "door" });
+        REQUIRE(manifest.sounds == std::vector<std::string> { "door_open", "static" });
+        REQUIRE(manifest.shaders == std::vector<std::string> { "darker" });
+        REQUIRE(manifest.adjacent_rooms == std::vector<std::string> { "next_room" });
+        REQUIRE(manifest.sources.size() == 3);
+        REQUIRE(manifest.is_fresh());
+    }
+
+    SECTION("Manifests are cached until their sources change") {
+        std::filesystem::remove_all(std::filesystem::path(rooms_root) / ".manifests");
+
+        auto built = RoomManifest::load(rooms_root, "room");
+        REQUIRE(std::filesystem::exists(std::filesystem::path(rooms_root) / ".manifests" / "room.toml"));
+
+        auto cached = RoomManifest::load(rooms_root, "room");
+        REQUIRE(cached.textures == built.textures);
+        REQUIRE(cached.sources.size() == built.sources.size());
+        REQUIRE(cached.is_fresh());
+
+        auto door_path = std::filesystem::path(rooms_root) / "prefabs" / "door.toml";
+        std::filesystem::last_write_time(door_path, std::filesystem::last_write_time(door_path) + std::chrono::seconds(1));
+        REQUIRE_FALSE(cached.is_fresh());
+    }
+}
@@ -5,6 +5,7 @@
 #include "sol/sol.hpp"
 
 #include "story_parser.hpp"
+#include "story_bundle.hpp"
 #include "line_data.hpp"
 #include "usertypes.hpp"
 #include "logger.hpp"
@@ -87,6 +88,104 @@ TEST_CASE("Story parser", "[story_parser]") {
 
             REQUIRE(referenced2.text == "referenced-2");
         }
+
+        SECTION("Referenced lines are indexed") {
+            REQUIRE(parser.has_line("test/reference/1"));
+            REQUIRE(parser.has_line("test/referenced_2/1"));
+            REQUIRE_FALSE(parser.has_line("test/referenced/3"));
+        }
+    }
+
+    SECTION("Line objects are only made when they are used") {
+        parser.parse("test/text_input");
+
+        REQUIRE(lines.raw_get<sol::object>("test/text_input/1").get_type() == sol::type::lua_nil);
+
+        auto l1 = lines["test/text_input/1"].get<TerminalTextInputLineData>();
+        REQUIRE(l1.variable == "v1");
+        REQUIRE(lines.raw_get<sol::object>("test/text_input/1").is<TerminalTextInputLineData>());
+
+        REQUIRE(lines["test/text_input/missing"].get<sol::object>().get_type() == sol::type::lua_nil);
+    }
+
+    SECTION("Parsing a file again replaces the objects of its lines") {
+        parser.parse("test/text_input");
+        lines["test/text_input/1"].get<TerminalTextInputLineData>();
+
+        parser.parse("test/text_input");
+        REQUIRE(lines.raw_get<sol::object>("test/text_input/1").get_type() == sol::type::lua_nil);
+        REQUIRE(lines["test/text_input/1"].get<TerminalTextInputLineData>().variable == "v1");
+    }
+
+    SECTION("Multiple files can be parsed at once") {
+        parser.parse(std::vector<std::string> { "test/reference", "test/text_input", "test/numbered_lines" });
+
+        REQUIRE(lines["test/referenced_2/1"].get<TerminalOutputLineData>().text == "referenced-2");
+        REQUIRE(lines["test/text_input/1"].get<TerminalTextInputLineData>().variable == "v1");
+        REQUIRE(lines["test/numbered_lines/1"].get<TerminalOutputLineData>().next == "test/numbered_lines/2");
+    }
+
+    SECTION("Circular references parse each file once") {
+        parser.parse("test/circular_a");
+
+        auto a = lines["test/circular_a/1"].get<TerminalOutputLineData>();
+        auto b = lines[a.next].get<TerminalOutputLineData>();
+
+        REQUIRE(b.text == "circular-b");
+        REQUIRE(b.next == "test/circular_a/1");
+    }
+
+    SECTION("Line text is split into template parts") {
+        parser.parse("test/templates");
+
+        auto plain = lines["test/templates/1"].get<TerminalOutputLineData>();
+        REQUIRE(plain.text_template.get_kind() == TextTemplate::Kind::Plain);
+
+        auto substitutions = lines["test/templates/2"].get<TerminalOutputLineData>();
+        REQUIRE(substitutions.text_template.get_kind() == TextTemplate::Kind::Substitutions);
+        REQUIRE(substitutions.text_template.get_segments().size() == 4);
+
+        sol::table env = lua.create_table_with("name", "someone", "age", 3);
+        REQUIRE(substitutions.text_template.render(sol::this_state { lua.lua_state() }, env, "test/templates/2") == "hello someone, you are 3");
+
+        auto code = lines["test/templates/3"].get<TerminalOutputLineData>();
+        REQUIRE(code.text_template.get_kind() == TextTemplate::Kind::Code);
+    }
+
+    SECTION("Substitutions can use the globals liluat allows") {
+        lua.open_libraries(sol::lib::base, sol::lib::string);
+        parser.parse("test/templates");
+
+        auto line = lines["test/templates/4"].get<TerminalOutputLineData>();
+        REQUIRE(line.text_template.get_kind() == TextTemplate::Kind::Substitutions);
+
+        sol::table env = lua.create_table_with("count", 2, "total", 5);
+        REQUIRE(line.text_template.render(sol::this_state { lua.lua_state() }, env, "test/templates/4") == "2 left of 5");
+    }
+
+    SECTION("Lines loaded from a bundle are the same as parsed ones") {
+        std::vector<StoryLine> parsed;
+        parser.parse_native("test/reference", StoryParser::default_base, parsed);
+        parser.parse_native("test/text_input", StoryParser::default_base, parsed);
+
+        StoryBundle::write("test_story.bundle", parsed);
+        parser.load_bundle("test_story.bundle");
+
+        REQUIRE(parser.has_namespace("test/referenced_2"));
+
+        auto referenced = lines["test/referenced/1"].get<TerminalOutputLineData>();
+        REQUIRE(referenced.text == "referenced");
+        REQUIRE(referenced.character_config.color == sf::Color(0, 0, 0));
+
+        auto responses = lines["test/referenced/2"].get<TerminalVariantInputLineData>();
+        REQUIRE(responses.variants.size() == 1);
+        REQUIRE(responses.variants.front().next == "test/referenced_2/1");
+
+        auto text_input = lines["test/text_input/1"].get<TerminalTextInputLineData>();
+        REQUIRE(text_input.variable == "v1");
+        REQUIRE(text_input.max_length == 1);
+
+        std::filesystem::remove("test_story.bundle");
     }
 
     SECTION("Text input lines parse correctly") {
@@ -144,5 +243,10 @@ TEST_CASE("Story parser", "[story_parser]") {
 
         auto data_vec_map = data_vec[4].as<std::map<std::string, std::string>>();
         REQUIRE(data_vec_map["a"] == "b");
+
+        REQUIRE_NOTHROW(parser.validate_custom_lines());
+
+        parser.parse("test/custom_missing");
+        REQUIRE_THROWS(parser.validate_custom_lines());
     }
 }
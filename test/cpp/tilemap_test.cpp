@@ -0,0 +1,109 @@
+#include "catch2/catch.hpp"
+
+#include "sol/sol.hpp"
+
+#include "tilemap.hpp"
+
+TEST_CASE("Tilemap", "[tilemap]") {
+    sol::state lua;
+
+    auto map = Tilemap::load(sol::this_state(lua), "resources/tilemaps/test/map.json");
+
+    SECTION("Map and tileset metadata are loaded") {
+        REQUIRE(map.width == 4);
+        REQUIRE(map.tile_height == 16);
+
+        REQUIRE(map.tilesets.size() == 1);
+        REQUIRE(map.tilesets[0].name == "test_tiles");
+        REQUIRE(map.tilesets[0].image_path == "resources/tilemaps/test/tiles.png");
+        REQUIRE(map.tilesets[0].columns == 4);
+    }
+
+    SECTION("Compressed layer data is decoded") {
+        auto &layer = map.layers[0];
+
+        REQUIRE(layer.type == "tilelayer");
+        REQUIRE(layer.data.size() == 12);
+        REQUIRE(layer.data[1] == 2);
+        REQUIRE(layer.data[5] == (3 | Tilemap::flipped_horizontally_flag));
+        REQUIRE(layer.data[8] == 5);
+    }
+
+    SECTION("Uncompressed layer data is loaded") {
+        auto &layer = map.layers[1];
+
+        REQUIRE(layer.data == std::vector<uint32_t> { 4, 0 });
+        REQUIRE(layer.typed_tiles.empty());
+    }
+
+    SECTION("GIDs are resolved through the lookup") {
+        REQUIRE(map.tileset_of(0) == 0);
+        REQUIRE(map.tileset_of(5) == 1);
+        REQUIRE(map.tileset_of(3 | Tilemap::flipped_vertically_flag) == 1);
+        REQUIRE(map.tileset_of(100) == 0);
+
+        auto frame = map.frame_of(5);
+        REQUIRE(frame.left == 0);
+        REQUIRE(frame.top == 16);
+        REQUIRE(frame.width == 16);
+        REQUIRE(map.type_of(2) == "Wall");
+        REQUIRE(map.type_of(1).empty());
+    }
+
+    SECTION("Only typed tiles are collected") {
+        auto &typed = map.layers[0].typed_tiles;
+
+        REQUIRE(typed.size() == 3);
+
+        REQUIRE(typed[0].type == "Wall");
+        REQUIRE(typed[0].x == 1);
+        REQUIRE(typed[0].y == 0);
+
+        REQUIRE(typed[2].type == "Player");
+        REQUIRE(typed[2].x == 1);
+        REQUIRE(typed[2].y == 1);
+        REQUIRE(typed[2].flips == 4);
+        REQUIRE(typed[2].frame.left == 32);
+        REQUIRE(typed[2].frame.top == 0);
+    }
+
+    SECTION("Object properties are converted") {
+        sol::table obj = map.layers[2].objects[1];
+
+        REQUIRE(obj.get<int>("x") == 16);
+        REQUIRE(obj["properties"]["interaction"].get<std::string>() == "open_door");
+        REQUIRE(obj["properties"]["trigger"].get<bool>());
+    }
+}
+
+TEST_CASE("Tile layer data decoding", "[tilemap]") {
+    std::vector<uint32_t> expected { 1, 2, 3, 4 | Tilemap::flipped_horizontally_flag };
+    std::vector<uint32_t> data;
+
+    SECTION("Uncompressed data is decoded") {
+        Tilemap::decode_layer_data("AQAAAAIAAAADAAAABAAAgA==", "", 4, data);
+
+        REQUIRE(data == expected);
+    }
+
+    SECTION("Whitespace in base64 is skipped") {
+        Tilemap::decode_layer_data("AQAAAAIA\nAAADAAAA BAAAgA==", "", 4, data);
+
+        REQUIRE(data == expected);
+    }
+
+    SECTION("Gzip compressed data is decoded") {
+        Tilemap::decode_layer_data("H4sIAAAAAAACA2NkYGBgAmJmIGZhYGgAAM9XvUIQAAAA", "gzip", 4, data);
+
+        REQUIRE(data == expected);
+    }
+
+    SECTION("Missing data is an error") {
+        REQUIRE_THROWS(Tilemap::decode_layer_data("AQAAAAIAAAADAAAABAAAgA==", "", 6, data));
+        REQUIRE_THROWS(Tilemap::decode_layer_data("H4sIAAAAAAACA2NkYGBgAmJmIGZhYGgAAM9XvUIQAAAA", "gzip", 6, data));
+    }
+
+    SECTION("Unknown compression is an error") {
+        REQUIRE_THROWS(Tilemap::decode_layer_data("AAAA", "lzma", 1, data));
+    }
+}